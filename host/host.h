@@ -0,0 +1,63 @@
+/*
+host/host.h
+This file defines the host harness interface: test and benchmark registration, checks,
+and the few host services the tests use. Tests include kernel headers, so they must not include
+C library headers, which declare puts, strcmp and memcpy differently. Only main.c talks to the C library.
+*/
+#pragma once
+
+#include "types.h"
+#include "bench/bench.h"
+#include "graph/graphic_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_SCREEN_WIDTH 320
+#define HOST_SCREEN_HEIGHT 240
+
+typedef struct {
+    const char *name;
+    void (*run)();
+} host_test;
+
+/*
+Defines and registers a test. Like the kernel's benchmarks, tests are collected in a linker section,
+so each test file needs no central list.
+Example usage: HOST_TEST(talloc_reuses_freed_block) { CHECK_EQ(talloc(0x1000), p); }
+*/
+#define HOST_TEST(id) \
+    static void host_test_##id(); \
+    static const host_test host_test_entry_##id __attribute__((used, section("host_tests"), aligned(8))) = \
+        { #id, host_test_##id }; \
+    static void host_test_##id()
+
+/*
+Registers a benchmark, with the same signature and runner rules as BENCHMARK in kernel/bench/bench.h.
+Example usage: HOST_BENCHMARK(format_buffer, 0, bench_format, 0);
+*/
+#define HOST_BENCHMARK(id, setup_fn, run_fn, teardown_fn) \
+    static const benchmark host_bench_##id __attribute__((used, section("host_benchmarks"), aligned(8))) = \
+        { #id, (setup_fn), (run_fn), (teardown_fn) }
+
+/*
+Checks record a failure and let the test carry on, so one run reports every broken expectation.
+*/
+#define CHECK(cond) host_check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) host_check_eq((uint64_t)(a), (uint64_t)(b), #a, #b, __FILE__, __LINE__)
+#define CHECK_STR(a, b) host_check_str((a), (b), #a, __FILE__, __LINE__)
+
+void host_check(bool ok, const char *expr, const char *file, int line);
+void host_check_eq(uint64_t a, uint64_t b, const char *expr_a, const char *expr_b, const char *file, int line);
+void host_check_str(const char *a, const char *b, const char *expr, const char *file, int line);
+
+bool host_panics(void (*fn)(void *ctx), void *ctx); // Runs fn and reports whether it called panic
+void host_panic(const char *msg, uint64_t info); // Called by the panic stubs
+void host_write(const char *s, uint32_t len);
+surface host_screen(); // Brings up graphics.c on its ramfb path on first use, HOST_SCREEN_WIDTH x HOST_SCREEN_HEIGHT
+uint64_t host_time_ns();
+
+#ifdef __cplusplus
+}
+#endif
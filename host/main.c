@@ -0,0 +1,180 @@
+/*
+host/main.c
+This file implements the host harness runner. It loads the board's device tree, then runs every
+registered test, or with --bench every registered benchmark, optionally filtered by a name substring.
+Benchmarks are scaled and timed like the kernel's suite, with the monotonic clock, and print the same
+JSON lines, so host and QEMU results can be compared with the same tools.
+Example usage: ./hosttest --bench format
+*/
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include "host.h"
+
+#define HOST_DTB_MAX 0x100000
+
+extern const host_test __start_host_tests[];
+extern const host_test __stop_host_tests[];
+extern const benchmark __start_host_benchmarks[] __attribute__((weak));
+extern const benchmark __stop_host_benchmarks[] __attribute__((weak));
+
+static uint8_t dtb_image[HOST_DTB_MAX] __attribute__((aligned(8)));
+uint8_t *host_dtb = dtb_image;
+
+static uint32_t failures;
+static const char *current_test;
+
+static jmp_buf *panic_target;
+
+void host_write(const char *s, uint32_t len) {
+    fwrite(s, 1, len, stdout);
+}
+
+uint64_t host_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fail(const char *file, int line) {
+    failures++;
+    printf("  FAIL %s at %s:%d: ", current_test, file, line);
+}
+
+void host_check(bool ok, const char *expr, const char *file, int line) {
+    if (ok) return;
+    fail(file, line);
+    printf("%s\n", expr);
+}
+
+void host_check_eq(uint64_t a, uint64_t b, const char *expr_a, const char *expr_b, const char *file, int line) {
+    if (a == b) return;
+    fail(file, line);
+    printf("%s == %s, got 0x%lx and 0x%lx\n", expr_a, expr_b, a, b);
+}
+
+void host_check_str(const char *a, const char *b, const char *expr, const char *file, int line) {
+    if (strcmp(a, b) == 0) return;
+    fail(file, line);
+    printf("%s is \"%s\", expected \"%s\"\n", expr, a, b);
+}
+
+void host_panic(const char *msg, uint64_t info) {
+    /*
+    A panic inside host_panics returns there. Anywhere else it is fatal, as in the kernel.
+    */
+    if (panic_target)
+        longjmp(*panic_target, 1);
+    printf("PANIC in %s: %s (0x%lx)\n", current_test ? current_test : "harness", msg, info);
+    fflush(stdout);
+    __builtin_trap();
+}
+
+bool host_panics(void (*fn)(void *ctx), void *ctx) {
+    jmp_buf target;
+    panic_target = &target;
+    bool panicked = true;
+    if (!setjmp(target)) {
+        fn(ctx);
+        panicked = false;
+    }
+    panic_target = 0;
+    return panicked;
+}
+
+static bool matches(const char *name, const char *filter) {
+    return !filter || strstr(name, filter);
+}
+
+static bool load_dtb(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    size_t len = fread(dtb_image, 1, sizeof(dtb_image), f);
+    fclose(f);
+    return len > 0;
+}
+
+static int run_tests(const char *filter) {
+    uint32_t run = 0;
+    for (const host_test *t = __start_host_tests; t < __stop_host_tests; t++) {
+        if (!matches(t->name, filter)) continue;
+        uint32_t before = failures;
+        current_test = t->name;
+        t->run();
+        printf("%s %s\n", failures == before ? "ok  " : "FAIL", t->name);
+        run++;
+    }
+    current_test = 0;
+    printf("%u tests, %u failed checks\n", run, failures);
+    return failures ? 1 : 0;
+}
+
+static uint64_t bench_scale(const benchmark *b, void *ctx) {
+    uint64_t iterations = 1;
+    while (1) {
+        uint64_t start = host_time_ns();
+        b->run(ctx, iterations);
+        uint64_t elapsed = host_time_ns() - start;
+        if (elapsed >= BENCH_TARGET_NS || iterations >= BENCH_MAX_ITERATIONS)
+            return iterations;
+        uint64_t next = elapsed ? (iterations * BENCH_TARGET_NS * 12) / (elapsed * 10) : iterations * 100;
+        if (next > iterations * 100) next = iterations * 100;
+        if (next <= iterations) next = iterations + 1;
+        iterations = next;
+    }
+}
+
+static void sort_u64(uint64_t *values, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint64_t v = values[i];
+        uint32_t j = i;
+        while (j > 0 && values[j - 1] > v) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = v;
+    }
+}
+
+static int run_benchmarks(const char *filter) {
+    for (const benchmark *b = __start_host_benchmarks; b < __stop_host_benchmarks; b++) {
+        if (!matches(b->name, filter)) continue;
+        void *ctx = b->setup ? b->setup() : 0;
+        uint64_t iterations = bench_scale(b, ctx);
+        uint64_t ns[BENCH_RUNS];
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            uint64_t start = host_time_ns();
+            b->run(ctx, iterations);
+            ns[i] = host_time_ns() - start;
+        }
+        if (b->teardown)
+            b->teardown(ctx);
+        sort_u64(ns, BENCH_RUNS);
+        uint64_t median_ps = ns[BENCH_RUNS / 2] * 1000 / iterations;
+        uint64_t min_ps = ns[0] * 1000 / iterations;
+        printf("{\"bench\":\"%s\",\"iterations\":%lu,\"runs\":%u,\"ns_per_iter\":%lu.%03lu,\"min_ns_per_iter\":%lu.%03lu,\"cycles_per_iter\":null}\n",
+            b->name, iterations, BENCH_RUNS, median_ps / 1000, median_ps % 1000, min_ps / 1000, min_ps % 1000);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bool bench = false;
+    const char *filter = 0;
+    const char *dtb = "../virt.dtb";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0)
+            bench = true;
+        else if (strcmp(argv[i], "--dtb") == 0 && i + 1 < argc)
+            dtb = argv[++i];
+        else
+            filter = argv[i];
+    }
+    if (!load_dtb(dtb)) {
+        printf("Could not read the device tree from %s, pass --dtb <file>\n", dtb);
+        return 2;
+    }
+    return bench ? run_benchmarks(filter) : run_tests(filter);
+}
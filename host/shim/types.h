@@ -0,0 +1,42 @@
+/*
+host/shim/types.h
+This file stands in for shared/types.h in the host build. The typedefs are the kernel's, so both
+can be included in one translation unit, and they keep the LP64 layout the kernel code relies on.
+Unlike the kernel header it can be included next to the C library headers,
+and it points the device tree parser at the DTB the host harness loads.
+*/
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int uint32_t;
+typedef unsigned long uint64_t;
+typedef unsigned long uintptr_t;
+typedef unsigned short uint16_t;
+typedef unsigned char uint8_t;
+
+typedef int int32_t;
+typedef long int64_t;
+typedef long intptr_t;
+typedef short int16_t;
+typedef char int8_t;
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern uint8_t *host_dtb; // Loaded from virt.dtb by the harness, QEMU places it at 0x40000000
+#define DTB_ADDR ((uint64_t)host_dtb)
+
+#ifdef __cplusplus
+}
+#else
+
+typedef unsigned int bool;
+
+#define true 1
+#define false 0
+
+#endif
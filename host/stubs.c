@@ -0,0 +1,143 @@
+/*
+host/stubs.c
+This file provides the host build's stand-ins for what the tested kernel code links against:
+the linker script's memory symbols, the assembly routines, logging, panics, and the hardware
+behind the scheduler, fw_cfg and the virtio GPU. Console output goes to stdout, raw and formatted alike.
+The virtio GPU is reported as absent, so graphics.c selects ramfb, which draws into the host heap.
+*/
+#include "host.h"
+#include "ram_e.h"
+#include "kstring.h"
+#include "console/klog.h"
+#include "trace.h"
+#include "fw/fw_cfg.h"
+#include "mmu.h"
+#include "process/scheduler.h"
+#include "process/proc_allocator.h"
+#include "graph/drivers/virtio_gpu_pci/virtio_gpu_pci_driver.h"
+#include "graph/graphics.h"
+
+#define HOST_HEAP_SIZE "0x2000000" // 32 MB, the first 5 MB are talloc's and the rest palloc's
+
+/*
+heap_bottom and heap_limit must bound one block, as they do in linker.ld, so they are laid out in assembly.
+*/
+asm(".pushsection .bss\n"
+    ".balign 4096\n"
+    ".globl heap_bottom\n"
+    "heap_bottom:\n"
+    ".skip " HOST_HEAP_SIZE "\n"
+    ".globl heap_limit\n"
+    "heap_limit:\n"
+    ".skip 8\n"
+    ".popsection\n");
+
+uint64_t kernel_start;
+uint64_t kcode_end;
+uint64_t kfull_end;
+uint64_t shared_start;
+uint64_t shared_end;
+
+void memcpy_simd(void *dest, const void *src, uint64_t count) {
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    while (count--)
+        *d++ = *s++;
+}
+
+void memset32_simd(void *dest, uint32_t value, uint64_t count) {
+    uint32_t *d = dest;
+    for (uint64_t i = 0; i < count / 4; i++)
+        d[i] = value;
+}
+
+uint8_t klog_levels[KLOG_SYS_COUNT] = { [0 ... KLOG_SYS_COUNT - 1] = KLOG_INFO };
+
+static void stdout_sink(void *ctx, const char *s, uint32_t len) {
+    host_write(s, len);
+}
+
+void kprintf_args(const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    format_args(stdout_sink, 0, fmt, args, arg_count);
+    host_write("\n", 1);
+}
+
+void kprintf_args_raw(const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    kprintf_args(fmt, args, arg_count);
+}
+
+void klog_args(uint8_t level, const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    kprintf_args(fmt, args, arg_count);
+}
+
+void uart_raw_puts(const char *s) {
+    uint32_t len = 0;
+    while (s[len]) len++;
+    host_write(s, len);
+}
+
+void panic(const char *msg) {
+    host_panic(msg, 0);
+}
+
+void panic_with_info(const char *msg, uint64_t info) {
+    host_panic(msg, info);
+}
+
+volatile uint32_t trace_mask;
+
+void trace_record_event(uint32_t event, uint64_t arg0, uint64_t arg1) {
+}
+
+uint64_t irq_save() {
+    return 0;
+}
+
+void irq_restore(uint64_t daif) {
+}
+
+void boot_stage_begin(const char *name) {
+}
+
+void boot_stage_end() {
+}
+
+bool fw_find_file(kstring search, struct fw_cfg_file *file) {
+    file->selector = 0x20; // Any non zero selector, the ramfb configuration write is dropped
+    return true;
+}
+
+void fw_cfg_dma_write(void *dest, uint32_t size, uint32_t ctrl) {
+}
+
+void register_cached_memory(uint64_t pa, uint64_t size) {
+}
+
+static process_t procs[MAX_PROCS];
+static int proc_count;
+
+process_t* init_process() {
+    process_t *proc = &procs[proc_count % MAX_PROCS];
+    proc->id = proc_count++ % MAX_PROCS;
+    return proc;
+}
+
+void* alloc_proc_mem(uint64_t size, bool kernel) {
+    return (void*)palloc(size);
+}
+
+bool vgp_init(uint32_t width, uint32_t height) {
+    return false;
+}
+
+uint64_t vgp_flush() { return 0; }
+bool vgp_fence_poll(uint64_t fence) { return true; }
+void vgp_flush_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {}
+surface vgp_get_surface() { return (surface){0}; }
+void vgp_damage(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {}
+
+surface host_screen() {
+    if (!gpu_ready())
+        gpu_init((size){HOST_SCREEN_WIDTH, HOST_SCREEN_HEIGHT});
+    return gpu_get_surface();
+}
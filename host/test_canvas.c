@@ -0,0 +1,114 @@
+/*
+host/test_canvas.c
+This file tests the software rasterizer in kernel/graph/canvas.c on a plain surface, without a GPU:
+clipping, the damage each primitive returns and the fast paths for full rows and straight lines.
+*/
+#include "host.h"
+#include "graph/canvas.h"
+#include "ram_e.h"
+
+#define CANVAS_W 64
+#define CANVAS_H 48
+
+static surface test_surface(uint32_t stride_pixels) {
+    surface s = {
+        .base = palloc(stride_pixels * CANVAS_H * 4),
+        .width = CANVAS_W,
+        .height = CANVAS_H,
+        .stride = stride_pixels * 4,
+    };
+    memset((void*)s.base, 0, s.stride * CANVAS_H);
+    return s;
+}
+
+static uint32_t px(surface s, uint32_t x, uint32_t y) {
+    return ((uint32_t*)(s.base + y * s.stride))[x];
+}
+
+static uint32_t count_color(surface s, uint32_t color) {
+    uint32_t n = 0;
+    for (uint32_t y = 0; y < s.height; y++)
+        for (uint32_t x = 0; x < s.width; x++)
+            n += px(s, x, y) == color;
+    return n;
+}
+
+HOST_TEST(canvas_fill_full_rows_keeps_padding) {
+    surface s = test_surface(CANVAS_W + 8);
+    rect d = canvas_fill_rect(s, (rect){{0, 4}, {CANVAS_W, 3}}, 0xAB);
+    CHECK_EQ(d.point.y, 4);
+    CHECK_EQ(d.size.height, 3);
+    CHECK_EQ(count_color(s, 0xAB), CANVAS_W * 3);
+    CHECK_EQ(((uint32_t*)(s.base + 4 * s.stride))[CANVAS_W], 0); // Stride padding is left alone
+}
+
+HOST_TEST(canvas_pixel_off_surface_is_empty) {
+    surface s = test_surface(CANVAS_W);
+    rect d = canvas_draw_pixel(s, (point){CANVAS_W, 0}, 0xFF);
+    CHECK_EQ(d.size.width, 0);
+    CHECK_EQ(count_color(s, 0xFF), 0);
+    d = canvas_draw_pixel(s, (point){3, 2}, 0xFF);
+    CHECK_EQ(d.size.width, 1);
+    CHECK_EQ(px(s, 3, 2), 0xFF);
+}
+
+HOST_TEST(canvas_line_clips_and_reports_bounds) {
+    surface s = test_surface(CANVAS_W);
+    rect d = canvas_draw_line(s, (point){10, 10}, (point){100, 40}, 0x11);
+    CHECK_EQ(d.point.x, 10);
+    CHECK_EQ(d.point.y, 10);
+    CHECK_EQ(d.point.x + d.size.width, CANVAS_W);
+    CHECK(px(s, 10, 10) == 0x11);
+    CHECK(count_color(s, 0x11) == CANVAS_W - 10); // One pixel per column while x is the major axis
+}
+
+HOST_TEST(canvas_line_diagonal_both_directions) {
+    surface s = test_surface(CANVAS_W);
+    canvas_draw_line(s, (point){20, 20}, (point){10, 30}, 0x22);
+    CHECK_EQ(count_color(s, 0x22), 11);
+    CHECK_EQ(px(s, 20, 20), 0x22);
+    CHECK_EQ(px(s, 15, 25), 0x22);
+    CHECK_EQ(px(s, 10, 30), 0x22);
+}
+
+HOST_TEST(canvas_straight_lines_use_fill) {
+    surface s = test_surface(CANVAS_W);
+    rect d = canvas_draw_line(s, (point){30, 5}, (point){2, 5}, 0x33);
+    CHECK_EQ(d.point.x, 2);
+    CHECK_EQ(d.size.width, 29);
+    CHECK_EQ(d.size.height, 1);
+    d = canvas_draw_line(s, (point){7, 0}, (point){7, 200}, 0x44);
+    CHECK_EQ(d.size.height, CANVAS_H);
+    CHECK_EQ(count_color(s, 0x44), CANVAS_H);
+}
+
+HOST_TEST(canvas_scaled_char_clips_at_edge) {
+    surface s = test_surface(CANVAS_W);
+    rect d = canvas_draw_char(s, (point){CANVAS_W - 6, 0}, '#', 2, 0x55);
+    CHECK_EQ(d.point.x + d.size.width, CANVAS_W);
+    CHECK(count_color(s, 0x55) > 0);
+    for (uint32_t y = 0; y < CANVAS_H; y++)
+        for (uint32_t x = 0; x < CANVAS_W - 6; x++)
+            CHECK_EQ(px(s, x, y), 0);
+    d = canvas_draw_char(s, (point){CANVAS_W, 0}, '#', 2, 0x55);
+    CHECK_EQ(d.size.width, 0);
+}
+
+HOST_TEST(canvas_char_matches_font) {
+    surface s = test_surface(CANVAS_W);
+    canvas_draw_char(s, (point){0, 0}, '|', 3, 0x66);
+    // The bar is the two middle columns of the glyph, three pixels wide each at scale 3
+    CHECK_EQ(px(s, 9, 0), 0x66);
+    CHECK_EQ(px(s, 14, 3), 0x66);
+    CHECK_EQ(px(s, 8, 0), 0);
+    CHECK_EQ(px(s, 15, 0), 0);
+}
+
+HOST_TEST(canvas_string_bounds_cover_lines) {
+    surface s = test_surface(CANVAS_W);
+    rect d = canvas_draw_string(s, string_l("abc\nd"), (point){4, 4}, 1, 0x77);
+    CHECK_EQ(d.point.x, 4);
+    CHECK_EQ(d.point.y, 4);
+    CHECK_EQ(d.size.width, 3 * canvas_char_size(1));
+    CHECK_EQ(d.size.height, 2 * canvas_char_size(1) + 2);
+}
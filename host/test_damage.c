@@ -0,0 +1,68 @@
+/*
+host/test_damage.c
+This file tests the damage list in kernel/graph/damage.c: clipping, containment, merging once full
+and coalescing before presenting.
+*/
+#include "host.h"
+#include "graph/damage.h"
+
+static const size bounds = {100, 80};
+
+HOST_TEST(damage_clips_and_drops_empty) {
+    damage_list d = {0};
+    damage_add(&d, (rect){{90, 70}, {50, 50}}, bounds);
+    damage_add(&d, (rect){{100, 0}, {5, 5}}, bounds);
+    damage_add(&d, (rect){{10, 10}, {0, 5}}, bounds);
+    CHECK_EQ(d.count, 1);
+    CHECK_EQ(d.rects[0].size.width, 10);
+    CHECK_EQ(d.rects[0].size.height, 10);
+}
+
+HOST_TEST(damage_skips_contained_and_replaces_covered) {
+    damage_list d = {0};
+    damage_add(&d, (rect){{10, 10}, {20, 20}}, bounds);
+    damage_add(&d, (rect){{15, 15}, {5, 5}}, bounds);
+    CHECK_EQ(d.count, 1);
+    damage_add(&d, (rect){{50, 50}, {4, 4}}, bounds);
+    damage_add(&d, (rect){{0, 0}, {40, 40}}, bounds);
+    CHECK_EQ(d.count, 2);
+    CHECK_EQ(d.rects[0].point.x, 50);
+    CHECK_EQ(d.rects[1].size.width, 40);
+}
+
+HOST_TEST(damage_merges_into_nearest_when_full) {
+    damage_list d = {0};
+    for (uint32_t i = 0; i < DAMAGE_RECTS; i++)
+        damage_add(&d, (rect){{i * 10, 0}, {2, 2}}, bounds);
+    CHECK_EQ(d.count, DAMAGE_RECTS);
+    damage_add(&d, (rect){{33, 0}, {2, 2}}, bounds);
+    CHECK_EQ(d.count, DAMAGE_RECTS);
+    CHECK_EQ(d.rects[3].point.x, 30); // The 30,0 rectangle grows least
+    CHECK_EQ(d.rects[3].size.width, 5);
+    rect all = damage_bounds(&d);
+    CHECK_EQ(all.point.x, 0);
+    CHECK_EQ(all.size.width, (DAMAGE_RECTS - 1) * 10 + 2);
+    damage_clear(&d);
+    CHECK_EQ(damage_bounds(&d).size.width, 0);
+}
+
+HOST_TEST(damage_coalesce_merges_strips_and_neighbours) {
+    damage_list d = {0};
+    damage_add(&d, (rect){{0, 0}, {50, 8}}, bounds);
+    damage_add(&d, (rect){{0, 8}, {50, 8}}, bounds); // Adjacent text rows merge at no cost
+    damage_add(&d, (rect){{90, 70}, {4, 4}}, bounds); // Far away, the union would cover far more
+    damage_coalesce(&d, 64);
+    CHECK_EQ(d.count, 2);
+    CHECK_EQ(d.rects[0].size.height, 16);
+    CHECK_EQ(damage_area(&d), 50 * 16 + 16);
+
+    damage_add(&d, (rect){{52, 0}, {2, 16}}, bounds); // Two pixels away, 32 pixels of waste
+    damage_coalesce(&d, 64);
+    CHECK_EQ(d.count, 2);
+    CHECK_EQ(d.rects[0].size.width, 54);
+
+    damage_coalesce(&d, 100 * 80); // With expensive commands everything is one rectangle
+    CHECK_EQ(d.count, 1);
+    CHECK_EQ(d.rects[0].size.width, 94);
+    CHECK_EQ(d.rects[0].size.height, 74);
+}
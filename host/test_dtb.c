@@ -0,0 +1,65 @@
+/*
+host/test_dtb.c
+This file tests the device tree scanner in kernel/dtb.c against the virt board's DTB.
+*/
+#include "host.h"
+#include "dtb.h"
+#include "kstring.h"
+
+int get_memory_region(uint64_t *out_base, uint64_t *out_size);
+
+HOST_TEST(dtb_header) {
+    uint64_t start = 0, size = 0;
+    CHECK(dtb_addresses(&start, &size));
+    CHECK_EQ(start, (uint64_t)host_dtb);
+    CHECK(size > 0x40 && size <= 0x100000);
+}
+
+HOST_TEST(dtb_memory_region) {
+    uint64_t start, size;
+    dtb_addresses(&start, &size);
+    uint64_t base = 0;
+    size = 0;
+    CHECK(get_memory_region(&base, &size));
+    CHECK_EQ(base, 0x40000000);
+    CHECK(size >= 0x8000000);
+}
+
+static int handle_uart(const char *name, const char *propname, const void *prop, uint32_t len, dtb_match_t *match) {
+    const uint32_t *p = prop;
+    if (strcmp(propname, "reg") == 0 && len >= 16) {
+        match->reg_base = ((uint64_t)__builtin_bswap32(p[0]) << 32) | __builtin_bswap32(p[1]);
+        match->reg_size = ((uint64_t)__builtin_bswap32(p[2]) << 32) | __builtin_bswap32(p[3]);
+        match->found = true;
+    } else if (strcmp(propname, "interrupts") == 0 && len >= 12) {
+        match->irq = __builtin_bswap32(p[1]) + 32; // SPI number to GIC interrupt ID
+    }
+    return 0;
+}
+
+HOST_TEST(dtb_scan_finds_uart) {
+    uint64_t start, size;
+    dtb_addresses(&start, &size);
+    dtb_match_t match = {0};
+    CHECK(dtb_scan("pl011", handle_uart, &match));
+    CHECK_EQ(match.reg_base, 0x09000000);
+    CHECK_EQ(match.reg_size, 0x1000);
+    CHECK_EQ(match.irq, 33);
+}
+
+HOST_TEST(dtb_scan_missing_node) {
+    uint64_t start, size;
+    dtb_addresses(&start, &size);
+    dtb_match_t match = {0};
+    CHECK(!dtb_scan("no-such-device", handle_uart, &match));
+}
+
+static void bench_dtb_scan(void *ctx, uint64_t iterations) {
+    uint64_t start, size;
+    dtb_addresses(&start, &size);
+    for (uint64_t i = 0; i < iterations; i++) {
+        dtb_match_t match = {0};
+        bench_keep(dtb_scan("pl011", handle_uart, &match));
+    }
+}
+HOST_BENCHMARK(dtb_scan_pl011, 0, bench_dtb_scan, 0);
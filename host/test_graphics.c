@@ -0,0 +1,174 @@
+/*
+host/test_graphics.c
+This file tests font rasterization and the drawing primitives of graphics.c on the ramfb path,
+reading the pixels back from the back buffer, and that flushing copies the damage to the scanout buffer.
+*/
+#include "host.h"
+#include "ram_e.h"
+#include "graph/graphics.h"
+#include "graph/font8x8_basic.h"
+
+static uint32_t pixel(surface s, uint32_t x, uint32_t y) {
+    return ((uint32_t*)s.base)[y * (s.stride / 4) + x];
+}
+
+static uint32_t count_color(surface s, uint32_t color) {
+    uint32_t n = 0;
+    for (uint32_t y = 0; y < s.height; y++)
+        for (uint32_t x = 0; x < s.width; x++)
+            n += pixel(s, x, y) == color;
+    return n;
+}
+
+static bool glyph_matches(surface s, uint32_t x0, uint32_t y0, char c, uint32_t scale, uint32_t color) {
+    /*
+    Every pixel of the scaled cell must be the color where the glyph bit is set and untouched elsewhere.
+    */
+    for (uint32_t row = 0; row < 8 * scale; row++) {
+        for (uint32_t col = 0; col < 8 * scale; col++) {
+            bool set = font8x8_basic[(uint8_t)c][row / scale] & (1 << (7 - col / scale));
+            if (pixel(s, x0 + col, y0 + row) != (set ? color : 0))
+                return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t glyph_bits(char c) {
+    uint32_t n = 0;
+    for (int row = 0; row < 8; row++)
+        n += __builtin_popcount(font8x8_basic[(uint8_t)c][row]);
+    return n;
+}
+
+HOST_TEST(screen_is_ramfb) {
+    surface s = host_screen();
+    CHECK(gpu_ready());
+    CHECK(s.base != 0);
+    CHECK_EQ(s.width, HOST_SCREEN_WIDTH);
+    CHECK_EQ(s.height, HOST_SCREEN_HEIGHT);
+    CHECK_EQ(s.stride, HOST_SCREEN_WIDTH * 4);
+    CHECK_EQ(gpu_get_screen_size().width, HOST_SCREEN_WIDTH);
+}
+
+HOST_TEST(draw_char_rasterizes_glyph) {
+    surface s = host_screen();
+    gpu_clear(0);
+    gpu_draw_char((point){3, 5}, 'A', 1, 0xFFFFFFFF);
+    CHECK(glyph_matches(s, 3, 5, 'A', 1, 0xFFFFFFFF));
+    CHECK_EQ(count_color(s, 0xFFFFFFFF), glyph_bits('A'));
+}
+
+HOST_TEST(draw_char_scales) {
+    surface s = host_screen();
+    gpu_clear(0);
+    gpu_draw_char((point){16, 16}, 'g', 3, 0x00FF00);
+    CHECK(glyph_matches(s, 16, 16, 'g', 3, 0x00FF00));
+    CHECK_EQ(count_color(s, 0x00FF00), glyph_bits('g') * 9);
+    CHECK_EQ(gpu_get_char_size(3), 24);
+}
+
+HOST_TEST(draw_char_clips_at_edges) {
+    surface s = host_screen();
+    gpu_clear(0);
+    gpu_draw_char((point){s.width - 4, s.height - 4}, '#', 1, 0xFF);
+    uint32_t inside = 0;
+    for (int row = 0; row < 4; row++)
+        inside += __builtin_popcount(font8x8_basic['#'][row] & 0xF0);
+    CHECK_EQ(count_color(s, 0xFF), inside);
+    CHECK_EQ(pixel(s, 0, 0), 0); // Nothing wrapped onto the next row
+}
+
+HOST_TEST(draw_string_breaks_lines) {
+    surface s = host_screen();
+    gpu_clear(0);
+    gpu_draw_string(string_l("ab\nc"), (point){0, 0}, 1, 0xFFFFFFFF);
+    CHECK(glyph_matches(s, 0, 0, 'a', 1, 0xFFFFFFFF));
+    CHECK(glyph_matches(s, 8, 0, 'b', 1, 0xFFFFFFFF));
+    CHECK(glyph_matches(s, 0, 10, 'c', 1, 0xFFFFFFFF));
+}
+
+HOST_TEST(fill_rect_clips) {
+    surface s = host_screen();
+    gpu_clear(0);
+    gpu_fill_rect((rect){{s.width - 10, 20}, {100, 5}}, 0x123456);
+    CHECK_EQ(count_color(s, 0x123456), 10 * 5);
+    CHECK_EQ(pixel(s, s.width - 1, 24), 0x123456);
+    gpu_fill_rect((rect){{s.width, 0}, {10, 10}}, 0x654321);
+    CHECK_EQ(count_color(s, 0x654321), 0);
+}
+
+HOST_TEST(scroll_moves_region) {
+    surface s = host_screen();
+    gpu_clear(0);
+    gpu_fill_rect((rect){{0, 32}, {s.width, 16}}, 0xAA);
+    gpu_scroll((rect){{0, 0}, {s.width, s.height}}, 16, 0x11);
+    CHECK_EQ(pixel(s, 5, 16), 0xAA);
+    CHECK_EQ(pixel(s, 5, 31), 0xAA);
+    CHECK_EQ(pixel(s, 5, 32), 0);
+    CHECK_EQ(pixel(s, 5, s.height - 1), 0x11);
+    CHECK_EQ(count_color(s, 0x11), s.width * 16);
+
+    // A partial width region leaves the columns beside it alone
+    gpu_clear(0);
+    gpu_fill_rect((rect){{0, 8}, {s.width, 8}}, 0xBB);
+    gpu_scroll((rect){{10, 0}, {20, 40}}, 8, 0);
+    CHECK_EQ(pixel(s, 15, 0), 0xBB);
+    CHECK_EQ(pixel(s, 15, 8), 0);
+    CHECK_EQ(pixel(s, 5, 8), 0xBB);
+    CHECK_EQ(pixel(s, 5, 0), 0);
+}
+
+extern uint64_t fb_ptr;
+
+HOST_TEST(flush_copies_damage_to_scanout) {
+    surface s = host_screen();
+    surface scanout = s;
+    scanout.base = fb_ptr;
+    gpu_clear(0);
+    gpu_flush();
+    CHECK_EQ(count_color(scanout, 0), s.width * s.height);
+
+    gpu_fill_rect((rect){{20, 30}, {8, 4}}, 0x777777);
+    CHECK_EQ(count_color(scanout, 0x777777), 0); // Nothing shows until the flush
+    gpu_flush();
+    CHECK_EQ(count_color(scanout, 0x777777), 8 * 4);
+
+    // Writes straight into the surface show up with the rectangle flushed
+    ((uint32_t*)s.base)[5 * (s.stride / 4) + 6] = 0x999999;
+    ((uint32_t*)s.base)[100 * (s.stride / 4) + 100] = 0x999999;
+    gpu_flush_rect((rect){{0, 0}, {10, 10}});
+    CHECK_EQ(pixel(scanout, 6, 5), 0x999999);
+    CHECK_EQ(pixel(scanout, 100, 100), 0);
+}
+
+static void bench_draw_char(void *ctx, uint64_t iterations) {
+    host_screen();
+    for (uint64_t i = 0; i < iterations; i++)
+        gpu_draw_char((point){(i % 32) * 8, 64}, 'A' + i % 26, 1, 0xFFFFFFFF);
+}
+HOST_BENCHMARK(gpu_draw_char, 0, bench_draw_char, 0);
+
+static void bench_draw_string(void *ctx, uint64_t iterations) {
+    host_screen();
+    kstring s = string_l("The quick brown fox jumps over the lazy dog");
+    for (uint64_t i = 0; i < iterations; i++)
+        gpu_draw_string(s, (point){0, 96}, 1, 0xFFFFFFFF);
+}
+HOST_BENCHMARK(gpu_draw_string_43, 0, bench_draw_string, 0);
+
+static void bench_fill_rect(void *ctx, uint64_t iterations) {
+    host_screen();
+    for (uint64_t i = 0; i < iterations; i++)
+        gpu_fill_rect((rect){{16, 16}, {64, 64}}, 0xFF000000 | (uint32_t)i);
+}
+HOST_BENCHMARK(gpu_fill_rect_64x64, 0, bench_fill_rect, 0);
+
+static void bench_flush(void *ctx, uint64_t iterations) {
+    host_screen();
+    for (uint64_t i = 0; i < iterations; i++) {
+        gpu_draw_string(string_l("The quick brown fox"), (point){0, 96}, 1, 0xFFFFFFFF);
+        gpu_flush();
+    }
+}
+HOST_BENCHMARK(gpu_flush_text_line, 0, bench_flush, 0);
@@ -0,0 +1,103 @@
+/*
+host/test_kconsole.cpp
+This file tests the kernel console's character ring and incremental rendering. Whatever mix of
+writes, scrolls and renders produced a frame, it must match the visible text drawn from scratch.
+*/
+#include "host.h"
+#include "ram_e.h"
+#include "kstring.h"
+#include "graph/graphics.h"
+#include "console/kconsole/kconsole.h"
+
+#define CONSOLE_ROWS (HOST_SCREEN_HEIGHT / 16)
+
+static bool screen_shows(surface s, const char **lines, uint32_t count) {
+    /*
+    Compares the framebuffer with the given lines drawn one per 16 pixel console row on a cleared screen.
+    The framebuffer is restored afterwards, so rendering can carry on from it.
+    */
+    uint64_t bytes = (uint64_t)s.stride * s.height;
+    void *actual = (void*)talloc(bytes);
+    memcpy(actual, (void*)s.base, bytes);
+    gpu_clear(0);
+    for (uint32_t i = 0; i < count; i++)
+        gpu_draw_string(string_l(lines[i]), {0, i * 16}, 1, 0xFFFFFFFF);
+    bool same = memcmp(actual, (void*)s.base, bytes) == 0;
+    memcpy((void*)s.base, actual, bytes);
+    temp_free(actual, bytes);
+    return same;
+}
+
+HOST_TEST(kconsole_renders_text) {
+    surface s = host_screen();
+    kconsole_clear();
+    kconsole_puts("Hello\nworld");
+    kconsole_render();
+    const char *lines[] = { "Hello", "world" };
+    CHECK(screen_shows(s, lines, 2));
+}
+
+HOST_TEST(kconsole_overwrites_dirty_cells_only) {
+    surface s = host_screen();
+    kconsole_clear();
+    kconsole_puts("abc");
+    kconsole_render();
+    ((uint32_t*)s.base)[s.width * 100 + 100] = 0x55; // Outside any dirty cell, must survive the next frame
+    kconsole_puts("d");
+    kconsole_render();
+    CHECK_EQ(((uint32_t*)s.base)[s.width * 100 + 100], 0x55);
+    ((uint32_t*)s.base)[s.width * 100 + 100] = 0;
+    const char *lines[] = { "abcd" };
+    CHECK(screen_shows(s, lines, 1));
+}
+
+HOST_TEST(kconsole_scrolls_ring) {
+    /*
+    Writes more lines than fit, rendering every few lines so scrolls and dirty cells combine in one frame.
+    Each line ends with a newline, so after k lines the view has scrolled k - rows + 1 times and the last row is blank.
+    */
+    surface s = host_screen();
+    kconsole_clear();
+    kconsole_render();
+    const uint32_t total = CONSOLE_ROWS + 7;
+    static char text[CONSOLE_ROWS + 7][16];
+    for (uint32_t i = 0; i < total; i++) {
+        format_buffer(text[i], sizeof(text[i]), "line %i", i);
+        kconsole_puts(text[i]);
+        kconsole_puts("\n");
+        if (i % 5 == 4)
+            kconsole_render();
+    }
+    kconsole_render();
+    const char *visible[CONSOLE_ROWS];
+    uint32_t first = total - CONSOLE_ROWS + 1;
+    for (uint32_t r = 0; r + 1 < CONSOLE_ROWS; r++)
+        visible[r] = text[first + r];
+    CHECK(screen_shows(s, visible, CONSOLE_ROWS - 1));
+}
+
+HOST_TEST(kconsole_wraps_long_lines) {
+    surface s = host_screen();
+    kconsole_clear();
+    char line[HOST_SCREEN_WIDTH / 8 + 4];
+    for (uint32_t i = 0; i < sizeof(line) - 1; i++)
+        line[i] = 'a' + i % 26;
+    line[sizeof(line) - 1] = 0;
+    kconsole_puts(line);
+    kconsole_render();
+    char first[HOST_SCREEN_WIDTH / 8 + 1];
+    for (uint32_t i = 0; i < HOST_SCREEN_WIDTH / 8; i++)
+        first[i] = line[i];
+    first[HOST_SCREEN_WIDTH / 8] = 0;
+    const char *lines[] = { first, line + HOST_SCREEN_WIDTH / 8 };
+    CHECK(screen_shows(s, lines, 2));
+}
+
+static void bench_console_line(void *ctx, uint64_t iterations) {
+    host_screen();
+    for (uint64_t i = 0; i < iterations; i++) {
+        kconsole_puts("[    1.234567] virtio-gpu: resource attached\n");
+        kconsole_render();
+    }
+}
+HOST_BENCHMARK(kconsole_line_and_render, 0, bench_console_line, 0);
@@ -0,0 +1,110 @@
+/*
+host/test_kstring.c
+This file tests the string helpers and the formatter in kernel/kstring.c.
+*/
+#include "host.h"
+#include "kstring.h"
+
+HOST_TEST(format_conversions) {
+    char buf[128];
+    format_buffer(buf, sizeof(buf), "%i %d %u", -42, 7, 3000000000UL);
+    CHECK_STR(buf, "-42 7 3000000000");
+    format_buffer(buf, sizeof(buf), "%x %h %p", 0xBEEF, 255, 0x1000);
+    CHECK_STR(buf, "beef 0xFF 0x0000000000001000");
+    format_buffer(buf, sizeof(buf), "%c%s%%", 'k', (uint64_t)"ernel");
+    CHECK_STR(buf, "kernel%");
+    format_buffer(buf, sizeof(buf), "%li %lu %lx", -1, 18446744073709551615UL, 16);
+    CHECK_STR(buf, "-1 18446744073709551615 10");
+}
+
+HOST_TEST(format_width_and_flags) {
+    char buf[64];
+    format_buffer(buf, sizeof(buf), "%-8s|%04x|%5i|%-5i|", (uint64_t)"id", 0x2A, -12, 3);
+    CHECK_STR(buf, "id      |002a|  -12|3    |");
+    format_buffer(buf, sizeof(buf), "%06i", -12);
+    CHECK_STR(buf, "-00012");
+    format_buffer(buf, sizeof(buf), "%s", 0);
+    CHECK_STR(buf, "(null)");
+}
+
+HOST_TEST(format_missing_arguments_end_output) {
+    char buf[64];
+    uint32_t len = format_buffer(buf, sizeof(buf), "a %i b %i c", 1);
+    CHECK_STR(buf, "a 1 b ");
+    CHECK_EQ(len, 6);
+    format_buffer(buf, sizeof(buf), "trailing %");
+    CHECK_STR(buf, "trailing %");
+}
+
+HOST_TEST(format_unknown_conversion_keeps_arguments) {
+    char buf[64];
+    format_buffer(buf, sizeof(buf), "%q %i %s", 5, (uint64_t)"ok");
+    CHECK_STR(buf, "%q 5 ok");
+}
+
+HOST_TEST(format_buffer_truncates) {
+    char buf[8];
+    uint32_t len = format_buffer(buf, sizeof(buf), "%s", (uint64_t)"0123456789");
+    CHECK_EQ(len, 7);
+    CHECK_STR(buf, "0123456");
+    CHECK_EQ(format_buffer(buf, 0, "%s", (uint64_t)"x"), 0);
+}
+
+static char sink_data[512];
+static uint32_t sink_len;
+static uint32_t sink_calls;
+
+static void collect(void *ctx, const char *s, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++)
+        sink_data[sink_len++] = s[i];
+    sink_calls++;
+}
+
+HOST_TEST(format_args_streams_in_chunks) {
+    char text[201];
+    for (int i = 0; i < 200; i++)
+        text[i] = 'a' + i % 26;
+    text[200] = 0;
+    uint64_t args[] = { (uint64_t)text };
+    sink_len = sink_calls = 0;
+    uint64_t total = format_args(collect, 0, "[%s]", args, 1);
+    sink_data[sink_len] = 0;
+    CHECK_EQ(total, 202);
+    CHECK_EQ(sink_len, 202);
+    CHECK(sink_calls > 1 && sink_calls < 10);
+    CHECK_EQ(sink_data[0], '[');
+    CHECK_EQ(sink_data[1], 'a');
+    CHECK_EQ(sink_data[201], ']');
+}
+
+HOST_TEST(string_helpers) {
+    kstring s = string_l("hello");
+    CHECK_EQ(s.length, 5);
+    CHECK_EQ(string_ca_max("hello", 3).length, 3);
+    CHECK(string_equals(s, string_l("hello")));
+    CHECK(!string_equals(s, string_l("help")));
+    kstring hex = string_from_hex(0x1F);
+    CHECK_STR(hex.data, "0x1F");
+    CHECK_STR(string_from_hex(0).data, "0x0");
+    kstring formatted = string_format("%i-%s", 5, (uint64_t)"x");
+    CHECK_STR(formatted.data, "5-x");
+    CHECK_EQ(formatted.length, 3);
+}
+
+HOST_TEST(strcmp_and_strcont) {
+    CHECK_EQ(strcmp("abc", "abc"), 0);
+    CHECK(strcmp("abc", "abd") != 0);
+    CHECK(strcmp("ab", "abc") != 0);
+    CHECK(strcont("virtio,mmio", "mmio"));
+    CHECK(strcont("memory@40000000", "memory"));
+    CHECK(!strcont("pl011", "pl031"));
+}
+
+static void bench_format(void *ctx, uint64_t iterations) {
+    char buf[128];
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint32_t len = format_buffer(buf, sizeof(buf), "%-12s %i %x %h", (uint64_t)"benchmark", -(int64_t)i, i, i);
+        bench_keep(len);
+    }
+}
+HOST_BENCHMARK(format_buffer, 0, bench_format, 0);
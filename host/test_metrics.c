@@ -0,0 +1,78 @@
+/*
+host/test_metrics.c
+This file tests the histogram buckets and percentiles and the registry lookups of kernel/metrics.c.
+*/
+#include "host.h"
+#include "metrics.h"
+
+HOST_TEST(histogram_buckets_by_power_of_two) {
+    static histogram h;
+    histogram_observe(&h, 0);
+    histogram_observe(&h, 1);
+    histogram_observe(&h, 2);
+    histogram_observe(&h, 3);
+    histogram_observe(&h, 1000);
+    histogram_observe(&h, 1ULL << 40);
+    CHECK_EQ(h.buckets[0], 1);
+    CHECK_EQ(h.buckets[1], 1);
+    CHECK_EQ(h.buckets[2], 2);
+    CHECK_EQ(h.buckets[10], 1);
+    CHECK_EQ(h.buckets[METRIC_BUCKETS - 1], 1); // Values past the last bucket land in it
+    CHECK_EQ(h.count, 6);
+    CHECK_EQ(h.sum, 1006 + (1ULL << 40));
+    CHECK_EQ(h.max, 1ULL << 40);
+}
+
+HOST_TEST(histogram_percentiles) {
+    static histogram h;
+    CHECK_EQ(histogram_percentile(&h, 50), 0);
+    for (uint32_t i = 0; i < 99; i++)
+        histogram_observe(&h, 5);
+    histogram_observe(&h, 300);
+    CHECK_EQ(histogram_percentile(&h, 50), 7); // Top of the 4..7 bucket
+    CHECK_EQ(histogram_percentile(&h, 99), 7);
+    CHECK_EQ(histogram_percentile(&h, 100), 300); // 256..511, capped at the largest value seen
+}
+
+static uint64_t read_answer(void *ctx) {
+    return *(uint64_t*)ctx;
+}
+
+HOST_TEST(registry_finds_and_groups) {
+    static uint64_t answer = 42;
+    static histogram hist;
+    static metric counter = METRIC_COUNTER_INIT("test.counter", "calls");
+    static metric gauge = METRIC_GAUGE_INIT("test.gauge", "units", read_answer, &answer);
+    static metric timing = METRIC_HISTOGRAM_INIT("test.timing", "us", &hist);
+    static metric other = METRIC_COUNTER_INIT("tests", "calls");
+    metric_register(&counter);
+    metric_register(&gauge);
+    metric_register(&timing);
+    metric_register(&other);
+
+    CHECK(metric_find("test.gauge") == &gauge);
+    CHECK(metric_find("test") == 0);
+    CHECK(metric_find("test.gauge.x") == 0);
+
+    metric_add(&counter, 3);
+    metric_add(&counter, 1);
+    metric_observe(&timing, 10);
+    CHECK_EQ(metric_value(&counter), 4);
+    CHECK_EQ(metric_value(&gauge), 42);
+    CHECK_EQ(metric_value(&timing), 1);
+
+    uint32_t in_group = 0;
+    for (metric *m = metric_first(); m; m = m->next)
+        in_group += metric_in_group(m, "test");
+    CHECK_EQ(in_group, 3); // "tests" is a different group
+    CHECK(metric_in_group(&other, "tests"));
+    CHECK(metric_in_group(&counter, "")); // The empty group holds everything
+}
+
+static void bench_observe(void *ctx, uint64_t iterations) {
+    static histogram h;
+    for (uint64_t i = 0; i < iterations; i++)
+        histogram_observe(&h, i);
+    bench_keep(h.count);
+}
+HOST_BENCHMARK(histogram_observe, 0, bench_observe, 0);
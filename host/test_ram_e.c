@@ -0,0 +1,98 @@
+/*
+host/test_ram_e.c
+This file tests the temporary allocator's free list and the permanent allocator in kernel/ram_e.c,
+and the block copy and fill routines the host build substitutes for the assembly ones.
+*/
+#include "host.h"
+#include "ram_e.h"
+
+extern uint64_t heap_bottom;
+extern uint64_t heap_limit;
+
+#define TEMP_END ((uint64_t)&heap_bottom + 0x500000)
+
+HOST_TEST(talloc_rounds_to_pages) {
+    uint64_t a = talloc(1);
+    uint64_t b = talloc(0x1001);
+    CHECK_EQ(a & 0xFFF, 0);
+    CHECK_EQ(b & 0xFFF, 0);
+    CHECK(a >= (uint64_t)&heap_bottom && b + 0x2000 <= TEMP_END);
+    CHECK(b >= a + 0x1000 || a >= b + 0x2000);
+    temp_free((void*)b, 0x1001);
+    temp_free((void*)a, 1);
+}
+
+HOST_TEST(talloc_reuses_freed_block) {
+    uint64_t a = talloc(0x1000);
+    temp_free((void*)a, 0x1000);
+    CHECK_EQ(talloc(0x1000), a);
+    temp_free((void*)a, 0x1000);
+}
+
+HOST_TEST(talloc_takes_first_fitting_block) {
+    uint64_t small = talloc(0x1000);
+    uint64_t large = talloc(0x3000);
+    temp_free((void*)large, 0x3000);
+    temp_free((void*)small, 0x1000);
+    // The list is now small -> large. A request the small block cannot hold skips it
+    CHECK_EQ(talloc(0x2000), large);
+    CHECK_EQ(talloc(0x1000), small);
+    temp_free((void*)small, 0x1000);
+    temp_free((void*)large, 0x3000);
+}
+
+HOST_TEST(talloc_memory_is_usable) {
+    uint8_t *p = (uint8_t*)talloc(0x2000);
+    memset(p, 0xA5, 0x2000);
+    CHECK_EQ(p[0], 0xA5);
+    CHECK_EQ(p[0x1FFF], 0xA5);
+    temp_free(p, 0x2000);
+}
+
+static void overflow_temp(void *ctx) {
+    talloc(0x600000);
+}
+
+static void overflow_perm(void *ctx) {
+    palloc((uint64_t)&heap_limit - (uint64_t)&heap_bottom);
+}
+
+HOST_TEST(allocators_panic_on_overflow) {
+    uint64_t before = talloc(0x1000);
+    temp_free((void*)before, 0x1000);
+    CHECK(host_panics(overflow_temp, 0));
+    CHECK(host_panics(overflow_perm, 0));
+    CHECK_EQ(talloc(0x1000), before); // A failed allocation leaves the allocator as it was
+    temp_free((void*)before, 0x1000);
+}
+
+HOST_TEST(palloc_is_above_temp) {
+    uint64_t a = palloc(10);
+    uint64_t b = palloc(0x1000);
+    CHECK_EQ(a & 0xFFF, 0);
+    CHECK(a >= TEMP_END);
+    CHECK_EQ(b, a + 0x1000);
+    CHECK(b + 0x1000 <= (uint64_t)&heap_limit);
+}
+
+HOST_TEST(memory_routines) {
+    uint32_t words[64];
+    memset32_simd(words, 0x12345678, sizeof(words) - 8);
+    CHECK_EQ(words[0], 0x12345678);
+    CHECK_EQ(words[61], 0x12345678);
+    words[62] = 0;
+    uint8_t copy[256];
+    memcpy(copy, words, sizeof(copy) - 8);
+    CHECK_EQ(memcmp(copy, words, sizeof(copy) - 8), 0);
+    copy[10] ^= 1;
+    CHECK(memcmp(copy, words, sizeof(copy) - 8) != 0);
+}
+
+static void bench_talloc(void *ctx, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint64_t p = talloc(0x1000);
+        bench_keep(p);
+        temp_free((void*)p, 0x1000);
+    }
+}
+HOST_BENCHMARK(talloc_free_4k, 0, bench_talloc, 0);
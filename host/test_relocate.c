@@ -0,0 +1,93 @@
+/*
+host/test_relocate.c
+This file tests relocate_code from shared/process_loader.c. Code and data are copied between buffers
+in one arena, and the relocated branches and ADRPs are decoded to check they reach the same targets.
+*/
+#include "host.h"
+#include "process_loader.h"
+
+#define NOP 0xD503201F
+#define B(offset) (0x14000000 | (((offset) >> 2) & 0x3FFFFFF))
+#define BL(offset) (0x94000000 | (((offset) >> 2) & 0x3FFFFFF))
+#define B_EQ(offset) (0x54000000 | ((((offset) >> 2) & 0x7FFFF) << 5))
+
+static uint8_t arena[0x100000] __attribute__((aligned(0x1000)));
+
+#define SRC_CODE (arena + 0x2000)
+#define SRC_DATA (arena + 0x5000)
+#define DST_CODE (arena + 0x40010) // Not page aligned, so ADRP page offsets change
+#define DST_DATA (arena + 0x83000)
+#define FUNCTION (arena + 0xC0000) // Outside the relocated code, e.g. a kernel function
+#define DATA_SIZE 0x2000
+
+static uint32_t adrp(uint64_t pc, uint64_t target) {
+    int64_t pages = (int64_t)((target & ~0xFFFULL) - (pc & ~0xFFFULL)) >> 12;
+    return 0x90000000 | ((pages & 0x3) << 29) | (((pages >> 2) & 0x7FFFF) << 5);
+}
+
+static uint64_t adrp_target(uint64_t pc, uint32_t instr) {
+    uint64_t immlo = (instr >> 29) & 0x3;
+    uint64_t immhi = (instr >> 5) & 0x7FFFF;
+    int64_t pages = ((int64_t)((immhi << 2) | immlo) << 43) >> 43;
+    return (pc & ~0xFFFULL) + pages * 0x1000;
+}
+
+static uint64_t branch_target(uint64_t pc, uint32_t instr) {
+    if ((instr >> 24) == 0x54)
+        return pc + (((int64_t)((instr >> 5) & 0x7FFFF) << 45) >> 43);
+    return pc + (((int64_t)(instr & 0x3FFFFFF) << 38) >> 36);
+}
+
+HOST_TEST(relocate_branches_and_adrp) {
+    uint32_t *src = (uint32_t*)SRC_CODE;
+    uint32_t *dst = (uint32_t*)DST_CODE;
+    uint64_t s = (uint64_t)src, d = (uint64_t)dst;
+    uint64_t function = (uint64_t)FUNCTION;
+    uint64_t data_page = (uint64_t)SRC_DATA + 0x1000;
+
+    src[0] = B(8); // Internal, to src[2]
+    src[1] = BL(function - (s + 4));
+    src[2] = adrp(s + 8, data_page);
+    src[3] = B_EQ(-0x4C); // External and backwards, to s - 0x40
+    src[4] = B_EQ(4); // Internal
+    src[5] = NOP;
+
+    relocate_code(dst, src, 6 * 4, (uint64_t)SRC_DATA, (uint64_t)DST_DATA, DATA_SIZE);
+
+    CHECK_EQ(dst[0], src[0]);
+    CHECK_EQ(dst[1] >> 26, 0x25);
+    CHECK_EQ(branch_target(d + 4, dst[1]), function);
+    CHECK_EQ(adrp_target(d + 8, dst[2]), (uint64_t)DST_DATA + 0x1000);
+    CHECK_EQ(dst[2] & 0x1F, src[2] & 0x1F);
+    CHECK_EQ(branch_target(d + 12, dst[3]), s - 0x40);
+    CHECK_EQ(dst[3] & 0xFF00001F, src[3] & 0xFF00001F);
+    CHECK_EQ(dst[4], src[4]);
+    CHECK_EQ(dst[5], NOP);
+}
+
+HOST_TEST(create_process_relocates_and_maps) {
+    uint32_t *src = (uint32_t*)SRC_CODE;
+    src[0] = NOP;
+    src[1] = BL((uint64_t)FUNCTION - ((uint64_t)src + 4));
+    uint8_t *data = SRC_DATA;
+    data[0] = 0x42;
+    process_t *proc = create_process((void(*)())src, 8, (uint64_t)src, data, DATA_SIZE);
+    CHECK(proc != 0);
+    CHECK_EQ(proc->code_origin, (uint64_t)src);
+    CHECK_EQ(proc->code_size, 8);
+    CHECK_EQ(proc->pc, proc->code_base);
+    uint32_t *code = (uint32_t*)proc->code_base;
+    CHECK_EQ(code[0], NOP);
+    CHECK_EQ(branch_target(proc->code_base + 4, code[1]), (uint64_t)FUNCTION);
+    CHECK_EQ(proc->sp & 0xFFF, 0);
+    CHECK_EQ(proc->state, READY);
+}
+
+static void bench_relocate(void *ctx, uint64_t iterations) {
+    uint32_t *src = (uint32_t*)SRC_CODE;
+    for (int i = 0; i < 1024; i++)
+        src[i] = (i % 4 == 1) ? BL((uint64_t)FUNCTION - ((uint64_t)&src[i])) : NOP;
+    for (uint64_t i = 0; i < iterations; i++)
+        relocate_code(DST_CODE, src, 4096, (uint64_t)SRC_DATA, (uint64_t)DST_DATA, DATA_SIZE);
+}
+HOST_BENCHMARK(relocate_code_4k, 0, bench_relocate, 0);
@@ -0,0 +1,130 @@
+/*
+kernel/bench/bench.c
+This file implements the benchmark runner, built in with `make BENCH=1`. It runs as a kernel process once boot
+is done. For every benchmark in the .benchmarks section it calls setup, finds an iteration count whose run
+takes at least BENCH_TARGET_NS, times BENCH_RUNS runs with cntvct and the PMU cycle counter, and calls teardown.
+Each result is one JSON line on the serial port. When every benchmark has run the machine is powered off
+through PSCI, so the `bench` script can run the suite in QEMU without a display and collect the output.
+*/
+#include "bench.h"
+#include "console/serial/uart.h"
+#include "console/kio.h"
+#include "process/kprocess_loader.h"
+#include "process/scheduler.h"
+#include "hrtimer.h"
+#include "kstring.h"
+#include "gic.h"
+#include "psci.h"
+#include "pmu.h"
+
+extern benchmark benchmarks_start[];
+extern benchmark benchmarks_end[];
+
+static bool pmu_cycles_available;
+
+static inline uint64_t bench_cycles() {
+    if (!pmu_cycles_available)
+        return 0;
+    asm volatile ("isb" ::: "memory");
+    return pmu_cycles();
+}
+
+static void bench_pmu_init() {
+    /*
+    Start the cycle counter if the CPU has an architected PMU.
+    */
+    if (!pmu_available()) return;
+    pmu_start_cycles();
+    pmu_cycles_available = true;
+}
+
+static void bench_print(const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    char line[256];
+    uint32_t len = format_buffer_args(line, sizeof(line), fmt, args, arg_count);
+    uart_raw_write_wait(line, len);
+}
+
+#define bench_printf(fmt, ...) \
+    ({ \
+        uint64_t _args[] = { __VA_ARGS__ }; \
+        bench_print((fmt), _args, sizeof(_args) / sizeof(_args[0])); \
+    })
+
+static void sort_u64(uint64_t *values, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint64_t v = values[i];
+        uint32_t j = i;
+        while (j > 0 && values[j - 1] > v) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = v;
+    }
+}
+
+static uint64_t bench_scale(const benchmark *b, void *ctx) {
+    /*
+    Find the iteration count for a benchmark. Start at one and grow from the time the last run took,
+    by at most 100x per step, until a run reaches BENCH_TARGET_NS.
+    */
+    uint64_t target = ns_to_ticks(BENCH_TARGET_NS);
+    uint64_t iterations = 1;
+    while (1) {
+        uint64_t start = timer_counter();
+        b->run(ctx, iterations);
+        uint64_t elapsed = timer_counter() - start;
+        if (elapsed >= target || iterations >= BENCH_MAX_ITERATIONS)
+            return iterations;
+        uint64_t next = elapsed ? (iterations * target * 12) / (elapsed * 10) : iterations * 100;
+        if (next > iterations * 100) next = iterations * 100;
+        if (next <= iterations) next = iterations + 1;
+        iterations = next;
+    }
+}
+
+static void bench_run_one(const benchmark *b) {
+    void *ctx = b->setup ? b->setup() : 0;
+    uint64_t iterations = bench_scale(b, ctx);
+
+    uint64_t ticks[BENCH_RUNS];
+    uint64_t cycles[BENCH_RUNS];
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        uint64_t start_cycles = bench_cycles();
+        uint64_t start = timer_counter();
+        b->run(ctx, iterations);
+        ticks[i] = timer_counter() - start;
+        cycles[i] = bench_cycles() - start_cycles;
+    }
+    if (b->teardown)
+        b->teardown(ctx);
+
+    sort_u64(ticks, BENCH_RUNS);
+    sort_u64(cycles, BENCH_RUNS);
+    uint64_t median_ps = ticks_to_ns(ticks[BENCH_RUNS / 2]) * 1000 / iterations;
+    uint64_t min_ps = ticks_to_ns(ticks[0]) * 1000 / iterations;
+    bench_printf("{\"bench\":\"%s\",\"iterations\":%u,\"runs\":%u,\"ns_per_iter\":%u.%03u,\"min_ns_per_iter\":%u.%03u",
+        (uint64_t)b->name, iterations, BENCH_RUNS, median_ps / 1000, median_ps % 1000, min_ps / 1000, min_ps % 1000);
+    if (pmu_cycles_available)
+        bench_printf(",\"cycles_per_iter\":%u}\n", cycles[BENCH_RUNS / 2] / iterations);
+    else
+        uart_raw_puts(",\"cycles_per_iter\":null}\n");
+}
+
+void bench_runner() {
+    /*
+    This function is the benchmark process. It runs the whole suite and powers the machine off.
+    */
+    enable_interrupt();
+    bench_pmu_init();
+    uint32_t count = benchmarks_end - benchmarks_start;
+    bench_printf("\n[BENCH] Running %u benchmarks\n", count);
+    for (benchmark *b = benchmarks_start; b < benchmarks_end; b++)
+        bench_run_one(b);
+    bench_printf("[BENCH] Done\n");
+    uart_tx_drain(); // Powering off drops whatever is still queued
+    psci_system_off();
+}
+
+void start_benchmarks() {
+    create_kernel_process(bench_runner, 0);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "types.h"
+
+#define BENCH_TARGET_NS (20 * 1000000ULL) // Iterations are scaled until one run takes at least this long
+#define BENCH_RUNS 5 // Timed runs per benchmark, the median is reported
+#define BENCH_MAX_ITERATIONS (1ULL << 32)
+
+typedef struct {
+    const char *name;
+    void *(*setup)(); // Optional, its result is passed to run and teardown
+    void (*run)(void *ctx, uint64_t iterations);
+    void (*teardown)(void *ctx); // Optional
+} benchmark;
+
+/*
+Registers a benchmark. Definitions are collected in the .benchmarks linker section, so a benchmark
+can live next to the code it measures and needs no central list.
+Example usage: BENCHMARK(talloc_4k, 0, bench_talloc_4k, 0);
+*/
+#define BENCHMARK(id, setup_fn, run_fn, teardown_fn) \
+    static const benchmark bench_##id __attribute__((used, section(".benchmarks"), aligned(8))) = \
+        { #id, (setup_fn), (run_fn), (teardown_fn) }
+
+/*
+Keeps the compiler from optimising a benchmarked computation away.
+*/
+#define bench_keep(value) asm volatile ("" :: "r"(value) : "memory")
+
+void start_benchmarks();
@@ -0,0 +1,127 @@
+/*
+kernel/bench/bench_kernel.c
+This file defines the benchmarks for the kernel primitives: the allocators, formatting and logging,
+the block copy and fill routines, drawing, and a context switch round trip.
+*/
+#include "bench.h"
+#include "ram_e.h"
+#include "kstring.h"
+#include "console/klog.h"
+#include "graph/graphics.h"
+#include "process/kprocess_loader.h"
+#include "process/scheduler.h"
+#include "gic.h"
+
+#define BENCH_BLOCK_SIZE 0x10000
+
+static void bench_talloc_4k(void *ctx, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint64_t p = talloc(0x1000);
+        bench_keep(p);
+        temp_free((void*)p, 0x1000);
+    }
+}
+BENCHMARK(talloc_free_4k, 0, bench_talloc_4k, 0);
+
+static void bench_format(void *ctx, uint64_t iterations) {
+    char buf[128];
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint32_t len = format_buffer(buf, sizeof(buf), "%-12s %i %x %h", (uint64_t)"benchmark", -(int64_t)i, i, i);
+        bench_keep(len);
+    }
+}
+BENCHMARK(format_buffer, 0, bench_format, 0);
+
+static void bench_klog(void *ctx, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint64_t args[] = { i, i };
+        klog_write_args(KLOG_DEBUG, "Benchmark record %i at %h", args, 2);
+    }
+}
+BENCHMARK(klog_write_args, 0, bench_klog, 0);
+
+typedef struct {
+    void *src;
+    void *dest;
+} bench_blocks;
+
+static void* bench_blocks_setup() {
+    static bench_blocks blocks;
+    blocks.src = (void*)talloc(BENCH_BLOCK_SIZE);
+    blocks.dest = (void*)talloc(BENCH_BLOCK_SIZE);
+    memset32_simd(blocks.src, 0x5A5A5A5A, BENCH_BLOCK_SIZE);
+    return &blocks;
+}
+
+static void bench_blocks_teardown(void *ctx) {
+    bench_blocks *blocks = ctx;
+    temp_free(blocks->src, BENCH_BLOCK_SIZE);
+    temp_free(blocks->dest, BENCH_BLOCK_SIZE);
+}
+
+static void bench_memcpy(void *ctx, uint64_t iterations) {
+    bench_blocks *blocks = ctx;
+    for (uint64_t i = 0; i < iterations; i++)
+        memcpy_simd(blocks->dest, blocks->src, BENCH_BLOCK_SIZE);
+}
+BENCHMARK(memcpy_simd_64k, bench_blocks_setup, bench_memcpy, bench_blocks_teardown);
+
+static void bench_memset(void *ctx, uint64_t iterations) {
+    bench_blocks *blocks = ctx;
+    for (uint64_t i = 0; i < iterations; i++)
+        memset32_simd(blocks->dest, (uint32_t)i, BENCH_BLOCK_SIZE);
+}
+BENCHMARK(memset32_simd_64k, bench_blocks_setup, bench_memset, bench_blocks_teardown);
+
+static void bench_fill_rect(void *ctx, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++)
+        gpu_fill_rect((rect){{16, 16}, {64, 64}}, 0xFF000000 | (uint32_t)i);
+}
+BENCHMARK(gpu_fill_rect_64x64, 0, bench_fill_rect, 0);
+
+static void bench_draw_string(void *ctx, uint64_t iterations) {
+    kstring s = string_l("The quick brown fox jumps over the lazy dog");
+    for (uint64_t i = 0; i < iterations; i++)
+        gpu_draw_string(s, (point){16, 96}, 1, 0xFFFFFFFF);
+}
+BENCHMARK(gpu_draw_string_43, 0, bench_draw_string, 0);
+
+static volatile bool pingpong;
+static int partner_pid = -1;
+
+static void bench_partner() {
+    /*
+    The other side of the context switch benchmark. It yields straight back while the benchmark runs
+    and sleeps otherwise, so it does not take time from the other benchmarks.
+    */
+    enable_interrupt();
+    while (1) {
+        if (pingpong)
+            yield_proc();
+        else
+            sleep_current_proc();
+    }
+}
+
+static void* bench_switch_setup() {
+    pingpong = true;
+    if (partner_pid < 0) {
+        uint64_t flags = irq_save();
+        process_t *partner = create_kernel_process(bench_partner, 0);
+        partner_pid = partner ? (int)partner->id : -1;
+        irq_restore(flags);
+    } else {
+        wake_proc(partner_pid);
+    }
+    return 0;
+}
+
+static void bench_switch_teardown(void *ctx) {
+    pingpong = false;
+}
+
+static void bench_switch(void *ctx, uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++)
+        yield_proc(); // Switches to the partner, which switches back
+}
+BENCHMARK(context_switch_roundtrip, bench_switch_setup, bench_switch, bench_switch_teardown);
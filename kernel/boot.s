@@ -2,6 +2,9 @@
 _start:
     ldr x1, =stack_top
     mov sp, x1
+    mov x0, #(1 << 20)
+    msr cpacr_el1, x0 // Trap FP/SIMD instructions at EL0 only, user code is built without them
+    isb
     mov x29, xzr
     mov x30, xzr
     bl kernel_main
@@ -0,0 +1,79 @@
+/*
+kernel/boot_timeline.c
+This file implements the boot timeline. Init code brackets each stage with boot_stage_begin and boot_stage_end,
+which record cntvct, and stages opened inside another one become its sub-stages.
+boot_timeline_report prints a table of every stage with its start, duration and share of the whole boot,
+followed by one JSON line per stage for scripts. Time before kernel_main shows up as the firmware stage.
+*/
+#include "boot_timeline.h"
+#include "console/kio.h"
+#include "hrtimer.h"
+#include "kstring.h"
+
+static boot_stage stages[BOOT_STAGES_MAX];
+static uint32_t stage_count;
+static uint32_t open_stages[BOOT_STAGE_DEPTH];
+static uint32_t depth;
+static uint64_t first_start;
+
+static inline uint64_t boot_counter() {
+    uint64_t v;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+
+void boot_stage_begin(const char *name) {
+    /*
+    This function starts timing a boot stage. It may be called before anything else is initialized.
+    Example usage: boot_stage_begin("gpu_init"); gpu_init(size); boot_stage_end();
+    */
+    uint64_t now = boot_counter();
+    if (stage_count == 0)
+        first_start = now;
+    if (stage_count >= BOOT_STAGES_MAX || depth >= BOOT_STAGE_DEPTH)
+        return;
+    stages[stage_count] = (boot_stage){ .name = name, .start = now, .end = 0, .depth = depth };
+    open_stages[depth++] = stage_count++;
+}
+
+void boot_stage_end() {
+    /*
+    This function ends the innermost open stage.
+    */
+    if (depth == 0) return;
+    stages[open_stages[--depth]].end = boot_counter();
+}
+
+void boot_timeline_report() {
+    /*
+    This function prints the timeline. Stages still open are measured up to now.
+    Percentages are of the time from reset to this call, with one decimal.
+    */
+    uint64_t now = boot_counter();
+    uint64_t total = now ? now : 1;
+
+    kprintf("[BOOT] %-28s %12s %12s %7s", (uint64_t)"stage", (uint64_t)"start us", (uint64_t)"duration us", (uint64_t)"boot");
+    kprintf("[BOOT] %-28s %12u %12u %5u.%u%%", (uint64_t)"firmware", 0, ticks_to_ns(first_start) / NSEC_PER_USEC,
+        (first_start * 1000 / total) / 10, (first_start * 1000 / total) % 10);
+    for (uint32_t i = 0; i < stage_count; i++) {
+        boot_stage *s = &stages[i];
+        uint64_t end = s->end ? s->end : now;
+        uint64_t per_mille = (end - s->start) * 1000 / total;
+        char name[32];
+        uint32_t indent = s->depth * 2;
+        for (uint32_t j = 0; j < indent; j++)
+            name[j] = ' ';
+        format_buffer(name + indent, sizeof(name) - indent, "%s", (uint64_t)s->name);
+        kprintf("[BOOT] %-28s %12u %12u %5u.%u%%", (uint64_t)name, ticks_to_ns(s->start) / NSEC_PER_USEC,
+            ticks_to_ns(end - s->start) / NSEC_PER_USEC, per_mille / 10, per_mille % 10);
+    }
+    kprintf("[BOOT] %-28s %12u %12u %5u.%u%%", (uint64_t)"total", 0, ticks_to_ns(now) / NSEC_PER_USEC, 100, 0);
+
+    for (uint32_t i = 0; i < stage_count; i++) {
+        boot_stage *s = &stages[i];
+        uint64_t end = s->end ? s->end : now;
+        kprintf("[BOOTJSON] {\"stage\":\"%s\",\"depth\":%u,\"start_ns\":%u,\"duration_ns\":%u}",
+            (uint64_t)s->name, s->depth, ticks_to_ns(s->start), ticks_to_ns(end - s->start));
+    }
+    kprintf("[BOOTJSON] {\"stage\":\"total\",\"depth\":0,\"start_ns\":0,\"duration_ns\":%u}", ticks_to_ns(now));
+}
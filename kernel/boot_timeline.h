@@ -0,0 +1,17 @@
+#pragma once
+
+#include "types.h"
+
+#define BOOT_STAGES_MAX 48
+#define BOOT_STAGE_DEPTH 4 // Nesting of stages and sub-stages
+
+typedef struct {
+    const char *name;
+    uint64_t start; // cntvct, which counts from reset
+    uint64_t end;
+    uint8_t depth;
+} boot_stage;
+
+void boot_stage_begin(const char *name);
+void boot_stage_end();
+void boot_timeline_report();
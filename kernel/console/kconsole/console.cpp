@@ -11,6 +11,10 @@ extern "C" void kconsole_puts(const char *s) {
     kconsole.put_string(s);
 }
 
+extern "C" void kconsole_render() {
+    kconsole.render();
+}
+
 extern "C" void kconsole_clear() {
     kconsole.clear();
 }
\ No newline at end of file
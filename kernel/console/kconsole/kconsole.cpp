@@ -2,12 +2,16 @@
 kernel/console/kconsole/kconsole.cpp
 This file implements a basic kernel console that outputs characters and strings
 to the screen using a GPU. It manages cursor position, scrolling, and screen clearing.
+Writes only update the character grid and the dirty span of each row, so they cost the same whatever the GPU.
+render(), called at a fixed refresh rate, applies the scrolls since the last frame with one framebuffer block move,
+draws only the dirty cells and flushes the damaged area once.
 It is implemented in C++ to utilize classes for better organization.
 */
 #include "kconsole.hpp"
 #include "ram_e.h"
 #include "graph/graphics.h"
 #include "console/serial/uart.h"
+#include "gic.h"
 
 KernelConsole::KernelConsole()
     : cursor_x(0), cursor_y(0), scroll_row_offset(0)
@@ -21,6 +25,7 @@ bool KernelConsole::check_ready(){
     if (!is_initialized){
         is_initialized = true;
         resize();
+        screen_clear();
         clear();
     }
     return true;
@@ -35,6 +40,13 @@ void KernelConsole::resize() {
         temp_free(buffer, buffer_header_size);
     if (buffer_data_size > 0)
         temp_free(row_data, buffer_data_size);
+    if (dirty_size > 0) {
+        temp_free(dirty_from, dirty_size);
+        temp_free(dirty_to, dirty_size);
+        temp_free(render_from, dirty_size);
+        temp_free(render_to, dirty_size);
+        temp_free(render_data, buffer_data_size);
+    }
 
     buffer_header_size = rows * sizeof(char*);
     buffer = (char**)talloc(rows * sizeof(char*));
@@ -44,12 +56,27 @@ void KernelConsole::resize() {
     for (unsigned int i = 0; i < rows; i++) {
         buffer[i] = row_data + (i * columns);
     }
+
+    render_data = (char*)talloc(buffer_data_size);
+
+    dirty_size = rows * sizeof(uint16_t);
+    dirty_from = (uint16_t*)talloc(dirty_size);
+    dirty_to = (uint16_t*)talloc(dirty_size);
+    render_from = (uint16_t*)talloc(dirty_size);
+    render_to = (uint16_t*)talloc(dirty_size);
+    for (unsigned int i = 0; i < rows; i++) {
+        dirty_from[i] = columns;
+        dirty_to[i] = 0;
+    }
+    pending_scroll = 0;
 }
 
-void KernelConsole::put_char(char c) {
-    if (!check_ready())
-        return;
+void KernelConsole::mark_dirty(unsigned int row, unsigned int from, unsigned int to) {
+    if (from < dirty_from[row]) dirty_from[row] = from;
+    if (to > dirty_to[row]) dirty_to[row] = to;
+}
 
+void KernelConsole::write_char(char c) {
     if (c == '\n') {
         newline();
         return;
@@ -59,23 +86,93 @@ void KernelConsole::put_char(char c) {
         newline();
 
     buffer[(scroll_row_offset + cursor_y) % rows][cursor_x] = c;
-    gpu_draw_char({cursor_x * char_width, cursor_y * char_height}, c, 1, 0xFFFFFFFF);
+    mark_dirty(cursor_y, cursor_x, cursor_x + 1);
     cursor_x++;
 }
 
+void KernelConsole::put_char(char c) {
+    if (!check_ready())
+        return;
+    uint64_t flags = irq_save();
+    write_char(c);
+    irq_restore(flags);
+}
+
 void KernelConsole::put_string(const char *str) {
     if (!check_ready())
         return;
+    uint64_t flags = irq_save();
     for (uint32_t i = 0; str[i] != 0; i++) {
-        put_char(str[i]);
+        write_char(str[i]);
+    }
+    irq_restore(flags);
+}
+
+void KernelConsole::render() {
+    /*
+    Bring the screen up to date with the grid.
+    The dirty state is copied out with interrupts disabled, so writers can keep going while the frame is drawn;
+    anything they change in the meantime is drawn in the next frame.
+    1. Move the framebuffer up by the lines scrolled since the last frame.
+    2. Clear and redraw the dirty cells of each row.
+    3. Flush the bounding box of everything that changed, once.
+    */
+    if (!check_ready())
+        return;
+
+    uint64_t flags = irq_save();
+    unsigned int lines = pending_scroll;
+    pending_scroll = 0;
+    for (unsigned int y = 0; y < rows; y++) {
+        render_from[y] = dirty_from[y];
+        render_to[y] = dirty_to[y];
+        char *row = buffer[(scroll_row_offset + y) % rows];
+        for (unsigned int x = dirty_from[y]; x < dirty_to[y]; x++)
+            render_data[y * columns + x] = row[x];
+        dirty_from[y] = columns;
+        dirty_to[y] = 0;
+    }
+    irq_restore(flags);
+
+    unsigned int damage_x0 = columns, damage_x1 = 0, damage_y0 = rows, damage_y1 = 0;
+
+    if (lines) {
+        if (lines > rows) lines = rows;
+        gpu_scroll({{0, 0}, {columns * char_width, rows * char_height}}, lines * char_height, 0x0);
+        damage_x0 = 0;
+        damage_x1 = columns;
+        damage_y0 = 0;
+        damage_y1 = rows;
+    }
+
+    for (unsigned int y = 0; y < rows; y++) {
+        unsigned int from = render_from[y], to = render_to[y];
+        if (from >= to) continue;
+        gpu_fill_rect({{from * char_width, y * char_height}, {(to - from) * char_width, char_height}}, 0x0);
+        for (unsigned int x = from; x < to; x++) {
+            char c = render_data[y * columns + x];
+            if (c)
+                gpu_draw_char({x * char_width, y * char_height}, c, 1, 0xFFFFFFFF);
+        }
+        if (from < damage_x0) damage_x0 = from;
+        if (to > damage_x1) damage_x1 = to;
+        if (y < damage_y0) damage_y0 = y;
+        if (y + 1 > damage_y1) damage_y1 = y + 1;
     }
+
+    if (damage_x0 < damage_x1)
+        gpu_flush_rect({{damage_x0 * char_width, damage_y0 * char_height}, {(damage_x1 - damage_x0) * char_width, (damage_y1 - damage_y0) * char_height}});
 }
 
 void KernelConsole::newline() {
     if (!check_ready())
         return;
+    char *row = buffer[(scroll_row_offset + cursor_y) % rows];
     for (unsigned x = cursor_x; x < columns; x++) {
-        buffer[(scroll_row_offset + cursor_y) % rows][x] = 0;
+        if (row[x]) {
+            row[x] = 0;
+            mark_dirty(cursor_y, x, x + 1);
+        }
     }
     cursor_x = 0;
     cursor_y++;
@@ -95,17 +192,14 @@ void KernelConsole::scroll() {
         buffer[(scroll_row_offset + rows - 1) % rows][x] = 0;
     }
 
-    redraw();
-}
-
-void KernelConsole::redraw() {
-    screen_clear();
-    for (unsigned int y = 0; y < rows; y++) {
-        for (unsigned int x = 0; x < columns; x++) {
-            char c = buffer[(scroll_row_offset + y) % rows][x];
-            gpu_draw_char({x * char_width, y * char_height}, c, 1, 0xFFFFFFFF);
-        }
+    // Cells waiting to be drawn move up with the text. The new bottom row is blank, as is the framebuffer once moved
+    for (unsigned int y = 0; y + 1 < rows; y++) {
+        dirty_from[y] = dirty_from[y + 1];
+        dirty_to[y] = dirty_to[y + 1];
     }
+    dirty_from[rows - 1] = columns;
+    dirty_to[rows - 1] = 0;
+    pending_scroll++;
 }
 
 void KernelConsole::screen_clear() {
@@ -113,13 +207,16 @@ void KernelConsole::screen_clear() {
 }
 
 void KernelConsole::clear() {
-    screen_clear();
+    uint64_t flags = irq_save();
     for (unsigned int y = 0; y < rows; y++) {
         for (unsigned int x = 0; x < columns; x++) {
             buffer[y][x] = 0;
         }
+        mark_dirty(y, 0, columns);
     }
     cursor_x = 0;
     cursor_y = 0;
     scroll_row_offset = 0;
-}
\ No newline at end of file
+    pending_scroll = 0;
+    irq_restore(flags);
+}
@@ -7,6 +7,7 @@ extern "C" {
 void kconsole_putc(char c);
 void kconsole_puts(const char *s);
 void kconsole_clear();
+void kconsole_render();
 
 #ifdef __cplusplus
 }
@@ -12,11 +12,13 @@ public:
     void scroll();
     void clear();
     void resize();
+    void render();
 
 private:
     bool check_ready();
     void screen_clear();
-    void redraw();
+    void write_char(char c);
+    void mark_dirty(unsigned int row, unsigned int from, unsigned int to);
 
     unsigned int cursor_x;
     unsigned int cursor_y;
@@ -24,12 +26,20 @@ private:
     unsigned int rows;
     bool is_initialized = false;
     int scroll_row_offset = 0;
+    unsigned int pending_scroll = 0; // Lines scrolled since the last render
     static constexpr int char_width = 8;
     static constexpr int char_height = 16;
     char** buffer;
     char* row_data;
+    uint16_t* dirty_from; // Per screen row, the columns [from, to) changed since the last render
+    uint16_t* dirty_to;
+
+    char* render_data; // Copy of the dirty rows taken by render()
+    uint16_t* render_from;
+    uint16_t* render_to;
 
     uint64_t buffer_header_size;
     uint64_t buffer_data_size;
+    uint64_t dirty_size;
 };
-extern KernelConsole kconsole;
\ No newline at end of file
+extern KernelConsole kconsole;
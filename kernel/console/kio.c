@@ -3,15 +3,30 @@ kernel/console/kio.c
 This file provides kernel I/O functions that utilize UART for serial communication.
 It includes functions to output characters, strings, hexadecimal values,
 and formatted strings to the console via UART.
+Formatted output goes to the kernel log ring (klog.c) and is drained from there by two consumers:
+the UART, which takes as much as its TX ring has room for and is refilled from the TX interrupt,
+and the screen console. Once the scheduler runs, the klogd process moves records into the console grid
+and renders the console at KIO_REFRESH_HZ, so the cost of drawing does not depend on how much is logged.
 */
 #include "kio.h"
 #include "serial/uart.h"
-#include "kstring.h"
 #include "gic.h"
 #include "ram_e.h"
 #include "kconsole/kconsole.h"
+#include "klog.h"
+#include "process/kprocess_loader.h"
+#include "process/scheduler.h"
+#include "hrtimer.h"
+
+#define KIO_REFRESH_HZ 60
 
 static bool use_visual = true;
+static bool console_async = false; // Set once klogd draws the console, before that kprintf draws it inline
+static int klogd_pid;
+static hrtimer refresh_timer;
+
+static klog_reader uart_reader;
+static klog_reader console_reader;
 
 void puts(const char *s){
     uart_raw_puts(s);
@@ -41,10 +56,127 @@ void kprintf_args(const char *fmt, const uint64_t *args, uint32_t arg_count){
 }
 
 void kprintf_args_raw(const char *fmt, const uint64_t *args, uint32_t arg_count) {
-    kstring s = string_format_args(fmt, args, arg_count);
-    puts(s.data);
-    putc('\n');
-    temp_free(s.data, 256);
+    klog_args(KLOG_INFO, fmt, args, arg_count);
+}
+
+void klog_args(uint8_t level, const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    /*
+    This function formats a message into the kernel log and kicks the consumers. It does not wait for output.
+    Example usage: klog(KLOG_WARN, "Queue %i full", queue); would log a warning.
+    */
+    klog_write_args(level, fmt, args, arg_count);
+
+    kio_drain_uart();
+    if (!console_async) {
+        kio_drain_console();
+        kconsole_render();
+    }
+}
+
+void kio_drain_uart() {
+    /*
+    This function moves log records into the UART TX ring for as long as whole lines fit.
+    Whatever is left is sent when the TX interrupt finds the ring empty and calls this function again.
+    */
+    if (!klog_reader_acquire(&uart_reader)) return;
+    klog_record record;
+    char line[KLOG_TEXT_MAX + 32];
+    do {
+        while (klog_read(&uart_reader, &record)) {
+            uint32_t len = klog_format(&record, line, sizeof(line));
+            if (uart_tx_space() < len) break;
+            uart_raw_puts(line);
+            klog_consume(&uart_reader);
+        }
+        klog_reader_release(&uart_reader);
+        // Records committed after the last read but before the release would otherwise wait for the next kick
+    } while (klog_pending(&uart_reader) && uart_tx_space() > KLOG_TEXT_MAX + 32 && klog_reader_acquire(&uart_reader));
+}
+
+void kio_drain_console() {
+    /*
+    This function writes every pending log record into the console grid. It is drawn by the next kconsole_render.
+    While the console is hidden the records are consumed without writing them.
+    */
+    if (!klog_reader_acquire(&console_reader)) return;
+    klog_record record;
+    char line[KLOG_TEXT_MAX + 32];
+    do {
+        while (klog_read(&console_reader, &record)) {
+            klog_consume(&console_reader);
+            if (!use_visual) continue;
+            klog_format(&record, line, sizeof(line));
+            kconsole_puts(line);
+        }
+        klog_reader_release(&console_reader);
+    } while (klog_pending(&console_reader) && klog_reader_acquire(&console_reader));
+}
+
+static irq_result refresh_tick(hrtimer *timer, void *ctx) {
+    wake_proc(klogd_pid);
+    return IRQ_HANDLED;
+}
+
+void klogd() {
+    /*
+    This function is the klogd kernel process, the screen consumer of the log and the console refresh.
+    Every frame it moves what was logged into the console grid, renders the dirty cells and sleeps until the next frame.
+    */
+    enable_interrupt();
+    hrtimer_start(&refresh_timer, NSEC_PER_SEC / KIO_REFRESH_HZ, NSEC_PER_SEC / KIO_REFRESH_HZ, 2 * NSEC_PER_MSEC);
+    while (1) {
+        kio_drain_console();
+        if (use_visual)
+            kconsole_render();
+        sleep_current_proc();
+    }
+}
+
+void kio_init() {
+    /*
+    This function lets the UART interrupt pull log records once its ring has room again.
+    Must be called after uart_enable_irq.
+    */
+    uart_set_tx_refill(kio_drain_uart);
+    kio_drain_uart();
+}
+
+void kio_start_klogd() {
+    /*
+    This function hands console drawing over to the klogd process. Call it before start_scheduler.
+    */
+    process_t *proc = create_kernel_process(klogd, 0);
+    if (!proc) return;
+    klogd_pid = proc->id;
+    hrtimer_setup(&refresh_timer, refresh_tick, 0, HRTIMER_VIRTUAL);
+    console_async = true;
+}
+
+void kio_panic_flush() {
+    /*
+    This function writes every log record the UART has not sent yet, synchronously.
+    It is meant for panic(), after uart_panic_flush, and takes the UART reader even if the panic interrupted its holder.
+    */
+    klog_reader_release(&uart_reader);
+    kio_drain_uart();
+}
+
+void kio_dump_log() {
+    /*
+    This function writes the whole retained log, not only what is new, to the UART.
+    It waits for the TX interrupt to make room, so it must be called with interrupts enabled.
+    Example usage: kio_dump_log(); would print the equivalent of dmesg.
+    */
+    klog_reader reader = { .seq = klog_oldest() };
+    klog_record record;
+    char line[KLOG_TEXT_MAX + 32];
+    while (klog_read(&reader, &record)) {
+        uint32_t len = klog_format(&record, line, sizeof(line));
+        while (uart_tx_space() < len)
+            asm volatile ("wfi" ::: "memory");
+        uart_raw_puts(line);
+        klog_consume(&reader);
+    }
 }
 
 void disable_visual() {
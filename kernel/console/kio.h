@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include "klog.h"
 
 #define kprintf(fmt, ...) \
     ({ \
@@ -14,8 +15,59 @@
         kprintf_args_raw((fmt), _args, sizeof(_args) / sizeof(_args[0])); \
     })
 
+#define klog(level, fmt, ...) \
+    ({ \
+        uint64_t _args[] = { __VA_ARGS__ }; \
+        klog_args((level), (fmt), _args, sizeof(_args) / sizeof(_args[0])); \
+    })
+
+/*
+Levelled, per-subsystem logging. A message is compiled in only if its level is at or below KLOG_COMPILE_LEVEL,
+and logged only if it is also at or below its subsystem's runtime level.
+Disabled levels expand to nothing, so their arguments are never evaluated.
+Example usage: klog_debug(KLOG_SYS_GPU, "Flushed %ix%i", w, h);
+*/
+#define klog_sys(sys, level, fmt, ...) \
+    ({ \
+        if (klog_enabled((sys), (level))) { \
+            uint64_t _args[] = { __VA_ARGS__ }; \
+            klog_args((level), (fmt), _args, sizeof(_args) / sizeof(_args[0])); \
+        } \
+    })
+
+#if KLOG_COMPILE_LEVEL >= KLOG_ERROR
+#define klog_error(sys, fmt, ...) klog_sys(sys, KLOG_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define klog_error(sys, fmt, ...) ((void)0)
+#endif
+
+#if KLOG_COMPILE_LEVEL >= KLOG_WARN
+#define klog_warn(sys, fmt, ...) klog_sys(sys, KLOG_WARN, fmt, ##__VA_ARGS__)
+#else
+#define klog_warn(sys, fmt, ...) ((void)0)
+#endif
+
+#if KLOG_COMPILE_LEVEL >= KLOG_INFO
+#define klog_info(sys, fmt, ...) klog_sys(sys, KLOG_INFO, fmt, ##__VA_ARGS__)
+#else
+#define klog_info(sys, fmt, ...) ((void)0)
+#endif
+
+#if KLOG_COMPILE_LEVEL >= KLOG_DEBUG
+#define klog_debug(sys, fmt, ...) klog_sys(sys, KLOG_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define klog_debug(sys, fmt, ...) ((void)0)
+#endif
+
 void kprintf_args(const char *fmt, const uint64_t *args, uint32_t arg_count);
 void kprintf_args_raw(const char *fmt, const uint64_t *args, uint32_t arg_count);
+void klog_args(uint8_t level, const char *fmt, const uint64_t *args, uint32_t arg_count);
+void kio_init();
+void kio_start_klogd();
+void kio_drain_uart();
+void kio_drain_console();
+void kio_panic_flush();
+void kio_dump_log();
 void puts(const char *s);
 void putc(const char c);
 void puthex(uint64_t value);
@@ -0,0 +1,202 @@
+/*
+kernel/console/klog.c
+This file implements the kernel log ring, the store behind kprintf.
+It is a fixed array of timestamped, levelled records indexed by a sequence number.
+Producers reserve a sequence number with a single atomic increment, write their record, and commit it
+by publishing the sequence number in the record. They never wait for each other or for a consumer.
+Consumers (the UART, the screen, dmesg) each keep a klog_reader and copy committed records out,
+checking the sequence number again afterwards in case the record was overwritten while being copied.
+*/
+#include "klog.h"
+#include "kstring.h"
+
+#define KLOG_MASK (KLOG_RECORDS - 1)
+
+static klog_record ring[KLOG_RECORDS];
+static volatile uint64_t head; // Next sequence number to reserve
+
+uint8_t klog_levels[KLOG_SYS_COUNT] = { [0 ... KLOG_SYS_COUNT - 1] = KLOG_INFO };
+
+static const char *subsystem_names[KLOG_SYS_COUNT] = { "core", "mem", "mmu", "irq", "pci", "gpu", "proc" };
+
+void klog_set_level(klog_subsystem sys, uint8_t level) {
+    /*
+    This function changes how verbose a subsystem is at runtime. Levels above KLOG_COMPILE_LEVEL stay silent,
+    as their messages are not in the image.
+    Example usage: klog_set_level(KLOG_SYS_MMU, KLOG_DEBUG); would log every page mapping.
+    */
+    if (sys < KLOG_SYS_COUNT)
+        klog_levels[sys] = level;
+}
+
+const char* klog_subsystem_name(klog_subsystem sys) {
+    return sys < KLOG_SYS_COUNT ? subsystem_names[sys] : "?";
+}
+
+static inline uint64_t klog_counter() {
+    uint64_t v;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+
+static klog_record* klog_reserve(uint8_t level, uint64_t *seq) {
+    /*
+    Claim the next record and mark it as in progress. Readers must see that before its contents change.
+    */
+    *seq = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    klog_record *record = &ring[*seq & KLOG_MASK];
+
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->timestamp = klog_counter();
+    record->level = level;
+    return record;
+}
+
+static void klog_commit(klog_record *record, uint64_t seq) {
+    __atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+void klog_write(uint8_t level, const char *text, uint32_t length) {
+    /*
+    This function appends a record to the log. It is safe to call from any context, including interrupt handlers.
+    Text longer than KLOG_TEXT_MAX is truncated.
+    Example usage: klog_write(KLOG_INFO, "Disk ready", 10);
+    */
+    uint64_t seq;
+    klog_record *record = klog_reserve(level, &seq);
+    if (length > KLOG_TEXT_MAX)
+        length = KLOG_TEXT_MAX;
+    record->length = length;
+    for (uint32_t i = 0; i < length; i++)
+        record->text[i] = text[i];
+    klog_commit(record, seq);
+}
+
+void klog_write_args(uint8_t level, const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    /*
+    This function formats a message straight into its log record, with no intermediate buffer.
+    Example usage: klog_write_args(KLOG_INFO, "Disk size %h", &size, 1);
+    */
+    uint64_t seq;
+    klog_record *record = klog_reserve(level, &seq);
+    record->length = format_buffer_args(record->text, KLOG_TEXT_MAX, fmt, args, arg_count);
+    klog_commit(record, seq);
+}
+
+uint64_t klog_oldest() {
+    /*
+    This function returns the sequence number of the oldest record still held in the ring.
+    A reader starting there sees the whole retained log.
+    */
+    uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    return h > KLOG_RECORDS ? h - KLOG_RECORDS : 0;
+}
+
+bool klog_read(klog_reader *reader, klog_record *out) {
+    /*
+    This function copies the next record for a reader without consuming it, so a consumer that cannot
+    take the record yet can retry later. Call klog_consume once the record has been handled.
+    Returns false if the next record has not been committed yet.
+    */
+    while (1) {
+        uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        if (reader->seq >= h) return false;
+
+        if (h - reader->seq > KLOG_RECORDS) {
+            reader->lost += h - KLOG_RECORDS - reader->seq;
+            reader->seq = h - KLOG_RECORDS;
+        }
+
+        klog_record *record = &ring[reader->seq & KLOG_MASK];
+        uint64_t seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        if (seq == reader->seq + 1) {
+            out->timestamp = record->timestamp;
+            out->level = record->level;
+            out->length = record->length;
+            for (uint32_t i = 0; i < out->length; i++)
+                out->text[i] = record->text[i];
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&record->seq, __ATOMIC_RELAXED) == seq) {
+                out->seq = seq;
+                return true;
+            }
+        } else if (seq < reader->seq + 1) {
+            return false; // Still being written
+        }
+
+        // Overwritten by a newer record, skip past it
+        reader->lost++;
+        reader->seq++;
+    }
+}
+
+void klog_consume(klog_reader *reader) {
+    reader->seq++;
+}
+
+bool klog_pending(klog_reader *reader) {
+    /*
+    This function tells whether klog_read would return a record right now.
+    A record that is still being written does not count, so a consumer can stop until its producer commits it.
+    */
+    uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    if (reader->seq >= h) return false;
+    if (h - reader->seq > KLOG_RECORDS) return true;
+    uint64_t seq = __atomic_load_n(&ring[reader->seq & KLOG_MASK].seq, __ATOMIC_ACQUIRE);
+    return seq >= reader->seq + 1;
+}
+
+bool klog_reader_acquire(klog_reader *reader) {
+    /*
+    This function claims a reader for the calling context. Every reader has a single consumer at a time;
+    a context that finds it taken can return, as the holder drains whatever was written in the meantime.
+    */
+    return !__atomic_exchange_n(&reader->busy, 1, __ATOMIC_ACQUIRE);
+}
+
+void klog_reader_release(klog_reader *reader) {
+    __atomic_store_n(&reader->busy, 0, __ATOMIC_RELEASE);
+}
+
+static uint32_t format_decimal(char *buf, uint64_t value, uint32_t width, char pad) {
+    char temp[20];
+    uint32_t len = 0;
+    do {
+        temp[len++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    uint32_t written = 0;
+    for (; len + written < width; written++)
+        buf[written] = pad;
+    while (len)
+        buf[written++] = temp[--len];
+    return written;
+}
+
+uint32_t klog_format(const klog_record *record, char *buf, uint32_t size) {
+    /*
+    This function renders a record as a line of text, "[seconds.microseconds] text\n".
+    The buffer must hold at least KLOG_TEXT_MAX + 32 bytes. Returns the length of the line, without a terminator.
+    */
+    if (size < KLOG_TEXT_MAX + 32) return 0;
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+
+    uint64_t seconds = record->timestamp / freq;
+    uint64_t micros = ((record->timestamp % freq) * 1000000) / freq;
+
+    uint32_t len = 0;
+    buf[len++] = '[';
+    len += format_decimal(buf + len, seconds, 5, ' ');
+    buf[len++] = '.';
+    len += format_decimal(buf + len, micros, 6, '0');
+    buf[len++] = ']';
+    buf[len++] = ' ';
+    for (uint32_t i = 0; i < record->length; i++)
+        buf[len++] = record->text[i];
+    buf[len++] = '\n';
+    buf[len] = 0;
+    return len;
+}
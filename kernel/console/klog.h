@@ -0,0 +1,63 @@
+#pragma once
+
+#include "types.h"
+
+#define KLOG_ERROR 0
+#define KLOG_WARN 1
+#define KLOG_INFO 2
+#define KLOG_DEBUG 3
+
+#ifndef KLOG_COMPILE_LEVEL
+#define KLOG_COMPILE_LEVEL KLOG_DEBUG // Messages above this level are compiled out, set with `make KLOG_LEVEL=n`
+#endif
+
+typedef enum {
+    KLOG_SYS_CORE,
+    KLOG_SYS_MEM,
+    KLOG_SYS_MMU,
+    KLOG_SYS_IRQ,
+    KLOG_SYS_PCI,
+    KLOG_SYS_GPU,
+    KLOG_SYS_PROC,
+    KLOG_SYS_COUNT,
+} klog_subsystem;
+
+#define KLOG_RECORDS 256 // Power of two
+#define KLOG_TEXT_MAX 232 // Keeps a record at 256 bytes
+
+typedef struct {
+    volatile uint64_t seq; // Sequence number + 1 once committed, 0 while being written
+    uint64_t timestamp; // cntvct when the record was reserved
+    uint16_t length;
+    uint8_t level;
+    uint8_t padding[5];
+    char text[KLOG_TEXT_MAX];
+} klog_record;
+
+typedef struct {
+    /*
+    A consumer of the log. Every reader keeps its own position, so they drain at their own pace.
+    A reader that falls more than KLOG_RECORDS behind skips the overwritten records and counts them as lost.
+    */
+    uint64_t seq;
+    uint64_t lost;
+    volatile uint32_t busy;
+} klog_reader;
+
+extern uint8_t klog_levels[KLOG_SYS_COUNT];
+
+static inline bool klog_enabled(klog_subsystem sys, uint8_t level) {
+    return level <= klog_levels[sys];
+}
+
+void klog_set_level(klog_subsystem sys, uint8_t level);
+const char* klog_subsystem_name(klog_subsystem sys);
+void klog_write(uint8_t level, const char *text, uint32_t length);
+void klog_write_args(uint8_t level, const char *fmt, const uint64_t *args, uint32_t arg_count);
+bool klog_read(klog_reader *reader, klog_record *out);
+void klog_consume(klog_reader *reader);
+bool klog_reader_acquire(klog_reader *reader);
+void klog_reader_release(klog_reader *reader);
+bool klog_pending(klog_reader *reader);
+uint64_t klog_oldest();
+uint32_t klog_format(const klog_record *record, char *buf, uint32_t size);
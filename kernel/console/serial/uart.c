@@ -4,6 +4,9 @@ UART stands for Universal Asynchronous Receiver/Transmitter.
 This file contains functions to initialize and use the UART for serial communication.
 By writing to and reading from specific memory-mapped registers,
 we can send and receive data over a serial interface.
+Output is queued in a ring buffer and moved into the 32 byte TX FIFO by the TX interrupt,
+so writers never wait for the line. Only panic() writes synchronously.
+Input is delivered by the RX and RX timeout interrupts to a registered receive handler.
 */
 #include "console/serial/uart.h"
 #include "ram_e.h"
@@ -15,6 +18,38 @@ we can send and receive data over a serial interface.
 #define UART0_FBRD (UART0_BASE + 0x28)
 #define UART0_LCRH (UART0_BASE + 0x2C)
 #define UART0_CR   (UART0_BASE + 0x30)
+#define UART0_IFLS (UART0_BASE + 0x34)
+#define UART0_IMSC (UART0_BASE + 0x38)
+#define UART0_MIS  (UART0_BASE + 0x40)
+#define UART0_ICR  (UART0_BASE + 0x44)
+
+#define UART_FR_BUSY (1 << 3)
+#define UART_FR_RXFE (1 << 4)
+#define UART_FR_TXFF (1 << 5)
+#define UART_INT_RX (1 << 4)
+#define UART_INT_TX (1 << 5)
+#define UART_INT_RT (1 << 6) // RX timeout, fires when fewer bytes than the RX trigger level sit in the FIFO
+
+#define UART_TX_RING_SIZE 0x4000 // Power of two, indices wrap with a mask
+#define UART_TX_RING_MASK (UART_TX_RING_SIZE - 1)
+
+/*
+The ring has any number of producers and a single consumer.
+Producers reserve space by advancing tx_reserve, copy their bytes, and then publish them
+in reservation order by advancing tx_commit. The consumer only ever reads up to tx_commit.
+*/
+static char tx_ring[UART_TX_RING_SIZE];
+static volatile uint32_t tx_reserve;
+static volatile uint32_t tx_commit;
+static volatile uint32_t tx_tail;
+
+static uint64_t tx_dropped;
+static uint32_t tx_high_watermark;
+static bool tx_sync;
+static bool tx_irq_ready;
+
+static void (*rx_handler)(char c);
+static void (*tx_refill)();
 
 uint64_t get_uart_base(){
     return UART0_BASE;
@@ -35,45 +70,249 @@ void enable_uart() {
 
   write32(UART0_LCRH, (1 << 4) | (1 << 5) | (1 << 6)); // 8 bits, no parity, one stop bit, FIFOs enabled
 
+  write32(UART0_IFLS, 0); // TX interrupt when the FIFO drains to 1/8, leaving room for 28 bytes per refill. RX interrupt at 1/8 full
+  write32(UART0_IMSC, 0); // Interrupts stay masked until uart_enable_irq
+  write32(UART0_ICR, 0x7FF);
+
   write32(UART0_CR, (1 << 0) | (1 << 8) | (1 << 9)); // Enable UART, TX and RX
 }
 
-void uart_raw_putc(const char c) {
-  while (read32(UART0_FR) & (1 << 5)); // Wait until TX FIFO is not full
+static void uart_tx_fill_fifo() {
+  /*
+  Move queued bytes into the TX FIFO until it is full or the ring is empty.
+  The TX interrupt is only unmasked while there is something left to send, otherwise it would fire continuously.
+  Must run with IRQs disabled, as it is the only consumer of the ring.
+  */
+  uint32_t tail = tx_tail;
+  uint32_t commit = __atomic_load_n(&tx_commit, __ATOMIC_ACQUIRE);
+  while (tail != commit && !(read32(UART0_FR) & UART_FR_TXFF)) {
+    write32(UART0_DR, tx_ring[tail & UART_TX_RING_MASK]);
+    tail++;
+  }
+  __atomic_store_n(&tx_tail, tail, __ATOMIC_RELEASE);
+
+  uint32_t imsc = read32(UART0_IMSC);
+  if (tail != commit && tx_irq_ready)
+    write32(UART0_IMSC, imsc | UART_INT_TX);
+  else
+    write32(UART0_IMSC, imsc & ~UART_INT_TX);
+}
+
+static void uart_sync_putc(const char c) {
+  while (read32(UART0_FR) & UART_FR_TXFF); // Wait until TX FIFO is not full
   write32(UART0_DR, c);
 }
 
-void uart_putc(const char c) {
+static bool uart_tx_queue(const char *s, uint32_t len) {
+  /*
+  Queue len bytes and start transmission without waiting for the line.
+  Returns false, queueing nothing, if the ring does not have room for all of them.
+  */
+  if (tx_sync) {
+    for (uint32_t i = 0; i < len; i++)
+      uart_sync_putc(s[i]);
+    return true;
+  }
+
+  uint64_t flags = irq_save(); // Keeps an IRQ handler that logs from spinning on a reservation it interrupted
+  uint32_t start;
+  do {
+    start = __atomic_load_n(&tx_reserve, __ATOMIC_RELAXED);
+    uint32_t used = start - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE);
+    if (used + len > UART_TX_RING_SIZE) {
+      irq_restore(flags);
+      return false;
+    }
+    if (used + len > tx_high_watermark)
+      tx_high_watermark = used + len;
+  } while (!__atomic_compare_exchange_n(&tx_reserve, &start, start + len, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+  for (uint32_t i = 0; i < len; i++)
+    tx_ring[(start + i) & UART_TX_RING_MASK] = s[i];
+
+  while (__atomic_load_n(&tx_commit, __ATOMIC_ACQUIRE) != start); // Earlier reservations publish first
+  __atomic_store_n(&tx_commit, start + len, __ATOMIC_RELEASE);
+
+  uart_tx_fill_fifo();
+  irq_restore(flags);
+  return true;
+}
+
+static void uart_tx_write(const char *s, uint32_t len) {
+  /*
+  Queue len bytes. If the ring does not have room for all of them, the whole write is dropped and counted.
+  */
+  if (!uart_tx_queue(s, len))
+    __atomic_fetch_add(&tx_dropped, len, __ATOMIC_RELAXED);
+}
+
+static irq_result uart_irq(uint32_t irq, void *ctx) {
+  /*
+  PL011 interrupt handler. Passes received bytes to the receive handler and refills the TX FIFO from the ring.
+  */
+  uint32_t mis = read32(UART0_MIS);
+  if (!mis) return IRQ_NONE;
+
+  if (mis & (UART_INT_RX | UART_INT_RT)) {
+    while (!(read32(UART0_FR) & UART_FR_RXFE)) {
+      char c = read32(UART0_DR) & 0xFF;
+      if (rx_handler)
+        rx_handler(c);
+    }
+    write32(UART0_ICR, UART_INT_RX | UART_INT_RT);
+  }
+
+  if (mis & UART_INT_TX) {
+    write32(UART0_ICR, UART_INT_TX);
+    uart_tx_fill_fifo();
+    if (tx_refill && tx_tail == tx_commit)
+      tx_refill();
+  }
+
+  return IRQ_HANDLED;
+}
+
+void uart_enable_irq() {
+  /*
+  This function routes the PL011 interrupt through the GIC. Once it is enabled the ring is drained
+  by the TX interrupt, anything queued before that point is flushed here.
+  Receive interrupts are enabled as well.
+  Must be called after gic_init.
+  Example usage: uart_enable_irq(); would switch the UART to interrupt driven transmission.
+  */
+  request_irq(UART0_IRQ, uart_irq, 0, IRQ_TRIGGER_LEVEL);
+  tx_irq_ready = true;
+  uint64_t flags = irq_save();
+  write32(UART0_IMSC, read32(UART0_IMSC) | UART_INT_RX | UART_INT_RT);
+  uart_tx_fill_fifo();
+  irq_restore(flags);
+}
+
+void uart_set_rx_handler(void (*handler)(char c)) {
+  /*
+  This function sets the function called, in interrupt context, for every received byte.
+  Example usage: uart_set_rx_handler(tty_receive); would feed serial input to the console line discipline.
+  */
+  rx_handler = handler;
+}
+
+void uart_set_tx_refill(void (*refill)()) {
+  /*
+  This function sets the function called, in interrupt context, once the TX ring has drained completely.
+  It lets a producer that holds more output than fits in the ring queue the rest when there is room.
+  Example usage: uart_set_tx_refill(kio_drain_uart);
+  */
+  tx_refill = refill;
+}
+
+uint32_t uart_tx_space() {
+  /*
+  This function returns how many bytes can currently be queued without being dropped.
+  */
+  if (tx_sync) return UART_TX_RING_SIZE;
+  return UART_TX_RING_SIZE - (__atomic_load_n(&tx_reserve, __ATOMIC_RELAXED) - __atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE));
+}
+
+static void uart_tx_wait() {
+  /*
+  Wait for the ring to drain some. With interrupts enabled the TX interrupt does it while the CPU sleeps.
+  With them masked, as in an interrupt handler or before uart_enable_irq, nothing else drains the ring,
+  so this moves bytes into the FIFO itself.
+  */
+  uint64_t flags = irq_save();
+  if (tx_irq_ready && !(flags & (1 << 7))) { // DAIF.I clear
+    irq_restore(flags);
+    asm volatile ("wfi" ::: "memory");
+  } else {
+    uart_tx_fill_fifo();
+    irq_restore(flags);
+  }
+}
+
+void uart_raw_write_wait(const char *s, uint64_t len) {
+  /*
+  This function queues len bytes like uart_raw_puts, but waits for room in the ring instead of dropping them,
+  for dumps much larger than the ring. With interrupts enabled it sleeps until the TX interrupt has drained enough.
+  With them masked, as in an interrupt handler or before uart_enable_irq, it holds the CPU until everything is queued.
+  Example usage: uart_raw_write_wait(line, len); for each line of a dump.
+  */
+  while (len) {
+    uint32_t chunk = len > UART_TX_RING_SIZE / 4 ? UART_TX_RING_SIZE / 4 : len;
+    while (!uart_tx_queue(s, chunk))
+      uart_tx_wait();
+    s += chunk;
+    len -= chunk;
+  }
+}
+
+void uart_tx_drain() {
+  /*
+  This function waits until everything queued has left the UART, for callers about to power off or reset.
+  Example usage: uart_tx_drain(); psci_system_off();
+  */
+  while (__atomic_load_n(&tx_tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&tx_commit, __ATOMIC_ACQUIRE))
+    uart_tx_wait();
+  while (read32(UART0_FR) & UART_FR_BUSY);
+}
+
+void uart_panic_flush() {
+  /*
+  This function switches the UART to synchronous output and writes out everything still queued.
+  It is meant for panic(), where interrupts will never be serviced again.
+  */
   disable_interrupt();
+  tx_sync = true;
+  write32(UART0_IMSC, read32(UART0_IMSC) & ~UART_INT_TX);
+  uint32_t commit = __atomic_load_n(&tx_commit, __ATOMIC_ACQUIRE);
+  for (uint32_t tail = tx_tail; tail != commit; tail++)
+    uart_sync_putc(tx_ring[tail & UART_TX_RING_MASK]);
+  tx_tail = commit;
+}
+
+uart_tx_stats uart_get_tx_stats() {
+  /*
+  This function returns the number of bytes dropped because the ring was full,
+  the highest ring occupancy seen so far and the number of bytes still queued.
+  */
+  return (uart_tx_stats){
+    .dropped = tx_dropped,
+    .high_watermark = tx_high_watermark,
+    .pending = tx_commit - tx_tail,
+  };
+}
+
+void uart_raw_putc(const char c) {
+  uart_tx_write(&c, 1);
+}
+
+void uart_putc(const char c) {
   uart_raw_putc(c);
-  enable_interrupt();
 }
 
 void uart_puts(const char *s) {
-  disable_interrupt();
   uart_raw_puts(s);
-  enable_interrupt();
 }
 
 void uart_raw_puts(const char *s){
-  while (*s != '\0') {
-    uart_raw_putc(*s);
-    s++;
-  }
+  uint32_t len = 0;
+  while (s[len] != '\0')
+    len++;
+  uart_tx_write(s, len);
 }
 
 void uart_puthex(uint64_t value) {
-  disable_interrupt();
   const char hex_chars[] = "0123456789ABCDEF";
+  char buf[18];
+  uint32_t len = 0;
   bool started = false;
-  uart_raw_putc('0');
-  uart_raw_putc('x');
+  buf[len++] = '0';
+  buf[len++] = 'x';
   for (int i = 60; i >= 0; i -= 4) {
     char curr_char = hex_chars[(value >> i) & 0xF];
     if (started || curr_char != '0' || i == 0) {
       started = true;
-      uart_putc(curr_char);
+      buf[len++] = curr_char;
     }
   }
-  enable_interrupt();
+  uart_tx_write(buf, len);
 }
@@ -7,15 +7,30 @@ extern "C" {
 #include "types.h"
 
 #define UART0_BASE 0x09000000
+#define UART0_IRQ 33 // SPI 1 on the virt board
+
+typedef struct {
+    uint64_t dropped;
+    uint32_t high_watermark;
+    uint32_t pending;
+} uart_tx_stats;
 
 uint64_t get_uart_base();
 void enable_uart();
+void uart_enable_irq();
+void uart_set_rx_handler(void (*handler)(char c));
+void uart_set_tx_refill(void (*refill)());
+uint32_t uart_tx_space();
+void uart_panic_flush();
+uart_tx_stats uart_get_tx_stats();
 void uart_puts(const char *s);
 void uart_putc(const char c);
 void uart_puthex(uint64_t value);
 
 void uart_raw_putc(const char c);
 void uart_raw_puts(const char *s);
+void uart_raw_write_wait(const char *s, uint64_t len);
+void uart_tx_drain();
 
 #ifdef __cplusplus
 }
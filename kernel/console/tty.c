@@ -0,0 +1,230 @@
+/*
+kernel/console/tty.c
+This file implements the input side of the kernel console. Characters received by the UART interrupt
+go through a minimal line discipline (echo, backspace editing, line buffering or raw mode)
+and are queued in an input ring that processes read through the read syscall.
+A process reading with no input available is blocked and woken up by the interrupt that completes its input.
+Control keys that dump large amounts of data are handed to the ttykeys process, as the dumps wait for room in the UART.
+*/
+#include "tty.h"
+#include "kio.h"
+#include "serial/uart.h"
+#include "process/scheduler.h"
+#include "process/kprocess_loader.h"
+#include "syscalls/syscalls.h"
+#include "trace.h"
+#include "profiler.h"
+#include "graph/screen_capture.h"
+#include "gic.h"
+
+#define TTY_INPUT_SIZE 1024 // Power of two, indices wrap with a mask
+#define TTY_INPUT_MASK (TTY_INPUT_SIZE - 1)
+#define TTY_LINE_MAX 256
+#define TTY_TRACE_KEY 0x14 // Ctrl-T starts tracing, or stops it and dumps the trace
+#define TTY_PROFILE_KEY 0x10 // Ctrl-P starts the sampling profiler, or stops it and dumps the samples
+#define TTY_CAPTURE_KEY 0x06 // Ctrl-F saves the screen to screen.ppm on the host, with semihosting
+
+#define TTY_WORK_TRACE (1 << 0)
+#define TTY_WORK_PROFILE (1 << 1)
+#define TTY_WORK_CAPTURE (1 << 2)
+
+static char input_ring[TTY_INPUT_SIZE];
+static volatile uint32_t input_head; // Written by the interrupt handler only
+static volatile uint32_t input_tail; // Written by readers only
+static uint32_t input_lines; // Complete lines in the ring, for canonical reads
+
+static char line_buf[TTY_LINE_MAX];
+static uint32_t line_len;
+
+static uint32_t tty_mode = INPUT_ECHO | INPUT_CANONICAL;
+static int waiting_proc = -1;
+
+static volatile uint32_t pending_work; // TTY_WORK_* bits for the ttykeys process
+static int keys_pid = -1;
+
+static bool tty_push(char c) {
+    if (input_head - input_tail >= TTY_INPUT_SIZE)
+        return false;
+    input_ring[input_head & TTY_INPUT_MASK] = c;
+    __atomic_store_n(&input_head, input_head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void tty_wake() {
+    if (waiting_proc < 0) return;
+    wake_proc(waiting_proc);
+    waiting_proc = -1;
+}
+
+static void tty_run_work(uint32_t work) {
+    if (work & TTY_WORK_TRACE) {
+        if (trace_active())
+            trace_dump();
+        else
+            trace_start(TRACE_ALL);
+    }
+    if (work & TTY_WORK_PROFILE) {
+        if (profiler_running())
+            profiler_dump();
+        else
+            profiler_start(PROFILE_DEFAULT_HZ, PROFILE_SOURCE_AUTO);
+    }
+    if (work & TTY_WORK_CAPTURE)
+        screen_capture("screen.ppm");
+}
+
+static void tty_defer(uint32_t work) {
+    /*
+    Hands the work for a control key to the ttykeys process. Until it runs the work is done right away,
+    in the interrupt handler, where the UART is drained by polling.
+    */
+    if (keys_pid < 0) {
+        tty_run_work(work);
+        return;
+    }
+    pending_work |= work;
+    wake_proc(keys_pid);
+}
+
+void tty_receive(char c) {
+    /*
+    This function feeds one received character through the line discipline. It runs in the UART interrupt handler.
+    In canonical mode characters are collected in a line buffer that can be edited with backspace,
+    and the whole line is queued when enter is pressed. In raw mode every character is queued immediately.
+    */
+    if (c == '\r') c = '\n';
+
+    if (c == TTY_TRACE_KEY) {
+        tty_defer(TTY_WORK_TRACE);
+        return;
+    }
+
+    if (c == TTY_PROFILE_KEY) {
+        tty_defer(TTY_WORK_PROFILE);
+        return;
+    }
+
+    if (c == TTY_CAPTURE_KEY) {
+        tty_defer(TTY_WORK_CAPTURE);
+        return;
+    }
+
+    if (!(tty_mode & INPUT_CANONICAL)) {
+        if (tty_push(c)) {
+            if (tty_mode & INPUT_ECHO) putc(c);
+            tty_wake();
+        }
+        return;
+    }
+
+    if (c == 0x7F || c == '\b') {
+        if (line_len > 0) {
+            line_len--;
+            if (tty_mode & INPUT_ECHO) uart_raw_puts("\b \b");
+        }
+        return;
+    }
+
+    if (c != '\n') {
+        if (line_len < TTY_LINE_MAX - 1) {
+            line_buf[line_len++] = c;
+            if (tty_mode & INPUT_ECHO) putc(c);
+        }
+        return;
+    }
+
+    line_buf[line_len++] = '\n';
+    if (input_head - input_tail + line_len <= TTY_INPUT_SIZE) {
+        for (uint32_t i = 0; i < line_len; i++)
+            tty_push(line_buf[i]);
+        input_lines++;
+    }
+    line_len = 0;
+    if (tty_mode & INPUT_ECHO) putc('\n');
+    tty_wake();
+}
+
+uint64_t tty_read(char *buf, uint64_t len) {
+    /*
+    This function copies queued input into buf without blocking and returns the number of bytes copied.
+    In canonical mode it returns nothing until a whole line is available, and stops after the newline.
+    Example usage: uint64_t n = tty_read(buf, sizeof(buf)); would read a line typed on the serial console.
+    */
+    if ((tty_mode & INPUT_CANONICAL) && input_lines == 0)
+        return 0;
+
+    uint32_t head = __atomic_load_n(&input_head, __ATOMIC_ACQUIRE);
+    uint64_t n = 0;
+    while (n < len && input_tail != head) {
+        char c = input_ring[input_tail & TTY_INPUT_MASK];
+        input_tail++;
+        buf[n++] = c;
+        if (c == '\n' && (tty_mode & INPUT_CANONICAL)) {
+            input_lines--;
+            break;
+        }
+    }
+    return n;
+}
+
+void tty_wait(int pid) {
+    /*
+    This function records the process to wake up when input arrives. Only one reader waits at a time.
+    */
+    waiting_proc = pid;
+}
+
+void tty_set_mode(uint32_t mode) {
+    /*
+    This function switches between canonical and raw input and turns echo on or off.
+    Any partially edited line is queued as is, so no typed input is lost.
+    Example usage: tty_set_mode(INPUT_ECHO); would switch to raw mode with echo.
+    */
+    if ((tty_mode & INPUT_CANONICAL) && !(mode & INPUT_CANONICAL)) {
+        for (uint32_t i = 0; i < line_len; i++)
+            tty_push(line_buf[i]);
+        line_len = 0;
+        input_lines = 0;
+    }
+    tty_mode = mode;
+}
+
+uint32_t tty_get_mode() {
+    return tty_mode;
+}
+
+void tty_keys() {
+    /*
+    This function is the ttykeys kernel process. It runs the work of the control keys in process context,
+    where dumps can wait for the UART to make room instead of dropping output.
+    Interrupts are masked between finding no work and going to sleep, so a key pressed in between still wakes it.
+    */
+    enable_interrupt();
+    while (1) {
+        uint64_t flags = irq_save();
+        uint32_t work = pending_work;
+        pending_work = 0;
+        if (!work)
+            sleep_current_proc();
+        irq_restore(flags);
+        if (work)
+            tty_run_work(work);
+    }
+}
+
+void tty_start_keys() {
+    /*
+    This function starts the ttykeys process. Call it before start_scheduler.
+    */
+    process_t *proc = create_kernel_process(tty_keys, 0);
+    if (proc)
+        keys_pid = proc->id;
+}
+
+void tty_init() {
+    /*
+    This function connects the line discipline to the UART receive interrupt.
+    Must be called after uart_enable_irq.
+    */
+    uart_set_rx_handler(tty_receive);
+}
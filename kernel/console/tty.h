@@ -0,0 +1,11 @@
+#pragma once
+
+#include "types.h"
+
+void tty_init();
+void tty_start_keys();
+void tty_receive(char c);
+uint64_t tty_read(char *buf, uint64_t len);
+void tty_wait(int pid);
+void tty_set_mode(uint32_t mode);
+uint32_t tty_get_mode();
@@ -11,7 +11,9 @@ kernel/dtb.c
 #include "kstring.h"
 #include "ram_e.h"
 
-#define DTB_ADDR 0x40000000UL
+#ifndef DTB_ADDR
+#define DTB_ADDR 0x40000000UL // Where QEMU loads the DTB, the host build points it elsewhere
+#endif
 #define FDT_MAGIC 0xD00DFEED
 
 #define FDT_BEGIN_NODE  0x00000001
@@ -56,6 +58,7 @@ bool dtb_addresses(uint64_t *start, uint64_t *size) {
    if (!dtb_get_header()) return false;
    *start = (uint64_t)DTB_ADDR;
    *size = __builtin_bswap32(hdr->totalsize);
+   return true;
 }
 
 bool dtb_debug_print_all() {
@@ -80,8 +83,14 @@ bool dtb_debug_print_all() {
             skip = (skip + 4) & ~3;
             p += skip / 4;
             kprintf_raw(name);
+        } else if (token == FDT_PROP) {
+            uint32_t len = __builtin_bswap32(*p++);
+            uint32_t nameoff = __builtin_bswap32(*p++);
+            kprintf_raw("  %s (%i bytes)", (uint64_t)(strings + nameoff), len);
+            p += (len + 3) / 4; // Property data is not tokens
         }
     }
+    return true;
 }
 
 bool dtb_scan(const char *search_name, dtb_node_handler handler, dtb_match_t *match) {
@@ -112,13 +121,12 @@ bool dtb_scan(const char *search_name, dtb_node_handler handler, dtb_match_t *ma
             p += skip / 4;
             depth++;
             active = strcont(name, search_name);
-        } else if (token == FDT_PROP && active) {
+        } else if (token == FDT_PROP) {
             uint32_t len = __builtin_bswap32(*p++);
             uint32_t nameoff = __builtin_bswap32(*p++);
-            const char *propname = string + nameoff;
-            const void *prop = p;
-            handler(NULL, propname, prop, len, match);
-            p += (len + 3) / 4;
+            if (active)
+                handler(NULL, string + nameoff, p, len, match);
+            p += (len + 3) / 4; // Properties of other nodes are skipped too, their data is not tokens
         } else if (token == FDT_END_NODE) {
             depth--;
             if (active && match->found)
@@ -11,6 +11,7 @@ FIQ stands for Fast Interrupt Request.
 #include "console/kio.h"
 #include "mmu.h"
 #include "graph/graphics.h"
+#include "semihost.h"
 
 static bool panic_triggered = false;
 
@@ -43,29 +44,47 @@ void handle_exception(const char* type) {
 
     disable_visual();
 
-    kstring s = string_format("%s \nESR_EL1: %h\nELR_EL1: %h\nFAR_EL1: %h",(uint64_t)string_l(type).data,esr,elr,far);
-    panic(s.data);
+    static char info[256]; // Not on the stack, panic may have been caused by it
+    format_buffer(info, sizeof(info), "%s \nESR_EL1: %h\nELR_EL1: %h\nFAR_EL1: %h", (uint64_t)type, esr, elr, far);
+    panic(info);
 }
 
-void sync_el1_handler(){ handle_exception("SYNC EXCEPTION"); }
+void sync_el1_handler(irq_frame *frame) {
+    /*
+    This function handles synchronous exceptions taken at EL1. It returns only for a semihosting probe
+    without a host, everything else is fatal.
+    */
+    uint64_t esr;
+    asm volatile ("mrs %0, esr_el1" : "=r"(esr));
+    if (semihost_fault(frame, esr))
+        return;
+    handle_exception("SYNC EXCEPTION");
+}
 
 void fiq_el1_handler(){ handle_exception("FIQ EXCEPTION\n"); }
 
 void error_el1_handler(){ handle_exception("ERROR EXCEPTION\n"); }
 
 void draw_panic_screen(kstring s) {
+    /*
+    Drawing only records damage, so the screen is flushed for the panic message to reach the display.
+    The flush waits for virtio-gpu to finish the transfer, since the caller spins forever right after.
+    */
     gpu_clear(0x0000FF);
     uint32_t scale = 3;
-    uint32_t size = gpu_get_char_size(scale);
     gpu_draw_string(s, (point){20,20}, scale, 0xFFFFFFFF);
+    gpu_flush_wait();
 }
 
 void panic(const char* panic_msg) {
+    uart_panic_flush();
+    kio_panic_flush();
     bool old_panic_triggered = panic_triggered;
     panic_triggered = true;
     if (!old_panic_triggered) {
-        kstring s = string_format("CRAYON NOT CRAYING\n%s\nSystem Halted", (uint64_t)panic_msg);
-        draw_panic_screen(s);
+        static char text[320]; // Not on the stack, panic may have been caused by it
+        uint32_t len = format_buffer(text, sizeof(text), "CRAYON NOT CRAYING\n%s\nSystem Halted", (uint64_t)panic_msg);
+        draw_panic_screen((kstring){ .data = text, .length = len });
     }
     uart_raw_puts("*** CRAYON DOESN'T DRAW ANYMORE ***");
     uart_raw_puts(panic_msg);
@@ -74,11 +93,14 @@ void panic(const char* panic_msg) {
 }
 
 void panic_with_info(const char* msg, uint64_t info) {
+    uart_panic_flush();
+    kio_panic_flush();
     bool old_panic_triggered = panic_triggered;
     panic_triggered = true;
     if (!old_panic_triggered) {
-        kstring s = string_format("CRAYON NOT CRAYING\n%s\nError code: %h\nSystem Halted", (uint64_t)msg, info);
-        draw_panic_screen(s);
+        static char text[320]; // Not on the stack, panic may have been caused by it
+        uint32_t len = format_buffer(text, sizeof(text), "CRAYON NOT CRAYING\n%s\nError code: %h\nSystem Halted", (uint64_t)msg, info);
+        draw_panic_screen((kstring){ .data = text, .length = len });
     }
     uart_raw_puts("*** CRAYON DOESN'T DRAW ANYMORE ***");
     uart_raw_puts(msg);
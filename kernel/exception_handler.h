@@ -1,9 +1,10 @@
 #pragma once
 
 #include "types.h"
+#include "irq.h"
 
 void set_exception_vectors();
-void sync_el1_handler();
+void sync_el1_handler(irq_frame *frame);
 void fiq_el1_handler();
 void error_el1_handler();
 void panic(const char* msg);
@@ -28,8 +28,14 @@ int handle_virito_node(const char *name, const char *propname, const void *prop,
     match->found = device_id == 2;
     return 1;
    }
-   else if (match->found && strcmp(propname, "interrupts") == 0 && len >= 4) {
-        match->irq = __builtin_bswap32(*(uint32_t *)prop);
+   else if (strcmp(propname, "interrupts") == 0 && len >= 12) {
+        /*
+        The GIC binding uses three cells: type (0 = SPI, 1 = PPI), number relative to the type, and trigger flags.
+        The property comes before "reg" in QEMU's tree, so it is recorded regardless of match->found.
+        */
+        uint32_t *p = (uint32_t *)prop;
+        uint32_t type = __builtin_bswap32(p[0]);
+        match->irq = __builtin_bswap32(p[1]) + (type == 0 ? 32 : 16);
         return 1;
    }
    return 0;
@@ -62,4 +68,8 @@ uint64_t get_disk_address() {
 
 uint64_t get_disk_size() {
     return disk_device_size;
+}
+
+uint32_t get_disk_irq() {
+    return disk_device_interrupt;
 }
\ No newline at end of file
@@ -5,4 +5,5 @@
 
 void init_disk();
 uint64_t get_disk_address();
-uint64_t get_disk_size();
\ No newline at end of file
+uint64_t get_disk_size();
+uint32_t get_disk_irq();
\ No newline at end of file
@@ -1,105 +1,199 @@
 /* 
 kernel/gic.c
 This file implements the Generic Interrupt Controller (GIC) initialization and interrupt handling.
-It sets up the GIC Distributor and CPU Interface, configures the timer interrupt,
+It sets up the GIC Distributor and CPU Interface, configures individual interrupt lines,
 and provides functions to enable interrupts and handle IRQ exceptions.
+Handlers for individual lines are registered through irq.c.
 IRQ stands for Interrupt Request.
 */
 #include "gic.h"
+#include "irq.h"
 #include "console/kio.h"
 #include "ram_e.h"
 #include "process/scheduler.h"
 
-#define IRQ_TIMER 30
-
-static uint64_t _msecs;
+#define GICD_CTLR       (GICD_BASE + 0x000)
+#define GICD_TYPER      (GICD_BASE + 0x004)
+#define GICD_ISENABLER  (GICD_BASE + 0x100)
+#define GICD_ICENABLER  (GICD_BASE + 0x180)
+#define GICD_ICPENDR    (GICD_BASE + 0x280)
+#define GICD_IPRIORITYR (GICD_BASE + 0x400)
+#define GICD_ITARGETSR  (GICD_BASE + 0x800)
+#define GICD_ICFGR      (GICD_BASE + 0xC00)
+#define GICD_SGIR       (GICD_BASE + 0xF00)
+
+#define GICC_CTLR (GICC_BASE + 0x000)
+#define GICC_PMR  (GICC_BASE + 0x004)
+#define GICC_IAR  (GICC_BASE + 0x00C)
+#define GICC_EOIR (GICC_BASE + 0x010)
+
+#define GICV2M_MSI_TYPER     (GICV2M_BASE + 0x008)
+#define GICV2M_MSI_SETSPI_NS (GICV2M_BASE + 0x040)
+
+static uint32_t gic_lines;
+static uint32_t msi_base;
+static uint32_t msi_count;
+static uint32_t msi_next;
 
 extern void irq_el1_asm_handler();
 
 void gic_init() {
     /*
     Initialize the GIC Distributor and CPU Interface by disabling them,
-    configuring the timer interrupt, and then enabling them.
+    putting every shared interrupt line into a known state, and then enabling them.
+    Lines stay disabled until a driver registers a handler with request_irq.
 
     GICD - GIC Distributor -> This component is responsible for receiving interrupts from peripherals
     GICC - GIC CPU Interface -> This component is responsible for delivering interrupts to the CPU cores
 
     */
 
-    write8(GICD_BASE, 0); // Disable Distributor
-    write8(GICC_BASE, 0); // Disable CPU Interface
+    write32(GICD_CTLR, 0); // Disable Distributor
+    write32(GICC_CTLR, 0); // Disable CPU Interface
+
+    gic_lines = ((read32(GICD_TYPER) & 0x1F) + 1) * 32; // ITLinesNumber
+    if (gic_lines > IRQ_MAX)
+        gic_lines = IRQ_MAX;
+
+    for (uint32_t i = 0; i < gic_lines; i += 32) {
+        write32(GICD_ICENABLER + (i / 32) * 4, 0xFFFFFFFF); // Disable all lines
+        write32(GICD_ICPENDR + (i / 32) * 4, 0xFFFFFFFF); // Clear anything left pending
+    }
+    for (uint32_t i = 32; i < gic_lines; i++) {
+        write8(GICD_IPRIORITYR + i, IRQ_DEFAULT_PRIORITY);
+        write8(GICD_ITARGETSR + i, IRQ_DEFAULT_TARGET);
+    }
 
-    uint32_t flag = read32(GICD_BASE + 0x100 + (IRQ_TIMER / 32) * 4); // Read current enable state
-    write32(GICD_BASE + 0x100 + (IRQ_TIMER / 32) * 4, flag | (1 << (IRQ_TIMER % 32))); // Enable timer interrupt
-    write32(GICD_BASE + 0x800 + (IRQ_TIMER / 4) * 4, 1 << ((IRQ_TIMER % 4) * 8)); // Target CPU 0
-    write32(GICD_BASE + 0x400 + (IRQ_TIMER / 4) * 4, 0); // Priority 0
+    write32(GICC_PMR, 0xF0); // Priority mask register
 
-    write16(GICC_BASE + 0x004, 0xF0); // Priority mask register
+    write32(GICC_CTLR, 1); // Enable CPU Interface
+    write32(GICD_CTLR, 1); // Enable Distributor
 
-    write8(GICC_BASE, 1); // Enable CPU Interface
-    write8(GICD_BASE, 1); // Enable Distributor
+    kprintf("[GIC INIT] GIC Initialized with %i lines\n", gic_lines);
 
-    kprintf("[GIC INIT] GIC Initialized\n");
+    uint32_t msi_typer = read32(GICV2M_MSI_TYPER);
+    msi_base = (msi_typer >> 16) & 0x3FF;
+    msi_count = msi_typer & 0x3FF;
+    if (msi_base < 32 || msi_base + msi_count > gic_lines)
+        msi_count = 0; // No usable v2m frame
+    msi_next = 0;
+    if (msi_count)
+        kprintf("[GIC INIT] GICv2m frame with %i SPIs starting at %i\n", msi_count, msi_base);
 }
 
-void timer_reset() {
-    /*
-    Reset the timer interval based on the configured seconds.
-    */
-    uint64_t freq;
-    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
-    uint64_t interval = (freq * _msecs) / 1000;
-    asm volatile ("msr cntp_tval_el0, %0" :: "r"(interval));
+bool gic_msi_available() {
+    return msi_count > 0;
 }
 
-void timer_enable() {
+uint32_t gic_alloc_msi() {
     /*
-    Enable the physical timer by setting the appropriate control bits.
+    Hand out the next SPI that the GICv2m frame can raise from a message write.
+    A device triggers it by writing the returned INTID to gic_msi_doorbell().
+    Returns 0 once the frame has no lines left.
     */
-    uint64_t val = 1;
-    asm volatile ("msr cntp_ctl_el0, %0" :: "r"(val));
-    asm volatile ("msr cntkctl_el1, %0" :: "r"(val));
+    if (msi_next >= msi_count) return 0;
+    return msi_base + msi_next++;
 }
 
-void timer_init(uint64_t msecs) {
+uint64_t gic_msi_doorbell() {
+    return GICV2M_MSI_SETSPI_NS;
+}
+
+void gic_configure_irq(uint32_t irq, bool edge, uint8_t priority, uint8_t target) {
     /*
-    Initialize the timer with the specified interval in seconds.
+    Configure the trigger mode, priority and target CPUs of an interrupt line.
+    Trigger mode and targets are fixed in hardware for SGIs and PPIs (0-31), so only the priority is set for those.
     */
-    _msecs = msecs;
-    timer_reset();
-    timer_enable();
+    write8(GICD_IPRIORITYR + irq, priority);
+    if (irq < 32) return;
+
+    write8(GICD_ITARGETSR + irq, target);
+
+    uintptr_t cfg = GICD_ICFGR + (irq / 16) * 4;
+    uint32_t shift = (irq % 16) * 2 + 1; // Upper bit of each 2 bit field selects edge triggering
+    uint32_t val = read32(cfg);
+    if (edge)
+        val |= (1 << shift);
+    else
+        val &= ~(1 << shift);
+    write32(cfg, val);
+}
+
+void gic_enable_irq(uint32_t irq) {
+    write32(GICD_ISENABLER + (irq / 32) * 4, 1 << (irq % 32));
+}
+
+void gic_disable_irq(uint32_t irq) {
+    write32(GICD_ICENABLER + (irq / 32) * 4, 1 << (irq % 32));
 }
 
 void enable_interrupt() {
     /*
     Enable global interrupts by clearing the interrupt mask.
     */
-    asm volatile ("msr daifclr, #2"); // Enable IRQs
-    asm volatile ("isb");
+    asm volatile ("msr daifclr, #2" ::: "memory"); // Enable IRQs
+    asm volatile ("isb" ::: "memory");
 }
 
 void disable_interrupt() {
     /*
     Disable global interrupts by setting the interrupt mask.
     */
-    asm volatile ("msr daifset, #2"); // Disable IRQs
-    asm volatile ("isb");
+    asm volatile ("msr daifset, #2" ::: "memory"); // Disable IRQs
+    asm volatile ("isb" ::: "memory");
+}
+
+uint64_t irq_save() {
+    /*
+    Disable IRQs and return the previous interrupt mask, so short critical sections can be nested
+    inside code that may already run with interrupts disabled.
+    Example usage: uint64_t flags = irq_save(); ... irq_restore(flags);
+    */
+    uint64_t daif;
+    // The memory clobbers keep the compiler from moving loads and stores out of the critical section
+    asm volatile ("mrs %0, daif" : "=r"(daif) :: "memory");
+    asm volatile ("msr daifset, #2" ::: "memory");
+    return daif;
+}
+
+void irq_restore(uint64_t daif) {
+    /*
+    Restore the interrupt mask returned by irq_save.
+    */
+    asm volatile ("msr daif, %0" :: "r"(daif) : "memory");
 }
 
-void irq_el1_handler() {
+void gic_send_sgi(uint32_t sgi) {
     /*
-    Handle IRQ exceptions by checking the interrupt ID and responding accordingly.
-    1. Read the interrupt ID from the GICC.
-    2. If it's the timer interrupt, reset the timer and signal end of interrupt.
-    3. If it's an unhandled interrupt, log the interrupt ID.
+    Raise a software generated interrupt (ID 0-15) on the calling CPU.
+    It is taken as soon as interrupts are unmasked.
     */
-   save_context_registers();
-   save_return_address_interrupt();
-    uint32_t irq = read32(GICC_BASE + 0xC);
+    write32(GICD_SGIR, (0b10 << 24) | (sgi & 0xF)); // TargetListFilter 0b10, this CPU only
+}
 
-    if (irq == IRQ_TIMER) {
-        timer_reset();
-        write32(GICC_BASE + 0x10, irq); // End of Interrupt
+void irq_el1_handler(irq_frame *frame, uint64_t entry_ticks) {
+    /*
+    Handle IRQ exceptions by acknowledging the interrupt and dispatching it to its registered handler.
+    1. Read the interrupt ID from the GICC. IDs 1020-1023 are spurious and must not be EOI'd.
+    2. Run the handler registered for the line, and signal end of interrupt.
+    3. If the handler asked for it, save the interrupted process and switch to the next one.
+    Otherwise return, and irq_el1_asm_handler resumes the interrupted code from the frame.
+    entry_ticks is the counter value read by the entry stub, right after the frame was pushed.
+    */
+    uint32_t iar = read32(GICC_IAR);
+    uint32_t irq = iar & 0x3FF;
+
+    if (irq >= 1020) {
+        irq_count_spurious();
+        return;
+    }
+
+    irq_result result = irq_handle(irq, frame, entry_ticks);
+
+    write32(GICC_EOIR, iar); // End of Interrupt
+
+    if (result == IRQ_RESCHEDULE) {
+        save_context_frame(frame);
         switch_proc(INTERRUPT);
     }
-}
\ No newline at end of file
+}
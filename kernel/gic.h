@@ -1,12 +1,30 @@
 #pragma once
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "types.h"
+#include "irq.h"
 
 #define GICD_BASE 0x08000000
 #define GICC_BASE 0x08010000
+#define GICV2M_BASE 0x08020000 // MSI frame, turns message writes into SPIs
 
 void gic_init();
-void timer_init(uint64_t msecs);
-void irq_el1_handler();
+void gic_configure_irq(uint32_t irq, bool edge, uint8_t priority, uint8_t target);
+void gic_enable_irq(uint32_t irq);
+void gic_disable_irq(uint32_t irq);
+void gic_send_sgi(uint32_t sgi);
+bool gic_msi_available();
+uint32_t gic_alloc_msi();
+uint64_t gic_msi_doorbell();
+void irq_el1_handler(irq_frame *frame, uint64_t entry_ticks);
 void disable_interrupt();
-void enable_interrupt();
\ No newline at end of file
+void enable_interrupt();
+uint64_t irq_save();
+void irq_restore(uint64_t daif);
+
+#ifdef __cplusplus
+}
+#endif
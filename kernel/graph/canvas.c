@@ -0,0 +1,189 @@
+/*
+kernel/graph/canvas.c
+This file implements the software rasterizer every GPU driver shares. It draws into a surface,
+the base address, size and stride of a framebuffer, so drivers only allocate the surface and present it.
+Both drivers use 32 bit pixels laid out the same in memory (XRGB8888 and B8G8R8A8), so colors need no conversion.
+Primitives clip once up front and then run unchecked inner loops on row pointers:
+rectangles are NEON fills per row, or one fill when they span whole rows, and glyphs are drawn as runs of set bits.
+*/
+#include "canvas.h"
+#include "ram_e.h"
+#include "graph/font8x8_basic.h"
+
+#define CANVAS_LINE_SPACING 2 // Pixels between lines of a string
+
+static const rect empty = {{0, 0}, {0, 0}};
+
+static inline uint32_t* pixel_at(surface s, uint32_t x, uint32_t y) {
+    return (uint32_t*)(s.base + (uint64_t)y * s.stride + (uint64_t)x * 4);
+}
+
+static inline bool clip(surface s, rect *r) {
+    /*
+    Clips r to the surface and tells whether anything is left of it.
+    */
+    if (r->point.x >= s.width || r->point.y >= s.height || !r->size.width || !r->size.height)
+        return false;
+    if (r->size.width > s.width - r->point.x) r->size.width = s.width - r->point.x;
+    if (r->size.height > s.height - r->point.y) r->size.height = s.height - r->point.y;
+    return true;
+}
+
+rect canvas_fill_rect(surface s, rect r, color color) {
+    /*
+    This function fills a rectangle with a color, clipped to the surface.
+    Example usage: canvas_fill_rect(s, (rect){{10, 20}, {100, 50}}, 0x00FF00); would fill a green rectangle at (10,20) with width 100 and height 50.
+    */
+    if (!clip(s, &r))
+        return empty;
+    uint8_t *row = (uint8_t*)pixel_at(s, r.point.x, r.point.y);
+    if (r.size.width == s.width && s.stride == s.width * 4) {
+        memset32_simd(row, color, (uint64_t)s.stride * r.size.height);
+        return r;
+    }
+    for (uint32_t y = 0; y < r.size.height; y++, row += s.stride)
+        memset32_simd(row, color, r.size.width * 4);
+    return r;
+}
+
+rect canvas_draw_pixel(surface s, point p, color color) {
+    /*
+    This function sets a single pixel, if it is on the surface.
+    Example usage: canvas_draw_pixel(s, (point){10, 20}, 0xFF0000); would draw a red pixel at coordinates (10, 20).
+    */
+    if (p.x >= s.width || p.y >= s.height)
+        return empty;
+    *pixel_at(s, p.x, p.y) = color;
+    return (rect){p, {1, 1}};
+}
+
+rect canvas_draw_line(surface s, point p0, point p1, color color) {
+    /*
+    This function draws a line between two points with Bresenham's algorithm.
+    Horizontal and vertical lines are filled as rectangles. Other lines walk a pixel pointer, checking bounds
+    on every step only when an end point is off the surface, as a line between two points on it stays on it.
+    Example usage: canvas_draw_line(s, (point){10, 20}, (point){100, 200}, 0x0000FF); would draw a blue line from (10,20) to (100,200).
+    */
+    uint32_t x0 = p0.x < p1.x ? p0.x : p1.x;
+    uint32_t y0 = p0.y < p1.y ? p0.y : p1.y;
+    int dx = (p1.x > p0.x) ? (p1.x - p0.x) : (p0.x - p1.x);
+    int dy = (p1.y > p0.y) ? (p1.y - p0.y) : (p0.y - p1.y);
+    if (dx == 0 || dy == 0)
+        return canvas_fill_rect(s, (rect){{x0, y0}, {dx + 1, dy + 1}}, color);
+
+    rect bounds = {{x0, y0}, {dx + 1, dy + 1}};
+    if (!clip(s, &bounds))
+        return empty;
+    bool checked = p0.x >= s.width || p0.y >= s.height || p1.x >= s.width || p1.y >= s.height;
+
+    int sx = (p0.x < p1.x) ? 1 : -1;
+    int sy = (p0.y < p1.y) ? 1 : -1;
+    int64_t step_y = sy * (int64_t)s.stride / 4;
+    int err = (dx > dy ? dx : -dy) / 2, e2;
+    uint32_t x = p0.x, y = p0.y;
+    uint32_t *pixel = pixel_at(s, x, y);
+
+    for (;;) {
+        if (!checked || (x < s.width && y < s.height))
+            *pixel = color;
+        if (x == p1.x && y == p1.y) break;
+        e2 = err;
+        if (e2 > -dx) { err -= dy; x += sx; pixel += sx; }
+        if (e2 < dy) { err += dx; y += sy; pixel += step_y; }
+    }
+    return bounds;
+}
+
+rect canvas_draw_char(surface s, point p, char c, uint32_t scale, color color) {
+    /*
+    This function draws a character from the 8x8 font, each font pixel scaled to a scale x scale square.
+    Every glyph row is split into runs of set bits, each written as one span, clipped to the surface once.
+    Example usage: canvas_draw_char(s, (point){10, 20}, 'A', 1, 0xFFFFFF); would draw the character 'A' in white at coordinates (10, 20).
+    */
+    rect cell = {p, {8 * scale, 8 * scale}};
+    if (!scale || !clip(s, &cell))
+        return empty;
+    const uint8_t *glyph = font8x8_basic[(uint8_t)c & 0x7F];
+    uint8_t *row = (uint8_t*)pixel_at(s, p.x, p.y);
+
+    for (uint32_t y = 0; y < cell.size.height; y++, row += s.stride) {
+        uint8_t bits = glyph[y / scale];
+        uint32_t col = 0;
+        while (bits) {
+            if (!(bits & 0x80)) {
+                bits <<= 1;
+                col++;
+                continue;
+            }
+            uint32_t from = col * scale;
+            while (bits & 0x80) {
+                bits <<= 1;
+                col++;
+            }
+            uint32_t to = col * scale;
+            if (from >= cell.size.width) break;
+            if (to > cell.size.width) to = cell.size.width;
+            uint32_t *span = (uint32_t*)row;
+            for (uint32_t x = from; x < to; x++)
+                span[x] = color;
+        }
+    }
+    return cell;
+}
+
+rect canvas_draw_string(surface s, kstring str, point p, uint32_t scale, color color) {
+    /*
+    This function draws a string, starting a new line below the first character on '\n'.
+    It returns the bounding box of everything drawn.
+    Example usage: canvas_draw_string(s, string_l("Hello"), (point){100, 100}, 1, 0xFFFFFF);
+    */
+    uint32_t char_size = canvas_char_size(scale);
+    uint32_t x = p.x, y = p.y;
+    uint32_t x1 = p.x, y1 = p.y;
+    for (uint32_t i = 0; i < str.length; i++) {
+        if (str.data[i] == '\n') {
+            y += char_size + CANVAS_LINE_SPACING;
+            x = p.x;
+            continue;
+        }
+        rect r = canvas_draw_char(s, (point){x, y}, str.data[i], scale, color);
+        if (r.size.width) {
+            if (r.point.x + r.size.width > x1) x1 = r.point.x + r.size.width;
+            if (r.point.y + r.size.height > y1) y1 = r.point.y + r.size.height;
+        }
+        x += char_size;
+    }
+    if (x1 == p.x || y1 == p.y)
+        return empty;
+    return (rect){p, {x1 - p.x, y1 - p.y}};
+}
+
+rect canvas_scroll(surface s, rect r, uint32_t lines, color fill) {
+    /*
+    This function moves the contents of a region up by the given number of pixel rows
+    and fills the rows uncovered at the bottom with a color. A full-width region is a single block move.
+    Example usage: canvas_scroll(s, (rect){{0, 0}, {1024, 768}}, 16, 0x0); would scroll the screen up by one 16 pixel text line.
+    */
+    if (!clip(s, &r))
+        return empty;
+    if (lines > r.size.height) lines = r.size.height;
+
+    uint64_t row_bytes = r.size.width * 4;
+    uint64_t top = (uint64_t)pixel_at(s, r.point.x, r.point.y);
+    uint32_t kept = r.size.height - lines;
+
+    if (r.point.x == 0 && r.size.width == s.width && s.stride == s.width * 4) {
+        memcpy_simd((void*)top, (void*)(top + lines * s.stride), (uint64_t)kept * s.stride);
+        memset32_simd((void*)(top + (uint64_t)kept * s.stride), fill, (uint64_t)lines * s.stride);
+    } else {
+        for (uint32_t y = 0; y < kept; y++)
+            memcpy_simd((void*)(top + (uint64_t)y * s.stride), (void*)(top + (uint64_t)(y + lines) * s.stride), row_bytes);
+        for (uint32_t y = kept; y < r.size.height; y++)
+            memset32_simd((void*)(top + (uint64_t)y * s.stride), fill, row_bytes);
+    }
+    return r;
+}
+
+uint32_t canvas_char_size(uint32_t scale) {
+    return 8 * scale;
+}
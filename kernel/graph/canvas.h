@@ -0,0 +1,25 @@
+#pragma once
+
+#include "types.h"
+#include "graph/graphic_types.h"
+#include "kstring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Drawing primitives over any 32 bit per pixel surface. Each one clips to the surface
+and returns the region it changed, empty when nothing was drawn, for the caller to report as damage.
+*/
+rect canvas_fill_rect(surface s, rect r, color color);
+rect canvas_draw_pixel(surface s, point p, color color);
+rect canvas_draw_line(surface s, point p0, point p1, color color);
+rect canvas_draw_char(surface s, point p, char c, uint32_t scale, color color);
+rect canvas_draw_string(surface s, kstring str, point p, uint32_t scale, color color);
+rect canvas_scroll(surface s, rect r, uint32_t lines, color fill);
+uint32_t canvas_char_size(uint32_t scale);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,117 @@
+/*
+kernel/graph/damage.c
+This file implements damage tracking for double buffered drivers. Drawing records the regions it touched,
+and presenting a frame copies only those regions instead of the whole screen.
+The list is short and bounded, so adding to it never fails: a rectangle inside one already listed is dropped,
+one that covers listed ones replaces them, and once the list is full it is merged into the rectangle
+whose area grows least by taking it in.
+Before presenting, damage_coalesce merges rectangles where one command over their union costs less than one per rectangle,
+for devices where each region presented is a command with a fixed cost.
+*/
+#include "damage.h"
+
+static inline uint64_t rect_area(rect r) {
+    return (uint64_t)r.size.width * r.size.height;
+}
+
+static inline bool rect_contains(rect outer, rect inner) {
+    return inner.point.x >= outer.point.x && inner.point.y >= outer.point.y &&
+        inner.point.x + inner.size.width <= outer.point.x + outer.size.width &&
+        inner.point.y + inner.size.height <= outer.point.y + outer.size.height;
+}
+
+static inline rect rect_union(rect a, rect b) {
+    uint32_t x0 = a.point.x < b.point.x ? a.point.x : b.point.x;
+    uint32_t y0 = a.point.y < b.point.y ? a.point.y : b.point.y;
+    uint32_t ax1 = a.point.x + a.size.width, bx1 = b.point.x + b.size.width;
+    uint32_t ay1 = a.point.y + a.size.height, by1 = b.point.y + b.size.height;
+    uint32_t x1 = ax1 > bx1 ? ax1 : bx1;
+    uint32_t y1 = ay1 > by1 ? ay1 : by1;
+    return (rect){{x0, y0}, {x1 - x0, y1 - y0}};
+}
+
+void damage_add(damage_list *d, rect r, size bounds) {
+    /*
+    This function records that a region changed. It is clipped to bounds, and empty regions are ignored.
+    Example usage: damage_add(&damage, (rect){{x, y}, {w, h}}, (size){width, height});
+    */
+    if (r.point.x >= bounds.width || r.point.y >= bounds.height || !r.size.width || !r.size.height)
+        return;
+    if (r.size.width > bounds.width - r.point.x) r.size.width = bounds.width - r.point.x;
+    if (r.size.height > bounds.height - r.point.y) r.size.height = bounds.height - r.point.y;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < d->count; i++) {
+        if (rect_contains(d->rects[i], r))
+            return;
+        if (!rect_contains(r, d->rects[i]))
+            d->rects[kept++] = d->rects[i];
+    }
+    d->count = kept;
+
+    if (d->count < DAMAGE_RECTS) {
+        d->rects[d->count++] = r;
+        return;
+    }
+
+    uint32_t best = 0;
+    uint64_t best_growth = (uint64_t)-1;
+    for (uint32_t i = 0; i < d->count; i++) {
+        uint64_t growth = rect_area(rect_union(d->rects[i], r)) - rect_area(d->rects[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    d->rects[best] = rect_union(d->rects[best], r);
+}
+
+void damage_clear(damage_list *d) {
+    d->count = 0;
+}
+
+rect damage_bounds(const damage_list *d) {
+    /*
+    This function returns the smallest rectangle holding all the damage, with a zero size when there is none.
+    */
+    if (!d->count)
+        return (rect){{0, 0}, {0, 0}};
+    rect bounds = d->rects[0];
+    for (uint32_t i = 1; i < d->count; i++)
+        bounds = rect_union(bounds, d->rects[i]);
+    return bounds;
+}
+
+void damage_coalesce(damage_list *d, uint32_t command_cost) {
+    /*
+    This function merges pairs of rectangles while their union covers at most command_cost pixels more than
+    the two of them apart, overlap counted twice. command_cost is what one more command costs, in pixels copied.
+    Adjacent strips and overlapping rectangles are always merged, scattered small ones are kept apart.
+    Example usage: damage_coalesce(&pending, 4096); before sending one transfer per rectangle.
+    */
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (uint32_t i = 0; i < d->count && !merged; i++) {
+            for (uint32_t j = i + 1; j < d->count; j++) {
+                rect u = rect_union(d->rects[i], d->rects[j]);
+                if (rect_area(u) > rect_area(d->rects[i]) + rect_area(d->rects[j]) + command_cost)
+                    continue;
+                d->rects[i] = u;
+                d->rects[j] = d->rects[--d->count];
+                merged = true;
+                break;
+            }
+        }
+    }
+}
+
+uint64_t damage_area(const damage_list *d) {
+    /*
+    This function returns the pixels the list covers, counting overlaps once per rectangle.
+    */
+    uint64_t area = 0;
+    for (uint32_t i = 0; i < d->count; i++)
+        area += rect_area(d->rects[i]);
+    return area;
+}
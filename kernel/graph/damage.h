@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+#include "graph/graphic_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DAMAGE_RECTS 8 // Past this many regions, new damage is merged into the one it grows least
+
+typedef struct {
+    /*
+    Regions of a surface changed since it was last presented, clipped to the surface.
+    Drivers add to it as they draw and empty it when they copy or transfer the regions to the screen.
+    */
+    rect rects[DAMAGE_RECTS];
+    uint32_t count;
+} damage_list;
+
+void damage_add(damage_list *d, rect r, size bounds);
+void damage_clear(damage_list *d);
+rect damage_bounds(const damage_list *d);
+void damage_coalesce(damage_list *d, uint32_t command_cost);
+uint64_t damage_area(const damage_list *d);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,18 +1,21 @@
 /*
 kernel/graph/drivers/ramfb_driver/ramfb_driver.c
 This file implements a simple RAM framebuffer driver. It provides functions to initialize
-the framebuffer, clear the screen, draw pixels, rectangles, lines, and characters.
+the framebuffer, describe it as a surface the canvas draws into, and present what was drawn.
 It uses a basic 32-bit XRGB8888 pixel format.
 Ramfb stands for RAM Framebuffer.
+QEMU scans out from memory the kernel maps non-cacheable, which is slow to read and shows frames half drawn.
+Drawing goes to a cacheable back buffer instead, recording the regions it touches, and rfb_flush copies only
+those regions to the scanout buffer with NEON block copies.
 */
 #include "console/kio.h"
 #include "ram_e.h"
 #include "kstring.h"
 #include "fw/fw_cfg.h"
 #include "ramfb_driver.h"
-#include "graph/font8x8_basic.h"
-
-#define RGB_FORMAT_XRGB8888 ((uint32_t)('X') | ((uint32_t)('R') << 8) | ((uint32_t)('2') << 16) | ((uint32_t)('4') << 24))
+#include "graph/damage.h"
+#include "mmu.h"
+#include "gic.h"
 
 typedef struct {
     /*
@@ -28,87 +31,24 @@ typedef struct {
     uint32_t stride;
 }__attribute__((packed)) fb_structure;
 
-uint64_t fb_ptr;
+uint64_t fb_ptr; // Scanout buffer QEMU displays
+uint64_t back_ptr; // Back buffer everything draws into
+
+static damage_list damage;
 
 uint32_t width;
 uint32_t height;
 uint32_t bpp;
 uint32_t stride;
 
-void rfb_clear(uint32_t color){
-    /*
-    This function clears the entire framebuffer by filling it with a specified color.
-    It calculates the total number of pixels and sets each pixel to the provided color.
-    Example usage: rfb_clear(0x00000000); would clear the screen to black.
-    */
-    volatile uint32_t* fb = (volatile uint32_t*)fb_ptr;
-    uint32_t pixels = width * height;
-    for (uint32_t i = 0; i < pixels; i++) {
-        fb[i] = color;
-    }
-}
-
-void rfb_draw_pixel(uint32_t x, uint32_t y, uint32_t color) {
-    /*
-    This function draws a single pixel at the specified (x, y) coordinates with the given color.
-    It first checks if the coordinates are within the framebuffer bounds before setting the pixel value.
-    Example usage: rfb_draw_pixel(10, 20, 0xFF0000); would draw a red pixel at coordinates (10, 20).
-    */
-    if (x >= width || y >= height) return;
-    volatile uint32_t* fb = (volatile uint32_t*)fb_ptr;
-    fb[y * (stride / 4) + x] = color;
-}
-
-void rfb_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color) {
-    /*
-    This function fills a rectangle defined by the top-left corner (x, y),
-    width (w), and height (h) with the specified color.
-    It iterates over the rectangle area and sets each pixel to the provided color.
-    Example usage: rfb_fill_rect(10, 20, 100, 50, 0x00FF00); would fill a green rectangle at (10,20) with width 100 and height 50.
-    */
-    for (uint32_t dy = 0; dy < h; dy++) {
-        for (uint32_t dx = 0; dx < w; dx++) {
-            rfb_draw_pixel(x + dx, y + dy, color);
-        }
-    }
-}
-
-void rfb_draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t color) {
+void rfb_damage(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
     /*
-    This function draws a line from point (x0, y0) to point (x1, y1) using Bresenham's line algorithm.
-    It calculates the necessary steps to interpolate between the two points and sets the pixels along the line to the specified color.
-    Example usage: rfb_draw_line(10, 20, 100, 200, 0x0000FF); would draw a blue line from (10,20) to (100,200).
+    This function records a region of the back buffer that was drawn into, for the next rfb_flush.
+    Drawing runs both in processes and in the console output path, so the list is updated with interrupts masked.
     */
-    int dx = (x1 > x0) ? (x1 - x0) : (x0 - x1);
-    int sx = (x0 < x1) ? 1 : -1;
-    int dy = (y1 > y0) ? (y1 - y0) : (y0 - y1);
-    int sy = (y0 < y1) ? 1 : -1;
-    int err = (dx > dy ? dx : -dy) / 2, e2;
-
-    for (;;) {
-        rfb_draw_pixel(x0, y0, color);
-        if (x0 == x1 && y0 == y1) break;
-        e2 = err;
-        if (e2 > -dx) { err -= dy; x0 += sx; }
-        if (e2 < dy) { err += dx; y0 += sy; }
-    }
-}
-
-void rfb_draw_char(uint32_t x, uint32_t y, char c, uint32_t scale, uint32_t color) {
-    /*
-    This function draws a character at the specified (x, y) coordinates using an 8x8 pixel font.
-    It retrieves the glyph for the character from a predefined font array and sets the corresponding pixels to the specified color.
-    Example usage: rfb_draw_char(10, 20, 'A', 0xFFFFFF); would draw the character 'A' in white at coordinates (10, 20).
-    */
-    const uint8_t* glyph = font8x8_basic[(uint8_t)c];
-    for (uint32_t row = 0; row < (8 * scale); row++) {
-        uint8_t bits = glyph[row / scale];
-        for (uint32_t col = 0; col < (8 * scale); col++) {
-            if (bits & (1 << (7 - (col / scale)))) {
-                rfb_draw_pixel(x + col, y + row, color);
-            }
-        }
-    }
+    uint64_t flags = irq_save();
+    damage_add(&damage, (rect){{x, y}, {w, h}}, (size){width, height});
+    irq_restore(flags);
 }
 
 bool rfb_init(uint32_t w, uint32_t h) {
@@ -135,12 +75,14 @@ bool rfb_init(uint32_t w, uint32_t h) {
     }
 
     fb_ptr = palloc(width * height * bpp);
+    back_ptr = palloc(width * height * bpp);
+    register_cached_memory(back_ptr, width * height * bpp);
 
     fb_structure fb = {
         .addr = __builtin_bswap64(fb_ptr),
         .width = __builtin_bswap32(width),
         .height = __builtin_bswap32(height),
-        .fourcc = __builtin_bswap32(RGB_FORMAT_XRGB8888),
+        .fourcc = __builtin_bswap32(PIXEL_FORMAT_XRGB8888),
         .flags = __builtin_bswap32(0),
         .stride = __builtin_bswap32(stride),
     };
@@ -152,27 +94,47 @@ bool rfb_init(uint32_t w, uint32_t h) {
     return true;
 }
 
-uint32_t rfb_get_char_size(uint32_t scale) {
-    return 8 * scale;
+surface rfb_get_surface() {
+    /*
+    This function describes the back buffer. What is drawn into it directly shows up after rfb_flush_rect.
+    Example usage: surface s = rfb_get_surface(); would get the address and layout of the framebuffer.
+    */
+    return (surface){
+        .base = back_ptr,
+        .width = width,
+        .height = height,
+        .stride = stride,
+        .format = PIXEL_FORMAT_XRGB8888,
+    };
 }
 
-void rfb_draw_string(kstring s, uint32_t x0, uint32_t y0, uint32_t scale, uint32_t color) {
-    int char_size = rfb_get_char_size(scale);
-    int str_length = s.length;
-
-    uint32_t xoff = 0;
-    for (int i = 0; i < str_length; i++) {
-        char c = s.data[i];
-        if (c == '\n') {
-            y0 += char_size + 2;
-            xoff = 0;
-        } else {
-            rfb_draw_char(x0 + (xoff * char_size), y0, c, scale, color);
-            xoff++;
+void rfb_flush(){
+    /*
+    This function copies the damaged regions of the back buffer to the scanout buffer.
+    The list is taken with interrupts masked and the copy runs without, so drawing can go on meanwhile;
+    what it draws is damage for the next flush.
+    Example usage: rfb_flush(); after drawing a frame.
+    */
+    uint64_t flags = irq_save();
+    damage_list pending = damage;
+    damage_clear(&damage);
+    irq_restore(flags);
+
+    for (uint32_t i = 0; i < pending.count; i++) {
+        rect r = pending.rects[i];
+        uint64_t offset = (uint64_t)r.point.y * stride + r.point.x * 4;
+        for (uint32_t y = 0; y < r.size.height; y++) {
+            memcpy_simd((void*)(fb_ptr + offset), (void*)(back_ptr + offset), r.size.width * 4);
+            offset += stride;
         }
     }
 }
 
-void rfb_flush(){
-    
+void rfb_flush_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h){
+    /*
+    This function puts a region written straight into the back buffer on screen, along with any damage pending.
+    Example usage: rfb_flush_rect(0, 0, 100, 16); after drawing into the surface from rfb_get_surface.
+    */
+    rfb_damage(x, y, w, h);
+    rfb_flush();
 }
\ No newline at end of file
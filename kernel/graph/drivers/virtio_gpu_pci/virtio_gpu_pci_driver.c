@@ -3,10 +3,22 @@ kernel/graph/drivers/virtio_gpu_pci/virtio_gpu_pci_driver.c
 This file implements a VirtIO GPU PCI driver. It initializes the VirtIO GPU device,
 sets up the necessary data structures, and provides functions to interact with the GPU,
 including retrieving display information, creating resources, and setting up scanouts.
+The canvas draws into the framebuffer and records damage, and vgp_flush transfers and flushes only the damaged regions, merged where one command
+over their union is cheaper than one per region, so a frame costs what changed rather than the screen size.
+The control queue is asynchronous: commands come from a pool of buffers, take descriptors from a free list,
+go out in batches with one notification, and are reaped from the queue interrupt. Fenced commands let callers
+wait for, or be called back on, the completion of a frame.
 */
 #include "console/kio.h"
 #include "ram_e.h"
 #include "pci.h"
+#include "gic.h"
+#include "trace.h"
+#include "boot_timeline.h"
+#include "hrtimer.h"
+#include "metrics.h"
+#include "graph/damage.h"
+#include "virtio_gpu_pci_driver.h"
 
 ///
 
@@ -24,6 +36,11 @@ including retrieving display information, creating resources, and setting up sca
 #define VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D     0x0104
 #define VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING 0x0106
 
+#define VIRTIO_GPU_RESP_OK_NODATA              0x1100
+#define VIRTIO_GPU_RESP_ERR_UNSPEC             0x1200 // Error responses start here
+
+#define VIRTIO_GPU_FLAG_FENCE 1
+
 #define VIRTIO_PCI_CAP_COMMON_CFG        1
 #define VIRTIO_PCI_CAP_NOTIFY_CFG        2
 #define VIRTIO_PCI_CAP_ISR_CFG           3
@@ -163,14 +180,52 @@ struct virtq_used {
 } __attribute__((packed));
 
 #define VIRTQ_DESC_F_NEXT 1
+#define VIRTQ_USED_F_NO_NOTIFY 1
 
 static uint64_t VIRTQUEUE_BASE;
 static uint64_t VIRTQUEUE_AVAIL;
 static uint64_t VIRTQUEUE_USED;
 
-static uint64_t VIRTQUEUE_CMD;
-static uint64_t VIRTQUEUE_RESP;
-static uint64_t VIRTQUEUE_DISP_INFO;
+#define VGP_QUEUE_SIZE 64 // Control queue descriptors, two per command
+#define VGP_REQUESTS 32 // Commands in flight at most
+#define VGP_REQUEST_BUFFER 512 // Bytes for a command and as many for its response. The largest, the display info response, is 408
+#define VGP_FENCE_WAITERS 8
+
+typedef struct {
+    /*
+    A command and its response buffer from the pool, from vgp_request_alloc until it completes.
+    Requests sent with vgp_call are released by the caller once it has read the response, the others when reaped.
+    */
+    uint8_t *cmd;
+    uint8_t *resp;
+    uint32_t type;
+    uint64_t fence; // 0 when the command carries no fence
+    uint64_t submitted; // Counter value at submission, for the latency histogram
+    uint16_t head; // First descriptor of the chain
+    bool sync;
+    volatile bool done;
+} vgp_request;
+
+typedef struct {
+    uint64_t fence;
+    void (*callback)(uint64_t fence, void *ctx); // 0 for a free slot
+    void *ctx;
+} fence_waiter;
+
+static vgp_request requests[VGP_REQUESTS];
+static vgp_request *free_requests[VGP_REQUESTS];
+static uint32_t free_request_count;
+static vgp_request *desc_request[VGP_QUEUE_SIZE]; // Request whose chain starts at each descriptor
+static uint16_t queue_size;
+static uint16_t free_desc_head; // Free descriptors are chained through their next field
+static uint16_t free_desc_count;
+static uint16_t avail_idx; // Next avail ring index, published to the device by vgp_kick
+static uint16_t used_seen; // Used ring entries already reaped
+static uint64_t next_fence;
+static volatile uint64_t signaled_fence;
+static fence_waiter fence_waiters[VGP_FENCE_WAITERS];
+
+static void vgp_reap();
 
 /// Capabilities & GPU init
 
@@ -190,39 +245,63 @@ static uint32_t default_width;
 static uint32_t default_height;
 #define FRAMEBUFFER_BPP 32
 
-uint64_t vgp_setup_bars(uint64_t base, uint8_t bar) {
-    /*
-    This function sets up the Base Address Register (BAR) for the VirtIO GPU device.
-    It probes the BAR size, allocates a configuration base address, and enables memory access.
-    It returns the final BAR address for the device.
-    Example usage: uint64_t bar_addr = vgp_setup_bars(device_base, 0);
-    */
-    uint64_t bar_addr = pci_get_bar_address(base, 0x10, bar);
-    kprintf("Setting up GPU BAR@%h FROM BAR %i", bar_addr, bar);
+#define VGP_COMMAND_COST 4096 // Pixels a transfer copies in about the time one more command round trip takes
 
-    write32(bar_addr, 0xFFFFFFFF);
-    uint64_t bar_val = read32(bar_addr);
+static damage_list damage;
 
-    if (bar_val == 0 || bar_val == 0xFFFFFFFF) {
-        kprintf("BAR size probing failed");
-        return 0;
-    }
+static pci_msix gpu_msix;
+static bool msix_active = false;
+static volatile uint32_t queue_in_flight = 0; // Control queue buffers the device has not returned yet
 
-    uint64_t size = ((uint64_t)(~(bar_val & ~0xF)) + 1);
-    kprintf("Calculated BAR size: %h", size);
+static uint64_t read_in_flight(void *ctx) {
+    return queue_in_flight;
+}
 
-    uint64_t config_base = 0x10010000;
-    write32(bar_addr, config_base & 0xFFFFFFFF);
+static histogram command_latency;
+static metric commands_metric = METRIC_COUNTER_INIT("virtq.gpu.commands", "commands");
+static metric in_flight_metric = METRIC_GAUGE_INIT("virtq.gpu.in_flight", "buffers", read_in_flight, 0);
+static metric latency_metric = METRIC_HISTOGRAM_INIT("virtq.gpu.latency", "us", &command_latency); // Submit to completion
+static metric notifies_metric = METRIC_COUNTER_INIT("virtq.gpu.notifies", "notifications");
+static metric transferred_metric = METRIC_COUNTER_INIT("gpu.transferred", "pixels");
+static metric transfers_metric = METRIC_COUNTER_INIT("gpu.transfers", "commands");
+static metric flushes_metric = METRIC_COUNTER_INIT("gpu.flushes", "commands");
 
-    bar_val = read32(bar_addr);
+#define VIRTIO_MSI_CONFIG_VECTOR 0
+#define VIRTIO_MSI_QUEUE_VECTOR 1
+#define VIRTIO_MSI_NO_VECTOR 0xFFFF
 
-    kprintf("FINAL BAR value: %h", bar_val);
+irq_result vgp_config_irq(uint32_t irq, void *ctx) {
+    /*
+    This function handles the configuration change interrupt, raised when the display setup changes on the host.
+    */
+    kprintf("GPU configuration changed");
+    return IRQ_HANDLED;
+}
 
-    uint32_t cmd = read32(base + 0x4);
-    cmd |= 0x2;
-    write32(base + 0x4, cmd);
+irq_result vgp_queue_irq(uint32_t irq, void *ctx) {
+    /*
+    This function handles the control queue interrupt. The device raises it after placing buffers in the used ring,
+    which are reaped here, signaling fences and waking up callers waiting on the queue.
+    MSI-X messages are edge triggered and need no acknowledgement in the ISR register.
+    */
+    vgp_reap();
+    return IRQ_HANDLED;
+}
 
-    return (bar_val & ~0xF);
+bool vgp_setup_msix(uint64_t address) {
+    /*
+    This function enables MSI-X on the device and routes the configuration and control queue vectors to the GIC.
+    If it fails the driver keeps polling the used ring.
+    */
+    if (!pci_msix_init(address, &gpu_msix)) {
+        kprintf("MSI-X not available, GPU commands will be polled");
+        return false;
+    }
+    if (!pci_msix_route(&gpu_msix, VIRTIO_MSI_CONFIG_VECTOR, vgp_config_irq, 0))
+        return false;
+    if (!pci_msix_route(&gpu_msix, VIRTIO_MSI_QUEUE_VECTOR, vgp_queue_irq, 0))
+        return false;
+    return true;
 }
 
 void vgp_start() {
@@ -262,18 +341,40 @@ void vgp_start() {
     }
 
     common_cfg->queue_select = 0;
-    uint32_t queue_size = common_cfg->queue_size;
+    queue_size = common_cfg->queue_size;
 
     kprintf("Queue size: %h", queue_size);
 
+    if (queue_size > VGP_QUEUE_SIZE)
+        queue_size = VGP_QUEUE_SIZE;
     common_cfg->queue_size = queue_size;
 
+    if (msix_active) {
+        common_cfg->msix_config = VIRTIO_MSI_CONFIG_VECTOR;
+        common_cfg->queue_msix_vector = VIRTIO_MSI_QUEUE_VECTOR;
+        if (common_cfg->msix_config == VIRTIO_MSI_NO_VECTOR || common_cfg->queue_msix_vector == VIRTIO_MSI_NO_VECTOR) {
+            kprintf("Device rejected MSI-X vectors, falling back to polling");
+            msix_active = false;
+        }
+    }
+
     VIRTQUEUE_BASE = palloc(4096);
     VIRTQUEUE_AVAIL = palloc(4096);
     VIRTQUEUE_USED = palloc(4096);
-    VIRTQUEUE_CMD = palloc(4096);
-    VIRTQUEUE_RESP = palloc(4096);
-    VIRTQUEUE_DISP_INFO = palloc(sizeof(struct virtio_gpu_resp_display_info));
+
+    volatile struct virtq_desc* desc = (volatile struct virtq_desc*)(uintptr_t)VIRTQUEUE_BASE;
+    for (uint16_t i = 0; i < queue_size; i++)
+        desc[i].next = i + 1;
+    free_desc_head = 0;
+    free_desc_count = queue_size;
+
+    uint8_t *buffers = (uint8_t*)palloc(VGP_REQUESTS * 2 * VGP_REQUEST_BUFFER);
+    for (uint32_t i = 0; i < VGP_REQUESTS; i++) {
+        requests[i].cmd = buffers + i * 2 * VGP_REQUEST_BUFFER;
+        requests[i].resp = requests[i].cmd + VGP_REQUEST_BUFFER;
+        free_requests[i] = &requests[i];
+    }
+    free_request_count = VGP_REQUESTS;
 
     common_cfg->queue_desc = VIRTQUEUE_BASE;
     common_cfg->queue_driver = VIRTQUEUE_AVAIL;
@@ -305,7 +406,7 @@ volatile struct virtio_pci_cap* vgp_get_capabilities(uint64_t address) {
 
         if (cap->cap_vndr == 0x9) {
             if (cap->cfg_type < VIRTIO_PCI_CAP_PCI_CFG && val == 0) {
-                val = vgp_setup_bars(address, cap->bar);
+                val = pci_setup_bar(address, cap->bar);
             }
 
             if (cap->cfg_type == VIRTIO_PCI_CAP_COMMON_CFG) {
@@ -330,40 +431,274 @@ volatile struct virtio_pci_cap* vgp_get_capabilities(uint64_t address) {
     return 0;
 }
 
-// Screen render functions
+// Control queue
+
+static void vgp_request_release(vgp_request *req) {
+    uint64_t daif = irq_save();
+    free_requests[free_request_count++] = req;
+    irq_restore(daif);
+}
+
+static void vgp_reap() {
+    /*
+    This function takes back the buffers the device has used. It records their latency, signals their fences,
+    returns their descriptors to the free list, and releases the requests no caller waits on, logging failed responses.
+    It runs with interrupts masked, from the queue interrupt or from a caller waiting on the queue.
+    */
+    volatile struct virtq_desc* desc = (volatile struct virtq_desc*)(uintptr_t)VIRTQUEUE_BASE;
+    volatile struct virtq_used* used = (volatile struct virtq_used*)(uintptr_t)VIRTQUEUE_USED;
+
+    while (used_seen != used->idx) {
+        asm volatile ("dmb ishld" ::: "memory"); // The response must not be read before the completion
+        uint16_t head = used->ring[used_seen % queue_size].id;
+        used_seen++;
+        vgp_request *req = desc_request[head];
+
+        uint16_t last = head, count = 1;
+        while (desc[last].flags & VIRTQ_DESC_F_NEXT) {
+            last = desc[last].next;
+            count++;
+        }
+        desc[last].next = free_desc_head;
+        free_desc_head = head;
+        free_desc_count += count;
+
+        queue_in_flight--;
+        histogram_observe(&command_latency, ticks_to_ns(timer_counter() - req->submitted) / NSEC_PER_USEC);
+        trace(TRACE_VQ_COMPLETE, req->type, used_seen);
+
+        if (req->fence > signaled_fence)
+            signaled_fence = req->fence; // The control queue is processed in order, so this covers every earlier fence
+        if (req->sync) {
+            req->done = true;
+        } else {
+            uint32_t resp_type = ((struct virtio_gpu_ctrl_hdr*)req->resp)->type;
+            if (resp_type >= VIRTIO_GPU_RESP_ERR_UNSPEC)
+                klog_error(KLOG_SYS_GPU, "GPU command %h failed: %h", req->type, resp_type);
+            vgp_request_release(req);
+        }
+    }
+
+    for (uint32_t i = 0; i < VGP_FENCE_WAITERS; i++) {
+        fence_waiter *w = &fence_waiters[i];
+        if (w->callback && w->fence <= signaled_fence) {
+            void (*callback)(uint64_t fence, void *ctx) = w->callback;
+            w->callback = 0;
+            callback(w->fence, w->ctx);
+        }
+    }
+}
+
+static void vgp_wait_for(bool (*ready)(void *ctx), void *ctx) {
+    /*
+    Waits until a completion makes ready true. A pending interrupt wakes wfi even while masked,
+    so checking with interrupts off cannot miss the completion. Without MSI-X the used ring is polled,
+    and so it is when the caller already had interrupts masked: inside an IRQ handler, such as a panic,
+    the GIC holds the queue interrupt back behind the running priority and wfi would never return.
+    */
+    uint64_t daif = irq_save();
+    bool can_sleep = msix_active && !(daif & (1 << 7)); // DAIF.I clear
+    while (1) {
+        vgp_reap();
+        if (ready(ctx))
+            break;
+        if (can_sleep) {
+            asm volatile ("wfi" ::: "memory");
+            irq_restore(daif);
+            daif = irq_save();
+        }
+    }
+    irq_restore(daif);
+}
+
+static bool request_available(void *ctx) {
+    return free_request_count > 0;
+}
 
-void vgp_send_command(uint64_t cmd_addr, uint32_t cmd_size, uint64_t resp_addr, uint32_t resp_size, uint64_t notify_base, uint32_t notify_multiplier, uint8_t flags) {
+static bool descriptors_available(void *ctx) {
+    return free_desc_count >= 2;
+}
+
+static bool request_done(void *ctx) {
+    return ((vgp_request*)ctx)->done;
+}
+
+static bool fence_reached(void *ctx) {
+    return *(uint64_t*)ctx <= signaled_fence;
+}
+
+void vgp_kick() {
     /*
-    This function sends a command to the VirtIO GPU device using the VirtIO queue.
-    It sets up the descriptor table, available ring, and notifies the device of the new command.
-    It then waits for the device to process the command and provide a response.
-    Example usage: vgp_send_command(cmd_addr, cmd_size, resp_addr, resp_size, notify_base, notify_multiplier, flags);
+    This function publishes the commands queued since the last kick and notifies the device once for all of them.
+    The notification is skipped while the device says it is still working through the ring.
+    Example usage: queue a few commands with vgp_submit, then vgp_kick();
     */
+    volatile struct virtq_avail* avail = (volatile struct virtq_avail*)(uintptr_t)VIRTQUEUE_AVAIL;
+    volatile struct virtq_used* used = (volatile struct virtq_used*)(uintptr_t)VIRTQUEUE_USED;
+
+    uint64_t daif = irq_save();
+    if (avail->idx != avail_idx) {
+        asm volatile ("dmb ishst" ::: "memory"); // The commands must be in memory before the index publishes them
+        avail->idx = avail_idx;
+        asm volatile ("dmb ish" ::: "memory"); // The index must be visible before reading whether to notify
+        if (!(used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+            *(volatile uint16_t*)(uintptr_t)((uint64_t)notify_cfg + notify_off_multiplier * 0) = 0;
+            metric_add(&notifies_metric, 1);
+        }
+    }
+    irq_restore(daif);
+}
+
+vgp_request* vgp_request_alloc(uint32_t type) {
+    /*
+    This function takes a request from the pool, with its command buffer cleared and the command type set.
+    When every request is in flight it kicks what is queued and waits for one to complete.
+    Example usage: vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_RESOURCE_FLUSH);
+    */
+    uint64_t daif = irq_save();
+    while (!free_request_count) {
+        irq_restore(daif);
+        vgp_kick();
+        vgp_wait_for(request_available, 0);
+        daif = irq_save();
+    }
+    vgp_request *req = free_requests[--free_request_count];
+    irq_restore(daif);
+
+    memset(req->cmd, 0, VGP_REQUEST_BUFFER);
+    memset(req->resp, 0, VGP_REQUEST_BUFFER);
+    ((struct virtio_gpu_ctrl_hdr*)req->cmd)->type = type;
+    req->type = type;
+    req->fence = 0;
+    req->sync = false;
+    req->done = false;
+    return req;
+}
+
+uint64_t vgp_submit(vgp_request *req, uint32_t cmd_size, uint32_t resp_size, bool fence) {
+    /*
+    This function queues a request as a two descriptor chain without notifying the device, so several commands
+    go out with a single vgp_kick. With fence set the command carries VIRTIO_GPU_FLAG_FENCE and a new fence id,
+    which it returns; the fence is signaled once the host has completed the command. It returns 0 otherwise.
+    Example usage: uint64_t fence = vgp_submit(req, sizeof(*cmd), sizeof(struct virtio_gpu_ctrl_hdr), true);
+    */
+    volatile struct virtq_desc* desc = (volatile struct virtq_desc*)(uintptr_t)VIRTQUEUE_BASE;
+    volatile struct virtq_avail* avail = (volatile struct virtq_avail*)(uintptr_t)VIRTQUEUE_AVAIL;
+    struct virtio_gpu_ctrl_hdr *hdr = (struct virtio_gpu_ctrl_hdr*)req->cmd;
+
+    uint64_t daif = irq_save();
+    while (free_desc_count < 2) {
+        irq_restore(daif);
+        vgp_kick();
+        vgp_wait_for(descriptors_available, 0);
+        daif = irq_save();
+    }
 
-    volatile struct virtq_desc* desc = (volatile struct virtq_desc*)(uintptr_t)(common_cfg->queue_desc);
-    volatile struct virtq_avail* avail = (volatile struct virtq_avail*)(uintptr_t)(common_cfg->queue_driver);
-    volatile struct virtq_used* used = (volatile struct virtq_used*)(uintptr_t)(common_cfg->queue_device);
+    if (fence) {
+        req->fence = ++next_fence; // Taken with interrupts masked, so fence ids follow the ring order
+        hdr->flags |= VIRTIO_GPU_FLAG_FENCE;
+        hdr->fence_id = req->fence;
+    }
 
-    desc[0].addr = cmd_addr;
-    desc[0].len = cmd_size;
-    desc[0].flags = flags;
-    desc[0].next = 1;
+    uint16_t head = free_desc_head;
+    uint16_t tail = desc[head].next;
+    free_desc_head = desc[tail].next;
+    free_desc_count -= 2;
+
+    desc[head].addr = (uint64_t)req->cmd;
+    desc[head].len = cmd_size;
+    desc[head].flags = VIRTQ_DESC_F_NEXT;
+    desc[head].next = tail;
+
+    desc[tail].addr = (uint64_t)req->resp;
+    desc[tail].len = resp_size;
+    desc[tail].flags = VIRTQ_DESC_F_WRITE;
+
+    desc_request[head] = req;
+    req->head = head;
+    req->submitted = timer_counter();
+    avail->ring[avail_idx % queue_size] = head;
+    avail_idx++;
+    queue_in_flight++;
+    metric_add(&commands_metric, 1);
+    trace(TRACE_VQ_SUBMIT, req->type, avail_idx);
+    irq_restore(daif);
+
+    return req->fence;
+}
 
-    desc[1].addr = resp_addr;
-    desc[1].len = resp_size;
-    desc[1].flags = VIRTQ_DESC_F_WRITE; 
-    desc[1].next = 0;
+uint32_t vgp_call(vgp_request *req, uint32_t cmd_size, uint32_t resp_size) {
+    /*
+    This function sends a request and waits for its response, returning the response type.
+    The response stays in req->resp until the caller releases the request with vgp_request_release.
+    Example usage: if (vgp_call(req, sizeof(*cmd), sizeof(struct virtio_gpu_ctrl_hdr)) == VIRTIO_GPU_RESP_OK_NODATA) { ... }
+    */
+    req->sync = true;
+    vgp_submit(req, cmd_size, resp_size, false);
+    vgp_kick();
+    vgp_wait_for(request_done, req);
+    return ((struct virtio_gpu_ctrl_hdr*)req->resp)->type;
+}
 
-    avail->ring[avail->idx % 128] = 0;
-    avail->idx++;
+bool vgp_fence_signaled(uint64_t fence) {
+    /*
+    This function tells whether the host has completed the command a fence was taken for, and all before it.
+    Example usage: if (vgp_fence_signaled(frame_fence)) { ... }
+    */
+    return fence <= signaled_fence;
+}
 
-    *(volatile uint16_t*)(uintptr_t)(notify_base + notify_multiplier * 0) = 0;
+void vgp_fence_wait(uint64_t fence) {
+    /*
+    This function waits for a fence, sleeping on the queue interrupt when there is one.
+    Example usage: vgp_fence_wait(vgp_flush()); would return once the frame is on the host.
+    */
+    if (vgp_fence_signaled(fence)) return;
+    vgp_kick();
+    vgp_wait_for(fence_reached, &fence);
+}
 
-    uint16_t last_used_idx = used->idx;
-    while (last_used_idx == used->idx);
-    last_used_idx = used->idx;
+bool vgp_fence_poll(uint64_t fence) {
+    /*
+    This function checks the used ring once and tells whether the fence is signaled, without sleeping.
+    It is for callers that cannot count on an interrupt to wake them, such as panic() inside an IRQ handler.
+    Example usage: while (!vgp_fence_poll(fence)); would spin until the frame is on the host.
+    */
+    if (vgp_fence_signaled(fence)) return true;
+    vgp_kick();
+    uint64_t daif = irq_save();
+    vgp_reap();
+    irq_restore(daif);
+    return vgp_fence_signaled(fence);
+}
+
+void vgp_fence_notify(uint64_t fence, void (*callback)(uint64_t fence, void *ctx), void *ctx) {
+    /*
+    This function calls callback once the fence is signaled: right away if it already is, or later
+    from the completion path with interrupts masked, so the callback must be short.
+    If every waiter slot is taken it waits for the fence instead.
+    Example usage: vgp_fence_notify(vgp_flush(), frame_done, proc);
+    */
+    uint64_t daif = irq_save();
+    if (!vgp_fence_signaled(fence)) {
+        for (uint32_t i = 0; i < VGP_FENCE_WAITERS; i++) {
+            if (!fence_waiters[i].callback) {
+                fence_waiters[i] = (fence_waiter){ fence, callback, ctx };
+                irq_restore(daif);
+                vgp_kick();
+                return;
+            }
+        }
+        irq_restore(daif);
+        vgp_fence_wait(fence);
+        daif = irq_save();
+    }
+    irq_restore(daif);
+    callback(fence, ctx);
 }
 
+// Screen render functions
+
 bool vgp_get_display_info(){
     /*
     This function retrieves the display information from the VirtIO GPU device.
@@ -371,25 +706,18 @@ bool vgp_get_display_info(){
     If a valid display is found, it updates the display width and height accordingly.
     Example usage: bool success = vgp_get_display_info(); would return true if a valid display is found.
     */
-    volatile struct virtio_gpu_ctrl_hdr* cmd = (volatile struct virtio_gpu_ctrl_hdr*)(uintptr_t)(VIRTQUEUE_CMD);
-    cmd->type = VIRTIO_GPU_CMD_GET_DISPLAY_INFO;
-    cmd->flags = 0;
-    cmd->fence_id = 0;
-    cmd->ctx_id = 0;
-    cmd->ring_idx = 0;
-    cmd->padding[0] = 0;
-    cmd->padding[1] = 0;
-    cmd->padding[2] = 0;
+    vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_GET_DISPLAY_INFO);
 
-    kprintf("Command prepared");
+    klog_debug(KLOG_SYS_GPU, "Command prepared");
 
-    vgp_send_command((uint64_t)cmd, sizeof(struct virtio_gpu_ctrl_hdr), VIRTQUEUE_DISP_INFO, sizeof(struct virtio_gpu_resp_display_info), (uint64_t)notify_cfg, notify_off_multiplier, 0);
+    vgp_call(req, sizeof(struct virtio_gpu_ctrl_hdr), sizeof(struct virtio_gpu_resp_display_info));
 
-    volatile struct virtio_gpu_resp_display_info* resp = (volatile struct virtio_gpu_resp_display_info*)(uintptr_t)(VIRTQUEUE_DISP_INFO);
+    struct virtio_gpu_resp_display_info* resp = (struct virtio_gpu_resp_display_info*)req->resp;
 
+    scanout_found = false;
     for (uint32_t i = 0; i < VIRTIO_GPU_MAX_SCANOUTS; i++){
         
-        kprintf("Scanout %i: enabled=%i size=%ix%i",i,resp->pmodes[i].enabled, resp->pmodes[i].width, resp->pmodes[i].height);
+        klog_debug(KLOG_SYS_GPU, "Scanout %i: enabled=%i size=%ix%i",i,resp->pmodes[i].enabled, resp->pmodes[i].width, resp->pmodes[i].height);
 
         if (resp->pmodes[i].enabled) {
             kprintf("Found a valid display: %ix%i",resp->pmodes[i].width,resp->pmodes[i].height);
@@ -397,15 +725,25 @@ bool vgp_get_display_info(){
             display_height = resp->pmodes[i].height;
             scanout_id = i;
             scanout_found = true;
-            return true;
+            break;
         }
     }
 
-    kprintf("Display not enabled yet. Using default but not allowing scanout");
-    resp->pmodes[0].width = default_width;
-    resp->pmodes[0].height = default_height;
-    scanout_found = false;
-    return false;
+    if (!scanout_found)
+        kprintf("Display not enabled yet. Using default but not allowing scanout");
+    vgp_request_release(req);
+    return scanout_found;
+}
+
+static void vgp_check_response(vgp_request *req, uint32_t resp_type, const char *name) {
+    klog_debug(KLOG_SYS_GPU, "Response type: %h flags: %h", resp_type, ((struct virtio_gpu_ctrl_hdr*)req->resp)->flags);
+
+    if (resp_type == VIRTIO_GPU_RESP_OK_NODATA) {
+        klog_debug(KLOG_SYS_GPU, "%s OK", (uint64_t)name);
+    } else {
+        klog_error(KLOG_SYS_GPU, "%s ERROR: %h", (uint64_t)name, resp_type);
+    }
+    vgp_request_release(req);
 }
 
 void vgp_create_2d_resource() {
@@ -415,40 +753,22 @@ void vgp_create_2d_resource() {
     It processes the response to confirm whether the resource creation was successful.
     Example usage: vgp_create_2d_resource() would create a 2D resource for the current display dimensions.
     */
-    volatile struct {
+    vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_RESOURCE_CREATE_2D);
+    struct {
         struct virtio_gpu_ctrl_hdr hdr;
         uint32_t resource_id;
         uint32_t format;
         uint32_t width;
         uint32_t height;
-    } *cmd = (volatile void*)(uintptr_t)(VIRTQUEUE_CMD);
+    } *cmd = (void*)req->cmd;
     
-    cmd->hdr.type = VIRTIO_GPU_CMD_RESOURCE_CREATE_2D;
-    cmd->hdr.flags = 0;
-    cmd->hdr.fence_id = 0;
-    cmd->hdr.ctx_id = 0;
-    cmd->hdr.ring_idx = 0;
-    cmd->hdr.padding[0] = 0;
-    cmd->hdr.padding[1] = 0;
-    cmd->hdr.padding[2] = 0;
     cmd->resource_id = GPU_RESOURCE_ID;
     cmd->format = 1; // VIRTIO_GPU_FORMAT_B8G8R8A8_UNORM
     cmd->width = display_width;
     cmd->height = display_height;
     
-    vgp_send_command((uint64_t)cmd, sizeof(*cmd), VIRTQUEUE_RESP, sizeof(struct virtio_gpu_ctrl_hdr), (uint64_t)notify_cfg, notify_off_multiplier, VIRTQ_DESC_F_NEXT);
-
-    asm volatile("" ::: "memory");
-
-    volatile struct virtio_gpu_ctrl_hdr* resp = (volatile void*)(uintptr_t)(VIRTQUEUE_RESP);
-
-    kprintf("Response type: %h flags: %h", resp->type, resp->flags);
-    
-    if (resp->type == 0x1100) {
-        kprintf("RESOURCE_CREATE_2D OK");
-    } else {
-        kprintf("RESOURCE_CREATE_2D ERROR: %h", resp->type);
-    }
+    uint32_t resp_type = vgp_call(req, sizeof(*cmd), sizeof(struct virtio_gpu_ctrl_hdr));
+    vgp_check_response(req, resp_type, "RESOURCE_CREATE_2D");
 }
 
 void vgp_attach_backing() {
@@ -458,28 +778,20 @@ void vgp_attach_backing() {
     to confirm whether the operation was successful.
     Example usage: vgp_attach_backing() would attach the framebuffer memory to the GPU resource.
     */
-    volatile uint8_t* ptr = (volatile uint8_t*)(uintptr_t)VIRTQUEUE_CMD;
+    vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING);
 
-    volatile struct {
+    struct {
         struct virtio_gpu_ctrl_hdr hdr;
         uint32_t resource_id;
         uint32_t nr_entries;
-    }__attribute__((packed)) *cmd = (volatile void*)ptr;
+    }__attribute__((packed)) *cmd = (void*)req->cmd;
 
-    volatile struct {
+    struct {
         uint64_t addr;
         uint32_t length;
         uint32_t padding;
-    }__attribute__((packed)) *entry = (volatile void*)(ptr + sizeof(*cmd));
-
-    cmd->hdr.type = VIRTIO_GPU_CMD_RESOURCE_ATTACH_BACKING;
-    cmd->hdr.flags = 0;
-    cmd->hdr.fence_id = 0;
-    cmd->hdr.ctx_id = 0;
-    cmd->hdr.ring_idx = 0;
-    cmd->hdr.padding[0] = 0;
-    cmd->hdr.padding[1] = 0;
-    cmd->hdr.padding[2] = 0;
+    }__attribute__((packed)) *entry = (void*)(req->cmd + sizeof(*cmd));
+
     cmd->resource_id = GPU_RESOURCE_ID;
     cmd->nr_entries = 1;
 
@@ -489,19 +801,8 @@ void vgp_attach_backing() {
     entry->length = framebuffer_size;
     entry->padding = 0;
 
-    vgp_send_command((uint64_t)cmd, sizeof(*cmd) + sizeof(*entry), VIRTQUEUE_RESP, sizeof(struct virtio_gpu_ctrl_hdr), (uint64_t)notify_cfg, notify_off_multiplier, VIRTQ_DESC_F_NEXT);
-
-    asm volatile("" ::: "memory");
-
-    volatile struct virtio_gpu_ctrl_hdr* resp = (volatile void*)(uintptr_t)(VIRTQUEUE_RESP);
-
-    kprintf("Response type: %h flags: %h", resp->type, resp->flags);
-
-    if (resp->type == 0x1100) {
-        kprintf("RESOURCE_ATTACH_BACKING OK");
-    } else {
-        kprintf("RESOURCE_ATTACH_BACKING ERROR: %h", resp->type);
-    }
+    uint32_t resp_type = vgp_call(req, sizeof(*cmd) + sizeof(*entry), sizeof(struct virtio_gpu_ctrl_hdr));
+    vgp_check_response(req, resp_type, "RESOURCE_ATTACH_BACKING");
 }
 
 void vgp_set_scanout() {
@@ -511,14 +812,14 @@ void vgp_set_scanout() {
     It processes the response to confirm whether the operation was successful.
     Example usage: vgp_set_scanout() would set the scanout for the current display dimensions.
     */
-    volatile struct {
+    vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_SET_SCANOUT);
+    struct {
         struct virtio_gpu_ctrl_hdr hdr;
         struct virtio_rect r;
         uint32_t scanout_id;
         uint32_t resource_id;
-    }__attribute__((packed)) *cmd = (volatile void*)(uintptr_t)VIRTQUEUE_CMD;
+    }__attribute__((packed)) *cmd = (void*)req->cmd;
 
-    
     cmd->r.x = 0;
     cmd->r.y = 0;
     cmd->r.width = display_width;
@@ -527,147 +828,131 @@ void vgp_set_scanout() {
     cmd->scanout_id = scanout_id;
     cmd->resource_id = GPU_RESOURCE_ID;
 
-    cmd->hdr.type = VIRTIO_GPU_CMD_SET_SCANOUT;
-    cmd->hdr.flags = 0;
-    cmd->hdr.fence_id = 0;
-    cmd->hdr.ctx_id = 0;
-    cmd->hdr.ring_idx = 0;
-    cmd->hdr.padding[0] = 0;
-    cmd->hdr.padding[1] = 0;
-    cmd->hdr.padding[2] = 0;
-
-
-    vgp_send_command((uint64_t)cmd, sizeof(*cmd), VIRTQUEUE_RESP, sizeof(struct virtio_gpu_ctrl_hdr), (uint64_t)notify_cfg, notify_off_multiplier, VIRTQ_DESC_F_NEXT);
-
-    asm volatile("" ::: "memory");
-
-    volatile struct virtio_gpu_ctrl_hdr* resp = (volatile void*)(uintptr_t)VIRTQUEUE_RESP;
-
-    kprintf("Response type: %h flags: %h", resp->type, resp->flags);
-
-    if (resp->type == 0x1100) {
-        kprintf("SCANOUT OK");
-    } else {
-        kprintf("SCANOUT ERROR: %h", resp->type);
-    }
+    uint32_t resp_type = vgp_call(req, sizeof(*cmd), sizeof(struct virtio_gpu_ctrl_hdr));
+    vgp_check_response(req, resp_type, "SCANOUT");
 }
 
-void vgp_transfer_to_host() {
+void vgp_transfer_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
     /*
-    This function transfers the framebuffer data to the host VirtIO GPU device.
-    It sends a command to transfer the 2D resource to the host and processes the response
-    to confirm whether the operation was successful.
-    Example usage: vgp_transfer_to_host() would transfer the framebuffer data to the GPU.
+    This function queues the transfer of a region of the framebuffer to the host resource.
+    It is sent with the next vgp_kick, and a failure is logged when the response comes back.
+    Example usage: vgp_transfer_rect(0, 0, 100, 16) would transfer the top-left 100x16 pixels to the GPU.
     */
-    volatile struct {
-        uint32_t type;
-        uint32_t flags;
-        uint64_t fence_id;
+    vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D);
+    struct {
+        struct virtio_gpu_ctrl_hdr hdr;
+        struct virtio_rect r;
+        uint64_t offset;
         uint32_t resource_id;
-        uint32_t rsvd;
-        uint32_t x;
-        uint32_t y;
-        uint32_t width;
-        uint32_t height;
-    } *cmd = (volatile void*)(uintptr_t)(VIRTQUEUE_CMD);
-    
-    cmd->type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
-    cmd->flags = 0;
-    cmd->fence_id = 0;
-    cmd->resource_id = GPU_RESOURCE_ID;
-    cmd->rsvd = 0;
-    cmd->x = 0;
-    cmd->y = 0;
-    cmd->width = display_width;
-    cmd->height = display_height;
-    
-    vgp_send_command((uint64_t)cmd, sizeof(*cmd), VIRTQUEUE_RESP, sizeof(struct virtio_gpu_ctrl_hdr), (uint64_t)notify_cfg, notify_off_multiplier, VIRTQ_DESC_F_NEXT);
-
-    asm volatile("" ::: "memory");
+        uint32_t padding;
+    }__attribute__((packed)) *cmd = (void*)req->cmd;
 
-    volatile struct virtio_gpu_ctrl_hdr* resp = (volatile void*)(uintptr_t)(VIRTQUEUE_RESP);
+    cmd->r.x = x;
+    cmd->r.y = y;
+    cmd->r.width = w;
+    cmd->r.height = h;
+    cmd->offset = ((uint64_t)y * display_width + x) * (FRAMEBUFFER_BPP/8); // Offset of the rect inside the backing
+    cmd->resource_id = GPU_RESOURCE_ID;
 
-    kprintf("Response type: %h flags: %h", resp->type, resp->flags);
-    
-    if (resp->type == 0x1100) {
-        kprintf("TRANSFER_TO_HOST OK");
-    } else {
-        kprintf("TRANSFER_TO_HOST ERROR: %h", resp->type);
-    }
+    vgp_submit(req, sizeof(*cmd), sizeof(struct virtio_gpu_ctrl_hdr), false);
 }
 
-void vgp_flush() {
+void vgp_damage(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
     /*
-    This function flushes the 2D resource on the VirtIO GPU device.
-    It sends a command to flush the resource and processes the response to confirm
-    whether the operation was successful.
-    Example usage: vgp_flush() would flush the current 2D resource to ensure it is displayed.
+    This function records a region of the framebuffer that was drawn into, for the next vgp_flush.
+    The list is updated with interrupts masked, as drawing runs both in processes and in the console output path.
     */
+    uint64_t flags = irq_save();
+    damage_add(&damage, (rect){{x, y}, {w, h}}, (size){display_width, display_height});
+    irq_restore(flags);
+}
 
-    vgp_transfer_to_host();
-
-    volatile struct {
-        uint32_t type;
-        uint32_t flags;
-        uint64_t fence_id;
+uint64_t vgp_resource_flush(uint32_t x, uint32_t y, uint32_t w, uint32_t h, bool fence) {
+    /*
+    This function queues putting a region of the resource, already transferred to the host, on the display.
+    It returns the fence of the command when asked for one, 0 otherwise.
+    Example usage: uint64_t fence = vgp_resource_flush(0, 0, 100, 16, true); after transferring that region.
+    */
+    vgp_request *req = vgp_request_alloc(VIRTIO_GPU_CMD_RESOURCE_FLUSH);
+    struct {
+        struct virtio_gpu_ctrl_hdr hdr;
+        struct virtio_rect r;
         uint32_t resource_id;
-        uint32_t rsvd;
-    } *cmd = (volatile void*)(uintptr_t)(VIRTQUEUE_CMD);
+        uint32_t padding;
+    }__attribute__((packed)) *cmd = (void*)req->cmd;
     
-    cmd->type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
-    cmd->flags = 0;
-    cmd->fence_id = 0;
+    cmd->r.x = x;
+    cmd->r.y = y;
+    cmd->r.width = w;
+    cmd->r.height = h;
     cmd->resource_id = GPU_RESOURCE_ID;
-    cmd->rsvd = 0;
     
-    vgp_send_command((uint64_t)cmd, sizeof(*cmd), VIRTQUEUE_RESP, sizeof(struct virtio_gpu_ctrl_hdr), (uint64_t)notify_cfg, notify_off_multiplier, VIRTQ_DESC_F_NEXT);
-
-    asm volatile("" ::: "memory");
-
-    volatile struct virtio_gpu_ctrl_hdr* resp = (volatile void*)(uintptr_t)(VIRTQUEUE_RESP);
-    
-    kprintf("Response type: %h flags: %h", resp->type, resp->flags);
+    return vgp_submit(req, sizeof(*cmd), sizeof(struct virtio_gpu_ctrl_hdr), fence);
+}
 
-    if (resp->type == 0x1100) {
-        kprintf("FLUSH OK");
+uint64_t vgp_flush() {
+    /*
+    This function puts the damage drawn since the last flush on the display.
+    Each damaged region, after coalescing, is one transfer. The flush then covers their bounding box in one command
+    when that box is not much larger than the regions, and goes region by region otherwise.
+    All of them go to the device with one notification, and the function returns without waiting.
+    The returned fence is signaled once the frame is on the host, 0 when there was nothing to flush;
+    waiting on it before drawing again keeps the next frame from being transferred half drawn.
+    Example usage: vgp_fence_wait(vgp_flush()); would flush and wait for the display to be updated.
+    */
+    uint64_t flags = irq_save();
+    damage_list pending = damage;
+    damage_clear(&damage);
+    irq_restore(flags);
+    if (!pending.count) return 0;
+
+    damage_coalesce(&pending, VGP_COMMAND_COST);
+    uint64_t area = damage_area(&pending);
+    for (uint32_t i = 0; i < pending.count; i++) {
+        rect r = pending.rects[i];
+        vgp_transfer_rect(r.point.x, r.point.y, r.size.width, r.size.height);
+    }
+    metric_add(&transfers_metric, pending.count);
+    metric_add(&transferred_metric, area);
+
+    uint64_t fence = 0;
+    rect bounds = damage_bounds(&pending);
+    if ((uint64_t)bounds.size.width * bounds.size.height <= area + (uint64_t)VGP_COMMAND_COST * (pending.count - 1)) {
+        fence = vgp_resource_flush(bounds.point.x, bounds.point.y, bounds.size.width, bounds.size.height, true);
+        metric_add(&flushes_metric, 1);
     } else {
-        kprintf("FLUSH ERROR: %h", resp->type);
+        for (uint32_t i = 0; i < pending.count; i++) {
+            rect r = pending.rects[i];
+            fence = vgp_resource_flush(r.point.x, r.point.y, r.size.width, r.size.height, i == pending.count - 1);
+        }
+        metric_add(&flushes_metric, pending.count);
     }
+    vgp_kick();
+    return fence;
 }
 
-void vgp_clear(uint32_t color) {
+void vgp_flush_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
     /*
-    This function clears the screen by filling the entire framebuffer with a specified color.
-    It iterates through each pixel in the framebuffer and sets its value to the provided color.
-    After clearing the screen, it transfers the updated framebuffer to the host and flushes the changes.
-    Example usage: vgp_clear(0x000000FF) would clear the screen to blue.
+    This function marks a region written straight into the framebuffer as damaged and flushes, along with any damage pending.
+    The rectangle is clipped to the display, so callers can pass damage straight from user space.
+    Example usage: vgp_flush_rect(0, 0, 100, 16) would update only the top-left 100x16 pixels on screen.
     */
-
-    kprintf("Clear screen");
-
-    volatile uint32_t* fb = (volatile uint32_t*)framebuffer_memory;
-    for (uint32_t i = 0; i < display_width * display_height; i++) {
-        fb[i] = color;
-    }
-
-    vgp_transfer_to_host();
+    vgp_damage(x, y, w, h);
     vgp_flush();
 }
 
-void vgp_draw_pixel(uint32_t x, uint32_t y, uint32_t color){
-
-}
-
-void vgp_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color){
-
-}
-
-void vgp_draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t color){
-
-}
-
-void vgp_draw_char(uint32_t x, uint32_t y, char c, uint32_t color) {
-    
+surface vgp_get_surface() {
+    /*
+    This function describes the framebuffer backing the GPU resource.
+    Example usage: surface s = vgp_get_surface(); would get the address and layout of the framebuffer.
+    */
+    return (surface){
+        .base = framebuffer_memory,
+        .width = display_width,
+        .height = display_height,
+        .stride = display_width * (FRAMEBUFFER_BPP/8),
+        .format = PIXEL_FORMAT_XRGB8888, // The resource is VIRTIO_GPU_FORMAT_B8G8R8A8_UNORM, the same layout in memory
+    };
 }
 
 bool vgp_init(uint32_t width, uint32_t height) {
@@ -678,7 +963,9 @@ bool vgp_init(uint32_t width, uint32_t height) {
     If successful, it returns true; otherwise, it returns false.
     Example usage: bool success = vgp_init(1024, 768); would initialize the GPU for a 1024x768 display.
     */
+    boot_stage_begin("find_pci_device");
     uint64_t address = find_pci_device(VENDOR_ID, DEVICE_ID_BASE + GPU_DEVICE_ID);
+    boot_stage_end();
 
     default_width = width;
     default_height = height;
@@ -688,11 +975,22 @@ bool vgp_init(uint32_t width, uint32_t height) {
 
         kprintf("Initializing GPU...");
 
+        boot_stage_begin("virtio_gpu_start");
         vgp_get_capabilities(address);
+        msix_active = vgp_setup_msix(address);
         vgp_start();
+        metric_register(&commands_metric);
+        metric_register(&in_flight_metric);
+        metric_register(&latency_metric);
+        metric_register(&notifies_metric);
+        metric_register(&transferred_metric);
+        metric_register(&transfers_metric);
+        metric_register(&flushes_metric);
+        boot_stage_end();
 
         kprintf("GPU initialized. Issuing commands");
 
+        boot_stage_begin("virtio_gpu_resources");
         vgp_get_display_info();
 
         framebuffer_memory = palloc(framebuffer_size);
@@ -701,14 +999,14 @@ bool vgp_init(uint32_t width, uint32_t height) {
 
         vgp_attach_backing();
 
-        vgp_transfer_to_host();
-
+        vgp_damage(0, 0, display_width, display_height);
         vgp_flush();
 
         if (scanout_found)
             vgp_set_scanout();
         else 
             kprintf("GPU did not return valid scanout data");
+        boot_stage_end();
 
         kprintf("GPU ready");
 
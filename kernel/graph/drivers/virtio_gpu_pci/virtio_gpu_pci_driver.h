@@ -1,13 +1,16 @@
 #pragma once 
 
 #include "types.h"
+#include "graph/graphic_types.h"
 
 bool vgp_init(uint32_t width, uint32_t height);
 
-void vgp_flush();
+uint64_t vgp_flush();
+void vgp_flush_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+surface vgp_get_surface();
+void vgp_damage(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
 
-void vgp_clear(uint32_t color);
-void vgp_draw_pixel(uint32_t x, uint32_t y, uint32_t color);
-void vgp_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color);
-void vgp_draw_line(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t color);
-void vgp_draw_char(uint32_t x, uint32_t y, char c, uint32_t color);
\ No newline at end of file
+bool vgp_fence_signaled(uint64_t fence);
+void vgp_fence_wait(uint64_t fence);
+bool vgp_fence_poll(uint64_t fence);
+void vgp_fence_notify(uint64_t fence, void (*callback)(uint64_t fence, void *ctx), void *ctx);
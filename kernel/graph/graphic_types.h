@@ -1,6 +1,6 @@
 /*
 kernel/graph/graphic_types.h
-This file defines basic graphic types such as color, point, size, and rectangle.
+This file defines basic graphic types such as color, point, size, rectangle and surface, and the pixel format surfaces use.
 */
 #pragma once
 
@@ -10,6 +10,8 @@ extern "C" {
 
 typedef uint32_t color;
 
+#define PIXEL_FORMAT_XRGB8888 ((uint32_t)('X') | ((uint32_t)('R') << 8) | ((uint32_t)('2') << 16) | ((uint32_t)('4') << 24)) // DRM fourcc XR24, 32 bit pixels stored B, G, R, X in memory
+
 typedef struct {
     uint32_t x;
     uint32_t y;
@@ -25,6 +27,14 @@ typedef struct {
     size size;
 }__attribute__((packed)) rect;
 
+typedef struct {
+    uint64_t base; // Address of the first pixel
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride; // Bytes per row
+    uint32_t format; // Pixel format fourcc
+}__attribute__((packed)) surface;
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
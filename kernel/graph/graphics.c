@@ -4,14 +4,20 @@ This file provides a unified graphics interface that abstracts different GPU dri
 It allows initialization, drawing operations, and screen management regardless of the underlying GPU.
 Current supported GPUs are VirtIO GPU PCI and RAM Framebuffer (ramfb).
 Features are selected based on the available GPU during initialization.
+Drawing is the same for every GPU: the canvas rasterizes into the driver's surface, and the driver is only told
+which region changed, then asked to present it on flush.
 */
 #include "graphics.h"
 #include "console/kio.h"
+#include "ram_e.h"
+#include "boot_timeline.h"
+#include "canvas.h"
 
 #include "graph/drivers/virtio_gpu_pci/virtio_gpu_pci_driver.h"
 #include "graph/drivers/ramfb_driver/ramfb_driver.h"
 
 static size screen_size;
+static surface screen; // Surface of the chosen driver, everything draws into it
 static bool _gpu_ready;
 
 typedef enum {
@@ -31,12 +37,20 @@ void gpu_init(size preferred_screen_size){
     Once a GPU is successfully initialized, it sets the screen size and marks the GPU as ready.
     Example usage: gpu_init((size){1024, 768}) would initialize the GPU with a screen size of 1024x768.
     */
-    if (vgp_init(preferred_screen_size.width,preferred_screen_size.height))
+    boot_stage_begin("vgp_init");
+    bool vgp = vgp_init(preferred_screen_size.width,preferred_screen_size.height);
+    boot_stage_end();
+    if (vgp) {
         chosen_GPU = VIRTIO_GPU_PCI;
-    else if (rfb_init(preferred_screen_size.width,preferred_screen_size.height))
-        chosen_GPU = RAMFB;
+    } else {
+        boot_stage_begin("rfb_init");
+        if (rfb_init(preferred_screen_size.width,preferred_screen_size.height))
+            chosen_GPU = RAMFB;
+        boot_stage_end();
+    }
     screen_size = preferred_screen_size;
     _gpu_ready = true;
+    screen = gpu_get_surface();
     kprintf("Selected and initialized GPU %i",chosen_GPU);
 }
 
@@ -68,134 +82,163 @@ void gpu_flush(){
             break;
     }
 }
-void gpu_clear(color color){
+
+void gpu_flush_wait(){
     /*
-    This function clears the screen to a specified color.
-    It calls the appropriate clear function based on the initialized GPU driver.
-    Example usage: gpu_clear(0x000000) would clear the screen to black.
+    This function flushes like gpu_flush but only returns once the frame has reached the display.
+    virtio-gpu is polled rather than waited on with wfi, so it works with interrupts masked or inside a handler.
+    Example usage: gpu_flush_wait() before halting, so the last frame is what stays on screen.
     */
     if (!gpu_ready())
         return;
     switch (chosen_GPU) {
-        case VIRTIO_GPU_PCI:
-            vgp_clear(color);
+        case VIRTIO_GPU_PCI: {
+            uint64_t fence = vgp_flush();
+            while (!vgp_fence_poll(fence));
             break;
+        }
         case RAMFB:
-            rfb_clear(color);
+            rfb_flush();
+            break;
         default:
             break;
     }
 }
 
-void gpu_draw_pixel(point p, color color){
+void gpu_flush_rect(rect r){
     /*
-    This function draws a pixel at the specified point with the given color.
-    It calls the appropriate draw_pixel function based on the initialized GPU driver.
-    Example usage: gpu_draw_pixel((point){10, 20}, 0xFFFF00) would draw a green pixel at coordinates (10, 20).
+    This function flushes only the given region of the screen, for drawing done straight into gpu_get_surface.
+    Example usage: gpu_flush_rect((rect){{0, 0}, {100, 16}}) would update the top-left 100x16 pixels.
     */
     if (!gpu_ready())
         return;
     switch (chosen_GPU) {
         case VIRTIO_GPU_PCI:
-            vgp_draw_pixel(p.x,p.y,color);
-        break;
+            vgp_flush_rect(r.point.x, r.point.y, r.size.width, r.size.height);
+            break;
         case RAMFB:
-            rfb_draw_pixel(p.x,p.y,color);
-        break;
+            rfb_flush_rect(r.point.x, r.point.y, r.size.width, r.size.height);
+            break;
         default:
-        break;
+            break;
     }
 }
 
-void gpu_fill_rect(rect r, color color){
+surface gpu_get_surface(){
     /*
-    This function fills a rectangle defined by the given rect structure with the specified color.
-    It calls the appropriate fill_rect function based on the initialized GPU driver.
-    Example usage: gpu_fill_rect((rect){{10, 20}, {100, 50}}, 0xFF0000) would fill a rectangle at (10,20) with width 100 and height 50 in red color.
+    This function returns the framebuffer of the initialized GPU driver, so it can be drawn into directly.
+    Example usage: surface s = gpu_get_surface(); would get the base address, size and stride of the framebuffer.
     */
     if (!gpu_ready())
+        return (surface){0};
+    switch (chosen_GPU) {
+        case VIRTIO_GPU_PCI:
+            return vgp_get_surface();
+        case RAMFB:
+            return rfb_get_surface();
+        default:
+            return (surface){0};
+    }
+}
+
+static void gpu_damage(rect r){
+    /*
+    Reports a region drawn by the canvas to the driver, which presents it on the next flush.
+    This is the only per-driver step of drawing, once per primitive.
+    */
+    if (!r.size.width)
         return;
     switch (chosen_GPU) {
         case VIRTIO_GPU_PCI:
-            vgp_fill_rect(r.point.x,r.point.y,r.size.width,r.size.height,color);
-        break;
+            vgp_damage(r.point.x, r.point.y, r.size.width, r.size.height);
+            break;
         case RAMFB:
-            rfb_fill_rect(r.point.x,r.point.y,r.size.width,r.size.height,color);
-        break;
+            rfb_damage(r.point.x, r.point.y, r.size.width, r.size.height);
+            break;
         default:
-        break;
+            break;
     }
 }
 
+void gpu_clear(color color){
+    /*
+    This function clears the screen to a specified color.
+    Example usage: gpu_clear(0x000000) would clear the screen to black.
+    */
+    if (!gpu_ready())
+        return;
+    gpu_damage(canvas_fill_rect(screen, (rect){{0, 0}, {screen.width, screen.height}}, color));
+}
+
+void gpu_draw_pixel(point p, color color){
+    /*
+    This function draws a pixel at the specified point with the given color.
+    Example usage: gpu_draw_pixel((point){10, 20}, 0xFFFF00) would draw a green pixel at coordinates (10, 20).
+    */
+    if (!gpu_ready())
+        return;
+    gpu_damage(canvas_draw_pixel(screen, p, color));
+}
+
+void gpu_fill_rect(rect r, color color){
+    /*
+    This function fills a rectangle defined by the given rect structure with the specified color.
+    Example usage: gpu_fill_rect((rect){{10, 20}, {100, 50}}, 0xFF0000) would fill a rectangle at (10,20) with width 100 and height 50 in red color.
+    */
+    if (!gpu_ready())
+        return;
+    gpu_damage(canvas_fill_rect(screen, r, color));
+}
+
+void gpu_scroll(rect r, uint32_t lines, color fill){
+    /*
+    This function moves the contents of a region up by the given number of pixel rows
+    and fills the rows uncovered at the bottom with a color. The region is presented with the next flush,
+    so it can be combined with other damage.
+    Example usage: gpu_scroll((rect){{0, 0}, {1024, 768}}, 16, 0x0) would scroll the screen up by one 16 pixel text line.
+    */
+    if (!gpu_ready())
+        return;
+    gpu_damage(canvas_scroll(screen, r, lines, fill));
+}
+
 void gpu_draw_line(point p0, point p1, uint32_t color){
     /*
     This function draws a line from point p0 to point p1 with the specified color.
-    It calls the appropriate draw_line function based on the initialized GPU driver.
     Example usage: gpu_draw_line((point){10, 20}, (point){100, 200}, 0x0000FF) 
     would draw a blue line from (10,20) to (100,200).
     */
     if (!gpu_ready())
         return;
-    switch (chosen_GPU) {
-        case VIRTIO_GPU_PCI:
-            vgp_draw_line(p0.x,p0.y,p1.x,p1.y,color);
-        break;
-        case RAMFB:
-            rfb_draw_line(p0.x,p0.y,p1.x,p1.y,color);
-        break;
-        default:
-        break;
-    }
+    gpu_damage(canvas_draw_line(screen, p0, p1, color));
 }
+
 void gpu_draw_char(point p, char c, uint32_t scale, uint32_t color){
     /*
     This function draws a character at the specified point with the given color.
-    It calls the appropriate draw_char function based on the initialized GPU driver.
-    Example usage: gpu_draw_char((point){50, 50}, 'A', 0xFFFFFF) 
+    Example usage: gpu_draw_char((point){50, 50}, 'A', 1, 0xFFFFFF) 
     would draw the character 'A' in white color at coordinates (50, 50).
     */
     if (!gpu_ready())
         return;
-    switch (chosen_GPU) {
-        case VIRTIO_GPU_PCI:
-            vgp_draw_char(p.x,p.y,c,color);
-        break;
-        case RAMFB:
-            rfb_draw_char(p.x,p.y,c,scale,color);
-        break;
-        default:
-        break;
-    }
+    gpu_damage(canvas_draw_char(screen, p, c, scale, color));
 }
 
 void gpu_draw_string(kstring s, point p, uint32_t scale, uint32_t color) {
     /*
     This function draws a string at the specified point with the given scale.
-    It calls the appropriate draw_string function based on the initialized GPU driver.
-    Example usage: gpu_draw_string(string_l("Hello"), (point){100, 100}, 1) 
+    Example usage: gpu_draw_string(string_l("Hello"), (point){100, 100}, 1, 0xFFFFFF) 
     would draw the string "Hello" at coordinates (100, 100) with a scale of 1.
     */
     if (!gpu_ready())
         return;
-    switch (chosen_GPU) {
-        case RAMFB:
-            rfb_draw_string(s, p.x, p.y, scale, color);
-        break;
-        default:
-        break;
-    }
+    gpu_damage(canvas_draw_string(screen, s, p, scale, color));
 }
 
 uint32_t gpu_get_char_size(uint32_t scale) {
     if (!gpu_ready())
         return 0;
-    switch (chosen_GPU) {
-        case RAMFB:
-            return rfb_get_char_size(scale);
-        break;
-        default:
-        break;
-    }
+    return canvas_char_size(scale);
 }
 
 size gpu_get_screen_size(){
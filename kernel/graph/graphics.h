@@ -12,10 +12,14 @@ void gpu_init(size preferred_screen_size);
 bool gpu_ready();
 
 void gpu_flush();
+void gpu_flush_wait();
+void gpu_flush_rect(rect r);
+surface gpu_get_surface();
 
 void gpu_clear(color color);
 void gpu_draw_pixel(point p, color color);
 void gpu_fill_rect(rect r, color color);
+void gpu_scroll(rect r, uint32_t lines, color fill);
 void gpu_draw_line(point p0, point p1, color color);
 void gpu_draw_char(point p, char c, uint32_t scale, uint32_t color);
 size gpu_get_screen_size();
@@ -0,0 +1,49 @@
+/*
+kernel/graph/screen_capture.c
+This file saves the framebuffer to a host file as a binary PPM image, which most image viewers open.
+It needs semihosting, as a capture is megabytes that the serial port would take minutes to carry.
+*/
+#include "screen_capture.h"
+#include "graphics.h"
+#include "semihost.h"
+#include "kstring.h"
+#include "console/kio.h"
+
+#define CAPTURE_CHUNK 64 // Pixels converted per write
+
+bool screen_capture(const char *name) {
+    /*
+    This function writes the current contents of the screen to the host file name.
+    Pixels are 32 bit XRGB, as both drivers set them up, and are written as 24 bit RGB.
+    Returns false without a GPU or without semihosting.
+    Example usage: screen_capture("screen.ppm");
+    */
+    if (!gpu_ready()) return false;
+    host_file out;
+    if (!host_file_open(&out, name)) {
+        kprintf("Screen capture needs QEMU -semihosting");
+        return false;
+    }
+    surface s = gpu_get_surface();
+    char header[32];
+    format_buffer(header, sizeof(header), "P6\n%u %u\n255\n", s.width, s.height);
+    host_file_puts(&out, header);
+
+    uint8_t rgb[CAPTURE_CHUNK * 3];
+    for (uint32_t y = 0; y < s.height; y++) {
+        uint32_t *row = (uint32_t*)(s.base + (uint64_t)y * s.stride);
+        for (uint32_t x = 0; x < s.width; x += CAPTURE_CHUNK) {
+            uint32_t count = s.width - x < CAPTURE_CHUNK ? s.width - x : CAPTURE_CHUNK;
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t pixel = row[x + i];
+                rgb[i * 3] = pixel >> 16;
+                rgb[i * 3 + 1] = pixel >> 8;
+                rgb[i * 3 + 2] = pixel;
+            }
+            host_file_write(&out, rgb, count * 3);
+        }
+    }
+    bool complete = host_file_close(&out);
+    kprintf("Screen captured to %s, %ux%u%s", (uint64_t)name, s.width, s.height, (uint64_t)(complete ? "" : ", incomplete"));
+    return complete;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "types.h"
+
+bool screen_capture(const char *name);
@@ -0,0 +1,91 @@
+/*
+kernel/graph/user_framebuffer.c
+This file lets user processes draw without a syscall per primitive.
+A process can map the kernel's drawing surface, or get a private off-screen surface
+of the same size, and then present a damage rectangle once per frame.
+On ramfb the drawing surface is the back buffer, and on virtio-gpu it is the guest copy of the scanout resource,
+so with either driver nothing a process writes there shows until it presents.
+*/
+#include "user_framebuffer.h"
+#include "graphics.h"
+#include "mmu.h"
+#include "ram_e.h"
+#include "console/kio.h"
+#include "process/scheduler.h"
+#include "process/proc_allocator.h"
+
+typedef struct {
+    uint64_t base; // Address of the surface, 0 if the process has not mapped one
+    bool offscreen;
+} user_surface;
+
+static user_surface user_surfaces[MAX_PROCS];
+static bool scanout_mapped = false;
+
+uint64_t map_user_framebuffer(uint32_t flags, gfx_surface_info *info) {
+    /*
+    This function maps a framebuffer into the calling process and fills info with its layout.
+    With GFX_MAP_SCANOUT the surface the kernel draws into is mapped at USER_FRAMEBUFFER_VA, with the attributes
+    register_user_framebuffer picks for it. On ramfb that is the back buffer, so writes appear only after gfx_present.
+    With GFX_MAP_OFFSCREEN a private surface is allocated, which present_user_framebuffer copies to the screen.
+    Returns the address of the mapping, or 0 if there is no GPU or no memory left.
+    Example usage: uint64_t fb = map_user_framebuffer(GFX_MAP_SCANOUT, &info);
+    */
+    surface screen = gpu_get_surface();
+    if (screen.base == 0) return 0;
+
+    int pid = get_current_proc();
+    uint64_t size = (uint64_t)screen.stride * screen.height;
+    user_surface *s = &user_surfaces[pid];
+
+    if (flags == GFX_MAP_OFFSCREEN) {
+        if (!s->base || !s->offscreen) {
+            s->base = (uint64_t)alloc_proc_mem(size, false);
+            if (!s->base) return 0;
+            s->offscreen = true;
+        }
+    } else {
+        if (!scanout_mapped) {
+            register_user_framebuffer(USER_FRAMEBUFFER_VA, screen.base, size);
+            scanout_mapped = true;
+        }
+        s->base = USER_FRAMEBUFFER_VA;
+        s->offscreen = false;
+    }
+
+    if (info) {
+        info->base = s->base;
+        info->width = screen.width;
+        info->height = screen.height;
+        info->stride = screen.stride;
+        info->format = screen.format;
+    }
+
+    kprintf_raw("Mapped framebuffer for process %i at %h", pid, s->base);
+    return s->base;
+}
+
+void present_user_framebuffer(rect damage) {
+    /*
+    This function puts the damaged region of the calling process' surface on screen.
+    Off-screen surfaces are copied row by row into the framebuffer first, then only the damaged region is flushed.
+    Example usage: present_user_framebuffer((rect){{0, 0}, {100, 16}});
+    */
+    surface screen = gpu_get_surface();
+    user_surface *s = &user_surfaces[get_current_proc()];
+    if (screen.base == 0 || !s->base) return;
+
+    if (damage.point.x >= screen.width || damage.point.y >= screen.height) return;
+    if (damage.size.width > screen.width - damage.point.x) damage.size.width = screen.width - damage.point.x;
+    if (damage.size.height > screen.height - damage.point.y) damage.size.height = screen.height - damage.point.y;
+
+    if (s->offscreen) {
+        uint64_t row_offset = (uint64_t)damage.point.y * screen.stride + damage.point.x * 4;
+        for (uint32_t y = 0; y < damage.size.height; y++) {
+            memcpy((void*)(screen.base + row_offset), (void*)(s->base + row_offset), damage.size.width * 4);
+            row_offset += screen.stride;
+        }
+    }
+
+    gpu_flush_rect(damage);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "types.h"
+#include "graph/graphic_types.h"
+#include "syscalls/syscalls.h"
+
+uint64_t map_user_framebuffer(uint32_t flags, gfx_surface_info *info);
+void present_user_framebuffer(rect damage);
@@ -0,0 +1,255 @@
+/*
+kernel/hrtimer.c
+This file implements high resolution timers: one-shot and periodic callbacks with nanosecond expiry.
+Queued timers are kept in a min-heap ordered by deadline, one heap per hardware timer,
+and only the earliest deadline is programmed into the comparator, so there are no idle ticks.
+Every timer has a slack. When an interrupt fires, all timers whose expiry has been reached run together,
+which coalesces nearby expiries into a single interrupt.
+*/
+#include "hrtimer.h"
+#include "gic.h"
+#include "console/kio.h"
+
+#define IRQ_VIRTUAL_TIMER 27
+#define IRQ_PHYSICAL_TIMER 30
+
+#define CNT_CTL_ENABLE 0x1
+#define CNT_CTL_IMASK 0x2
+
+typedef struct {
+    hrtimer *heap[HRTIMER_MAX];
+    uint32_t count;
+    uint32_t irq;
+} hrtimer_base;
+
+static hrtimer_base bases[2];
+
+// Fixed point conversion factors, computed once from cntfrq_el0
+static uint64_t ns_to_ticks_mult; // ticks = (ns * mult) >> 32
+static uint64_t ticks_to_ns_mult; // ns = (ticks * mult) >> 32
+
+uint64_t timer_counter() {
+    /*
+    This function returns the virtual counter, the time base for all hrtimers.
+    Both timers compare against it, as the kernel does not set a virtual offset.
+    */
+    uint64_t v;
+    asm volatile ("isb; mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+
+uint64_t ns_to_ticks(uint64_t ns) {
+    return (uint64_t)(((unsigned __int128)ns * ns_to_ticks_mult) >> 32);
+}
+
+uint64_t ticks_to_ns(uint64_t ticks) {
+    return (uint64_t)(((unsigned __int128)ticks * ticks_to_ns_mult) >> 32);
+}
+
+uint64_t timer_now_ns() {
+    return ticks_to_ns(timer_counter());
+}
+
+static void hrtimer_program(hrtimer_base *base) {
+    /*
+    Program the comparator of a hardware timer with the earliest deadline, or mask it when nothing is queued.
+    */
+    uint64_t ctl = base->count ? CNT_CTL_ENABLE : CNT_CTL_IMASK;
+    uint64_t cval = base->count ? base->heap[0]->deadline : 0;
+    if (base == &bases[HRTIMER_PHYSICAL]) {
+        asm volatile ("msr cntp_cval_el0, %0" :: "r"(cval));
+        asm volatile ("msr cntp_ctl_el0, %0" :: "r"(ctl));
+    } else {
+        asm volatile ("msr cntv_cval_el0, %0" :: "r"(cval));
+        asm volatile ("msr cntv_ctl_el0, %0" :: "r"(ctl));
+    }
+}
+
+static void heap_swap(hrtimer_base *base, uint32_t a, uint32_t b) {
+    hrtimer *t = base->heap[a];
+    base->heap[a] = base->heap[b];
+    base->heap[b] = t;
+    base->heap[a]->index = a;
+    base->heap[b]->index = b;
+}
+
+static void heap_up(hrtimer_base *base, uint32_t i) {
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (base->heap[parent]->deadline <= base->heap[i]->deadline) break;
+        heap_swap(base, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(hrtimer_base *base, uint32_t i) {
+    while (1) {
+        uint32_t smallest = i;
+        uint32_t l = i * 2 + 1, r = i * 2 + 2;
+        if (l < base->count && base->heap[l]->deadline < base->heap[smallest]->deadline) smallest = l;
+        if (r < base->count && base->heap[r]->deadline < base->heap[smallest]->deadline) smallest = r;
+        if (smallest == i) break;
+        heap_swap(base, i, smallest);
+        i = smallest;
+    }
+}
+
+static bool heap_insert(hrtimer_base *base, hrtimer *timer) {
+    if (base->count >= HRTIMER_MAX) return false;
+    timer->index = base->count;
+    base->heap[base->count++] = timer;
+    heap_up(base, timer->index);
+    return true;
+}
+
+static void heap_remove(hrtimer_base *base, hrtimer *timer) {
+    uint32_t i = timer->index;
+    timer->index = -1;
+    base->count--;
+    if (i == base->count) return;
+    hrtimer *moved = base->heap[base->count];
+    base->heap[i] = moved;
+    moved->index = i;
+    heap_up(base, i);
+    heap_down(base, moved->index);
+}
+
+void hrtimer_setup(hrtimer *timer, hrtimer_callback callback, void *ctx, uint32_t flags) {
+    /*
+    This function prepares a timer before its first start.
+    Example usage: hrtimer_setup(&t, my_timeout, 0, HRTIMER_VIRTUAL);
+    */
+    timer->callback = callback;
+    timer->ctx = ctx;
+    timer->flags = flags & HRTIMER_PHYSICAL;
+    timer->index = -1;
+    timer->period = 0;
+}
+
+static void hrtimer_enqueue(hrtimer *timer, uint64_t expires, uint64_t period, uint64_t slack) {
+    /*
+    Queue a timer at an absolute expiry, all values in counter ticks.
+    */
+    hrtimer_base *base = &bases[timer->flags];
+    uint64_t flags = irq_save();
+    if (timer->index >= 0)
+        heap_remove(base, timer);
+    timer->expires = expires;
+    timer->slack = slack;
+    timer->deadline = timer->expires + timer->slack;
+    timer->period = period;
+    if (!heap_insert(base, timer))
+        kprintf_raw("[HRTIMER] Too many timers queued, dropping timer");
+    if (timer->index == 0)
+        hrtimer_program(base);
+    irq_restore(flags);
+}
+
+void hrtimer_start(hrtimer *timer, uint64_t delay_ns, uint64_t period_ns, uint64_t slack_ns) {
+    /*
+    This function queues a timer to run delay_ns from now, and then every period_ns if the period is not 0.
+    The callback runs between delay_ns and delay_ns + slack_ns, so a larger slack lets it share an interrupt with other timers.
+    Restarting a queued timer moves it to the new expiry.
+    Example usage: hrtimer_start(&t, 5 * NSEC_PER_MSEC, 0, 100 * NSEC_PER_USEC); would run the callback once in 5ms, give or take 100us.
+    */
+    hrtimer_enqueue(timer, timer_counter() + ns_to_ticks(delay_ns), ns_to_ticks(period_ns), ns_to_ticks(slack_ns));
+}
+
+void hrtimer_start_at(hrtimer *timer, uint64_t expires) {
+    /*
+    This function queues a one-shot timer to run once the counter reaches expires, with no slack.
+    It is meant for code that needs to know exactly when the timer was due.
+    Example usage: hrtimer_start_at(&t, timer_counter() + ns_to_ticks(NSEC_PER_MSEC));
+    */
+    hrtimer_enqueue(timer, expires, 0, 0);
+}
+
+void hrtimer_cancel(hrtimer *timer) {
+    /*
+    This function removes a queued timer. Cancelling a timer that is not queued does nothing.
+    */
+    hrtimer_base *base = &bases[timer->flags];
+    uint64_t flags = irq_save();
+    if (timer->index >= 0) {
+        bool was_first = timer->index == 0;
+        heap_remove(base, timer);
+        if (was_first)
+            hrtimer_program(base);
+    }
+    irq_restore(flags);
+}
+
+bool hrtimer_active(hrtimer *timer) {
+    return timer->index >= 0;
+}
+
+static irq_result hrtimer_run(hrtimer_base *base, hrtimer *timer, uint64_t now) {
+    /*
+    Run an expired timer that has already been removed from the heap, and queue it again if it is periodic.
+    Periods that were missed entirely are skipped rather than run back to back.
+    */
+    irq_result result = timer->callback(timer, timer->ctx);
+    if (timer->period && timer->index < 0) {
+        timer->expires += timer->period;
+        if (timer->expires <= now)
+            timer->expires = now + timer->period;
+        timer->deadline = timer->expires + timer->slack;
+        heap_insert(base, timer);
+    }
+    return result;
+}
+
+static irq_result hrtimer_irq(uint32_t irq, void *ctx) {
+    /*
+    Hardware timer interrupt. Runs every timer whose deadline has passed, then every queued timer whose
+    expiry has been reached even though its deadline has not, and re-arms the comparator for the next deadline.
+    */
+    hrtimer_base *base = ctx;
+    irq_result result = IRQ_HANDLED;
+    uint64_t now = timer_counter();
+
+    while (base->count && base->heap[0]->deadline <= now) {
+        hrtimer *timer = base->heap[0];
+        heap_remove(base, timer);
+        if (hrtimer_run(base, timer, now) == IRQ_RESCHEDULE)
+            result = IRQ_RESCHEDULE;
+    }
+
+    for (uint32_t i = 0; i < base->count;) {
+        hrtimer *timer = base->heap[i];
+        if (timer->expires > now) {
+            i++;
+            continue;
+        }
+        heap_remove(base, timer);
+        if (hrtimer_run(base, timer, now) == IRQ_RESCHEDULE)
+            result = IRQ_RESCHEDULE;
+        i = 0; // The heap was reordered
+    }
+
+    hrtimer_program(base);
+    return result;
+}
+
+void hrtimers_init() {
+    /*
+    This function computes the tick conversion factors and routes both timer interrupts.
+    Must be called after gic_init.
+    */
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    ns_to_ticks_mult = (uint64_t)(((unsigned __int128)freq << 32) / NSEC_PER_SEC);
+    ticks_to_ns_mult = (uint64_t)(((unsigned __int128)NSEC_PER_SEC << 32) / freq);
+
+    uint64_t val = 0b11;
+    asm volatile ("msr cntkctl_el1, %0" :: "r"(val)); // Let EL0 read both counters
+
+    bases[HRTIMER_VIRTUAL].irq = IRQ_VIRTUAL_TIMER;
+    bases[HRTIMER_PHYSICAL].irq = IRQ_PHYSICAL_TIMER;
+    for (int i = 0; i < 2; i++) {
+        hrtimer_program(&bases[i]);
+        request_irq(bases[i].irq, hrtimer_irq, &bases[i], IRQ_TRIGGER_LEVEL | IRQ_PRIORITY(0x80));
+    }
+
+    kprintf("[HRTIMER] Counter frequency %i Hz", freq);
+}
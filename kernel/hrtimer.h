@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+#include "irq.h"
+
+#define HRTIMER_VIRTUAL 0x0 // Runs on the virtual timer (CNTV), for general use
+#define HRTIMER_PHYSICAL 0x1 // Runs on the EL1 physical timer (CNTP), reserved for the scheduler tick
+
+#define HRTIMER_MAX 64 // Queued timers per hardware timer
+
+#define NSEC_PER_USEC 1000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+
+typedef struct hrtimer hrtimer;
+
+typedef irq_result (*hrtimer_callback)(hrtimer *timer, void *ctx);
+
+struct hrtimer {
+    uint64_t expires; // Earliest time the callback may run, in counter ticks
+    uint64_t deadline; // Latest time the callback may run, expires + slack
+    uint64_t period; // In counter ticks, 0 for one-shot timers
+    uint64_t slack;
+    hrtimer_callback callback;
+    void *ctx;
+    uint32_t flags;
+    int32_t index; // Position in the heap, -1 when not queued
+};
+
+void hrtimers_init();
+void hrtimer_setup(hrtimer *timer, hrtimer_callback callback, void *ctx, uint32_t flags);
+void hrtimer_start(hrtimer *timer, uint64_t delay_ns, uint64_t period_ns, uint64_t slack_ns);
+void hrtimer_start_at(hrtimer *timer, uint64_t expires);
+void hrtimer_cancel(hrtimer *timer);
+bool hrtimer_active(hrtimer *timer);
+
+uint64_t timer_counter();
+uint64_t timer_now_ns();
+uint64_t ns_to_ticks(uint64_t ns);
+uint64_t ticks_to_ns(uint64_t ticks);
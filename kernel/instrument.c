@@ -0,0 +1,82 @@
+/*
+kernel/instrument.c
+This file implements function entry and exit tracing for the `make INSTRUMENT=1` build, which compiles the kernel
+with -finstrument-functions. The compiler calls __cyg_profile_func_enter and __cyg_profile_func_exit around
+every instrumented function, and the hooks record the function address and cntvct into a buffer.
+The buffer fills once from boot and then stops, so a dump covers boot from its first call.
+The exception path (exception_handler.c, gic.c, irq.c), the interrupt handlers of the UART, timers, console input,
+tracing, metrics and the profiler, and the scheduler are built without instrumentation,
+as are the kernel processes, whose code is relocated when they are loaded.
+The dump goes to the host file ftrace.log with semihosting, and to the serial port otherwise.
+tools/ftrace_fold.py symbolizes a dump against kernel.elf and folds it into flame graph stacks.
+*/
+#include "instrument.h"
+#include "semihost.h"
+#include "console/kio.h"
+#include "kstring.h"
+
+#define INSTRUMENT_EXIT 1 // Set in the address of exit records, functions are 4 byte aligned
+
+#define NO_INSTRUMENT __attribute__((no_instrument_function))
+
+typedef struct {
+    uint64_t timestamp;
+    uint64_t address; // Function address, INSTRUMENT_EXIT set on exit
+} instrument_record;
+
+static instrument_record records[INSTRUMENT_RECORDS];
+static volatile uint64_t next_record;
+static volatile uint64_t dropped;
+static volatile bool recording = true;
+
+NO_INSTRUMENT static inline void instrument_record_call(uint64_t address) {
+    if (!recording) return;
+    uint64_t index = __atomic_fetch_add(&next_record, 1, __ATOMIC_RELAXED);
+    if (index >= INSTRUMENT_RECORDS) {
+        dropped++;
+        return;
+    }
+    uint64_t now;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(now));
+    records[index].timestamp = now;
+    records[index].address = address;
+}
+
+NO_INSTRUMENT void __cyg_profile_func_enter(void *fn, void *call_site) {
+    instrument_record_call((uint64_t)fn);
+}
+
+NO_INSTRUMENT void __cyg_profile_func_exit(void *fn, void *call_site) {
+    instrument_record_call((uint64_t)fn | INSTRUMENT_EXIT);
+}
+
+NO_INSTRUMENT void instrument_stop() {
+    recording = false;
+}
+
+NO_INSTRUMENT void instrument_dump() {
+    /*
+    This function stops recording and writes the buffer as hex lines between "[FTRACE] begin" and "[FTRACE] end",
+    to ftrace.log on the host, or to the serial port waiting for room in the UART ring, so no record is dropped.
+    Recording stays off afterwards, as the dump itself calls instrumented code.
+    */
+    instrument_stop();
+    uint64_t count = next_record < INSTRUMENT_RECORDS ? next_record : INSTRUMENT_RECORDS;
+
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    host_file out;
+    bool to_host = host_file_open(&out, "ftrace.log");
+    char line[64];
+    format_buffer(line, sizeof(line), "\n[FTRACE] begin freq %u dropped %u\n", freq, dropped);
+    host_file_puts(&out, line);
+    for (uint64_t i = 0; i < count; i++) {
+        format_buffer(line, sizeof(line), "[FTRACE] %x %x\n", records[i].timestamp, records[i].address);
+        host_file_puts(&out, line);
+    }
+    host_file_puts(&out, "[FTRACE] end\n");
+    if (to_host) {
+        bool complete = host_file_close(&out);
+        kprintf("Function trace written to ftrace.log, %u bytes%s", out.written, (uint64_t)(complete ? "" : ", incomplete"));
+    }
+}
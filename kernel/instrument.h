@@ -0,0 +1,8 @@
+#pragma once
+
+#include "types.h"
+
+#define INSTRUMENT_RECORDS 65536 // 1MB of records, filled once from boot
+
+void instrument_stop();
+void instrument_dump();
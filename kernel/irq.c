@@ -0,0 +1,175 @@
+/*
+kernel/irq.c
+This file implements a generic IRQ registration and dispatch layer on top of the GIC.
+Drivers register a handler per interrupt line with request_irq, and the IRQ exception
+handler dispatches to it. Every line keeps a count of how often it fired and how long its handler ran,
+and the first IRQ_METRIC_LINES lines requested also publish a histogram of their handler times.
+*/
+#include "irq.h"
+#include "gic.h"
+#include "console/kio.h"
+#include "trace.h"
+#include "hrtimer.h"
+#include "kstring.h"
+
+static irq_desc irq_descs[IRQ_MAX];
+static uint64_t spurious_count;
+static uint64_t last_entry_ticks;
+static irq_frame *last_frame;
+
+#define IRQ_METRIC_LINES 32
+
+typedef struct {
+    uint32_t irq;
+    char name[12];
+    metric metric;
+    histogram time;
+} irq_line_metric;
+
+static irq_line_metric line_metrics[IRQ_METRIC_LINES];
+static uint32_t line_metric_count;
+
+static uint64_t read_spurious(void *ctx) {
+    return spurious_count;
+}
+
+static metric spurious_metric = METRIC_GAUGE_INIT("irq.spurious", "interrupts", read_spurious, 0);
+
+static histogram* irq_line_histogram(uint32_t irq) {
+    /*
+    Returns the handler time histogram of a line, publishing it the first time the line is requested.
+    */
+    for (uint32_t i = 0; i < line_metric_count; i++)
+        if (line_metrics[i].irq == irq)
+            return &line_metrics[i].time;
+    if (line_metric_count == 0)
+        metric_register(&spurious_metric);
+    if (line_metric_count == IRQ_METRIC_LINES)
+        return 0;
+    irq_line_metric *line = &line_metrics[line_metric_count++];
+    line->irq = irq;
+    format_buffer(line->name, sizeof(line->name), "irq.%u", irq);
+    line->metric = (metric)METRIC_HISTOGRAM_INIT(line->name, "ns", &line->time);
+    metric_register(&line->metric);
+    return &line->time;
+}
+
+static inline uint64_t irq_read_counter() {
+    uint64_t v;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+
+bool request_irq(uint32_t irq, irq_handler handler, void *ctx, uint32_t flags) {
+    /*
+    This function registers a handler for an interrupt line and enables it in the GIC.
+    The flags select the trigger mode (IRQ_TRIGGER_EDGE or IRQ_TRIGGER_LEVEL), the priority (IRQ_PRIORITY)
+    and, for SPIs, the target CPUs (IRQ_TARGET). Priority and target fall back to sensible defaults when not given.
+    Returns false if the line is out of range or already taken.
+    Example usage: request_irq(33, uart_irq, 0, IRQ_TRIGGER_LEVEL); would route the PL011 interrupt to uart_irq.
+    */
+    if (irq >= IRQ_MAX || !handler) return false;
+    if (irq_descs[irq].handler) {
+        kprintf("[IRQ] Line %i already registered", irq);
+        return false;
+    }
+
+    if (!(flags & IRQ_PRIORITY(0xFF)))
+        flags |= IRQ_PRIORITY(IRQ_DEFAULT_PRIORITY);
+    if (!(flags & IRQ_TARGET(0xFF)))
+        flags |= IRQ_TARGET(IRQ_DEFAULT_TARGET);
+
+    irq_descs[irq] = (irq_desc){
+        .handler = handler,
+        .ctx = ctx,
+        .flags = flags,
+        .handler_time = irq_line_histogram(irq),
+    };
+
+    gic_configure_irq(irq, flags & IRQ_TRIGGER_EDGE, (flags >> 8) & 0xFF, (flags >> 16) & 0xFF);
+    gic_enable_irq(irq);
+    return true;
+}
+
+void free_irq(uint32_t irq) {
+    /*
+    This function disables an interrupt line and removes its handler.
+    */
+    if (irq >= IRQ_MAX) return;
+    gic_disable_irq(irq);
+    irq_descs[irq].handler = 0;
+    irq_descs[irq].ctx = 0;
+}
+
+irq_result irq_handle(uint32_t irq, irq_frame *frame, uint64_t entry_ticks) {
+    /*
+    This function runs the handler registered for an acknowledged interrupt and records its statistics.
+    The caller is responsible for signalling End of Interrupt to the GIC.
+    */
+    last_entry_ticks = entry_ticks;
+    last_frame = frame;
+    if (irq >= IRQ_MAX) return IRQ_NONE;
+    irq_desc *desc = &irq_descs[irq];
+    desc->count++;
+    if (!desc->handler) {
+        desc->unhandled++;
+        return IRQ_NONE;
+    }
+
+    trace(TRACE_IRQ_ENTRY, irq, entry_ticks);
+    uint64_t start = irq_read_counter();
+    irq_result result = desc->handler(irq, desc->ctx);
+    uint64_t elapsed = irq_read_counter() - start;
+    trace(TRACE_IRQ_EXIT, irq, result);
+
+    desc->total_ticks += elapsed;
+    if (elapsed > desc->max_ticks)
+        desc->max_ticks = elapsed;
+    if (desc->handler_time)
+        histogram_observe(desc->handler_time, ticks_to_ns(elapsed));
+    if (result == IRQ_NONE)
+        desc->unhandled++;
+    return result;
+}
+
+uint64_t irq_entry_ticks() {
+    /*
+    This function returns the counter value at which the interrupt being handled entered the kernel.
+    Handlers can compare it with the time they expected to be raised to measure entry latency.
+    */
+    return last_entry_ticks;
+}
+
+irq_frame* irq_interrupted_frame() {
+    /*
+    This function returns the registers of the code the interrupt being handled stopped,
+    so handlers like the sampling profiler can see where it was.
+    */
+    return last_frame;
+}
+
+void irq_count_spurious() {
+    spurious_count++;
+}
+
+const irq_desc* irq_get_desc(uint32_t irq) {
+    if (irq >= IRQ_MAX) return 0;
+    return &irq_descs[irq];
+}
+
+uint64_t irq_get_spurious_count() {
+    return spurious_count;
+}
+
+void irq_debug_print() {
+    /*
+    This function prints the count, unhandled count and handler time of every line that has fired.
+    Times are in cntvct ticks, see cntfrq_el0 for the frequency.
+    */
+    for (uint32_t i = 0; i < IRQ_MAX; i++) {
+        irq_desc *desc = &irq_descs[i];
+        if (!desc->count) continue;
+        kprintf("[IRQ] %i: count %i unhandled %i total %i max %i ticks", i, desc->count, desc->unhandled, desc->total_ticks, desc->max_ticks);
+    }
+    kprintf("[IRQ] Spurious: %i", spurious_count);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "types.h"
+#include "metrics.h"
+
+#define IRQ_MAX 288 // 32 private (SGI + PPI) lines plus 256 SPIs on the virt board
+#define IRQ_SPURIOUS 1023
+
+#define IRQ_TRIGGER_LEVEL 0x0
+#define IRQ_TRIGGER_EDGE 0x1
+#define IRQ_PRIORITY(p) (((uint32_t)(p) & 0xFF) << 8) // Lower is more urgent, 0 selects the default. Must stay below the 0xF0 priority mask
+#define IRQ_TARGET(mask) (((uint32_t)(mask) & 0xFF) << 16) // CPU interface mask for SPIs, 0 selects the default
+
+#define IRQ_DEFAULT_PRIORITY 0xA0
+#define IRQ_DEFAULT_TARGET 0x1
+
+typedef enum {
+    IRQ_NONE, // Not ours, counted as unhandled
+    IRQ_HANDLED,
+    IRQ_RESCHEDULE, // Handled, and the scheduler should pick the next process
+} irq_result;
+
+typedef irq_result (*irq_handler)(uint32_t irq, void *ctx);
+
+typedef struct {
+    /*
+    Registers of the interrupted context, pushed by irq_el1_asm_handler.
+    The layout must match the offsets used in exception_vectors_as.S.
+    */
+    uint64_t regs[31]; // x0-x30
+    uint64_t elr;
+    uint64_t spsr;
+    uint64_t sp_el1; // Stack pointer before the frame was pushed
+    uint64_t sp_el0;
+    uint64_t padding; // Keeps the frame 16 byte aligned
+    uint64_t simd[8]; // q0-q3, used by memcpy_simd and memset32_simd
+} irq_frame;
+
+typedef struct {
+    irq_handler handler;
+    void *ctx;
+    uint32_t flags;
+    uint64_t count;
+    uint64_t unhandled;
+    uint64_t total_ticks; // Time spent in the handler, in cntvct ticks
+    uint64_t max_ticks;
+    histogram *handler_time; // Handler run times in ns, published as the metric irq.<line>
+} irq_desc;
+
+bool request_irq(uint32_t irq, irq_handler handler, void *ctx, uint32_t flags);
+void free_irq(uint32_t irq);
+irq_result irq_handle(uint32_t irq, irq_frame *frame, uint64_t entry_ticks);
+uint64_t irq_entry_ticks();
+irq_frame* irq_interrupted_frame();
+void irq_count_spurious();
+const irq_desc* irq_get_desc(uint32_t irq);
+uint64_t irq_get_spurious_count();
+void irq_debug_print();
@@ -5,6 +5,7 @@ interrupts, timer, and memory management unit (MMU). It serves as the entry poin
 */
 #include "console/kio.h"
 #include "console/serial/uart.h"
+#include "console/tty.h"
 #include "graph/graphics.h"
 #include "pci.h"
 #include "kstring.h"
@@ -14,14 +15,27 @@ interrupts, timer, and memory management unit (MMU). It serves as the entry poin
 #include "ram_e.h"
 #include "dtb.h"
 #include "gic.h"
+#include "hrtimer.h"
+#include "trace.h"
+#include "instrument.h"
+#include "boot_timeline.h"
 #include "process/scheduler.h"
 #include "default_process.h"
 #include "filesystem/disk.h"
 #include "kernel_processes/bootscreen.h"
+#include "kernel_processes/latency_test.h"
+#include "kernel_processes/kshell.h"
+#include "bench/bench.h"
 
 void kernel_main() {
 
+    boot_stage_begin("enable_uart");
     enable_uart();
+    boot_stage_end();
+
+#ifdef TRACE_BOOT
+    trace_start(TRACE_ALL);
+#endif
 
     kprintf("Initializing kernel...");
 
@@ -29,28 +43,42 @@ void kernel_main() {
 
     kprintf("UART output enabled");
 
+    boot_stage_begin("set_exception_vectors");
+    set_exception_vectors();
+    boot_stage_end();
+
+    kprintf("Exception vectors set");
+
+    kprintf("Interrupts init");
+    boot_stage_begin("interrupts");
+    gic_init();
+    uart_enable_irq();
+    kio_init();
+    tty_init();
+    hrtimers_init();
+    mem_metrics_init();
+    boot_stage_end();
+
     size screen_size = {1024,768};
 
     kprintf("Preparing for draw");
 
+    boot_stage_begin("gpu_init");
     gpu_init(screen_size);
+    boot_stage_end();
 
     kprintf("GPU initialized");
 
     kprintf("Device initialization finished");
 
-    set_exception_vectors();
-
-    kprintf("Exception vectors set");
-
-    kprintf("Interrupts init");
-    gic_init();
-
     kprintf("Initializing disk...");
+    boot_stage_begin("init_disk");
     init_disk();
+    boot_stage_end();
 
-    mmu_enable_verbose();
+    boot_stage_begin("mmu_init");
     mmu_init();
+    boot_stage_end();
     kprintf("MMU Mapped");
 
     kprintf("Kernel initialized successfully!");
@@ -63,7 +91,24 @@ void kernel_main() {
 
     // default_processes();
 
+    boot_stage_begin("start_processes");
+#ifdef LATENCY_TEST
+    start_latency_test();
+#elif defined(BENCH)
+    start_benchmarks();
+#else
+    kio_start_klogd();
+    start_kshell();
+    tty_start_keys();
     start_bootscreen();
+#endif
+    boot_stage_end();
+
+#ifdef INSTRUMENT
+    instrument_dump();
+#endif
+
+    boot_timeline_report();
 
     kprintf("Starting scheduler");
 
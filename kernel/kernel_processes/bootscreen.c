@@ -25,8 +25,8 @@ static uint64_t randomNumber = 0;
 __attribute__((section(".text.kbootscreen")))
 void boot_draw_name(point screen_middle, int xoffset, int yoffset) {
     const char* name = "Craybond OS - Crayons are for losers - %i%";
-    uint64_t *i = &randomNumber;
-    kstring s = string_format_args(name, i, 1);
+    char text[64];
+    kstring s = { .data = text, .length = format_buffer_args(text, sizeof(text), name, &randomNumber, 1) };
     int scale = 2;
     uint32_t char_size = gpu_get_char_size(scale);
     int mid_offset = (s.length/2) * char_size;
@@ -34,7 +34,6 @@ void boot_draw_name(point screen_middle, int xoffset, int yoffset) {
     int yo = screen_middle.y + yoffset;
     gpu_fill_rect((rect){xo,yo, char_size * s.length, char_size}, 0x0);
     gpu_draw_string(s, (point){xo, yo}, scale, 0xFFFFFF);
-    temp_free(s.data, 256);
 }
 
 __attribute__((section(".text.kbootscreen"))) // Code section for bootscreen process
@@ -130,6 +129,7 @@ void bootscreen() {
                 }
 
             }
+            gpu_flush();
             // Apply fixed pint rotation matrix for next point
             // rotate cw: x' = x*cos + y*sin, y' = -x*sin + y*cos
             int next_x = (x * cos_step + y * sin_step) / 1024;
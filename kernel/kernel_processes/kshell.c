@@ -0,0 +1,207 @@
+/*
+kernel/kernel_processes/kshell.c
+This file implements the kernel shell, a kernel process that reads commands from the serial console
+and prints tables about the running system. ps lists the processes with the CPU time they used,
+trace starts and stops event tracing, and every other view is a group of the metrics registry:
+typing the first part of a metric name (mem, irq, sched, virtq...) lists the metrics published under it,
+so a subsystem that registers new metrics gets a shell command for free.
+Output goes straight to the UART ring, waiting for room rather than dropping parts of a table.
+*/
+#include "kshell.h"
+#include "process/kprocess_loader.h"
+#include "process/scheduler.h"
+#include "console/tty.h"
+#include "console/serial/uart.h"
+#include "kstring.h"
+#include "metrics.h"
+#include "hrtimer.h"
+#include "trace.h"
+#include "gic.h"
+#include "ram_e.h"
+
+#define SHELL_LINE_MAX 128
+#define SHELL_ARGS_MAX 4
+
+static void shell_write(const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    char line[160];
+    uint32_t len = format_buffer_args(line, sizeof(line), fmt, args, arg_count);
+    while (uart_tx_space() < len)
+        asm volatile ("wfi" ::: "memory");
+    uart_raw_puts(line);
+}
+
+#define shell_printf(fmt, ...) \
+    ({ \
+        uint64_t _args[] = { __VA_ARGS__ }; \
+        shell_write((fmt), _args, sizeof(_args) / sizeof(_args[0])); \
+    })
+
+static bool word_equals(const char *a, const char *b) {
+    uint32_t i = 0;
+    while (a[i] && a[i] == b[i]) i++;
+    return a[i] == b[i];
+}
+
+static void cmd_ps(uint32_t argc, char **argv) {
+    /*
+    CPU time is what each process ran up to its last switch, the share is of the time all of them ran.
+    */
+    uint64_t total = 0;
+    for (int pid = 0; pid < get_proc_count(); pid++)
+        total += get_proc(pid)->cpu_ticks;
+    if (!total) total = 1;
+    shell_printf("%4s %-8s %12s %7s %10s %18s\n", (uint64_t)"PID", (uint64_t)"STATE", (uint64_t)"CPU ms", (uint64_t)"CPU", (uint64_t)"SWITCHES", (uint64_t)"PC");
+    for (int pid = 0; pid < get_proc_count(); pid++) {
+        process_t *proc = get_proc(pid);
+        const char *state = pid == get_current_proc() ? "RUNNING" : proc->state == BLOCKED ? "BLOCKED" : "READY";
+        uint64_t per_mille = proc->cpu_ticks * 1000 / total;
+        shell_printf("%4u %-8s %12u %5u.%u%% %10u %18h\n", pid, (uint64_t)state, ticks_to_ns(proc->cpu_ticks) / NSEC_PER_MSEC,
+            per_mille / 10, per_mille % 10, proc->switches, proc->pc);
+    }
+}
+
+static void print_group(const char *group) {
+    /*
+    Prints the counters and gauges of a group, then its histograms with their count, mean and percentiles.
+    */
+    bool values = false, histograms = false;
+    for (metric *m = metric_first(); m; m = m->next) {
+        if (!metric_in_group(m, group) || m->type == METRIC_HISTOGRAM) continue;
+        if (!values)
+            shell_printf("%-28s %16s %s\n", (uint64_t)"METRIC", (uint64_t)"VALUE", (uint64_t)"UNIT");
+        values = true;
+        shell_printf("%-28s %16u %s\n", (uint64_t)m->name, metric_value(m), (uint64_t)m->unit);
+    }
+    for (metric *m = metric_first(); m; m = m->next) {
+        if (!metric_in_group(m, group) || m->type != METRIC_HISTOGRAM) continue;
+        if (!histograms)
+            shell_printf("%s%-28s %10s %10s %10s %10s %10s %s\n", (uint64_t)(values ? "\n" : ""), (uint64_t)"HISTOGRAM",
+                (uint64_t)"COUNT", (uint64_t)"MEAN", (uint64_t)"P50", (uint64_t)"P99", (uint64_t)"MAX", (uint64_t)"UNIT");
+        histograms = true;
+        histogram *h = m->hist;
+        uint64_t count = h->count;
+        shell_printf("%-28s %10u %10u %10u %10u %10u %s\n", (uint64_t)m->name, count, count ? h->sum / count : 0,
+            histogram_percentile(h, 50), histogram_percentile(h, 99), h->max, (uint64_t)m->unit);
+    }
+    if (!values && !histograms)
+        shell_printf("No metrics under %s\n", (uint64_t)group);
+}
+
+static void cmd_metrics(uint32_t argc, char **argv) {
+    print_group(argc > 1 ? argv[1] : "");
+}
+
+static void cmd_virtqueue(uint32_t argc, char **argv) {
+    print_group("virtq");
+}
+
+static void cmd_trace(uint32_t argc, char **argv) {
+    if (argc > 1 && word_equals(argv[1], "start")) {
+        trace_start(TRACE_ALL);
+        shell_printf("Tracing started\n");
+    } else if (argc > 1 && word_equals(argv[1], "stop")) {
+        trace_dump();
+    } else {
+        shell_printf("Tracing is %s, use trace start or trace stop, which dumps the trace\n", (uint64_t)(trace_active() ? "on" : "off"));
+    }
+}
+
+static void cmd_help(uint32_t argc, char **argv);
+
+static const struct {
+    const char *name;
+    const char *help;
+    void (*run)(uint32_t argc, char **argv);
+} commands[] = {
+    { "help", "List the commands", cmd_help },
+    { "ps", "Processes and the CPU time they used", cmd_ps },
+    { "trace", "start, or stop and dump the event trace", cmd_trace },
+    { "metrics", "[group] Every metric, or those of one group", cmd_metrics },
+    { "virtqueue", "Virtqueue depths and command latencies, the virtq group", cmd_virtqueue },
+};
+
+#define SHELL_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static void cmd_help(uint32_t argc, char **argv) {
+    for (uint32_t i = 0; i < SHELL_COMMANDS; i++)
+        shell_printf("%-10s %s\n", (uint64_t)commands[i].name, (uint64_t)commands[i].help);
+    shell_printf("Metric groups, each one is a command as well:");
+    for (metric *m = metric_first(); m; m = m->next) {
+        uint32_t len = 0;
+        while (m->name[len] && m->name[len] != '.') len++;
+        bool seen = false;
+        for (metric *other = metric_first(); other != m && !seen; other = other->next) {
+            uint32_t other_len = 0;
+            while (other->name[other_len] && other->name[other_len] != '.') other_len++;
+            seen = other_len == len && memcmp(other->name, m->name, len) == 0;
+        }
+        if (seen) continue;
+        char group[32];
+        format_buffer(group, len + 1 < sizeof(group) ? len + 1 : sizeof(group), "%s", (uint64_t)m->name);
+        shell_printf(" %s", (uint64_t)group);
+    }
+    shell_printf("\n");
+}
+
+static void shell_run(char *line) {
+    char *argv[SHELL_ARGS_MAX];
+    uint32_t argc = 0;
+    for (char *c = line; *c && argc < SHELL_ARGS_MAX; ) {
+        while (*c == ' ' || *c == '\t' || *c == '\n') *c++ = 0;
+        if (!*c) break;
+        argv[argc++] = c;
+        while (*c && *c != ' ' && *c != '\t' && *c != '\n') c++;
+    }
+    if (!argc) return;
+
+    for (uint32_t i = 0; i < SHELL_COMMANDS; i++) {
+        if (word_equals(argv[0], commands[i].name)) {
+            commands[i].run(argc, argv);
+            return;
+        }
+    }
+    for (metric *m = metric_first(); m; m = m->next) {
+        if (metric_in_group(m, argv[0])) {
+            print_group(argv[0]);
+            return;
+        }
+    }
+    shell_printf("Unknown command %s, try help\n", (uint64_t)argv[0]);
+}
+
+static uint32_t shell_read_line(char *buf, uint32_t size) {
+    /*
+    Blocks until the line discipline has a complete line. Interrupts are masked between the empty read
+    and going to sleep, so a line that completes in between still wakes the shell.
+    */
+    while (1) {
+        uint64_t flags = irq_save();
+        uint64_t n = tty_read(buf, size - 1);
+        if (!n) {
+            tty_wait(get_current_proc());
+            sleep_current_proc();
+        }
+        irq_restore(flags);
+        if (n) {
+            buf[n] = 0;
+            return n;
+        }
+    }
+}
+
+void kshell() {
+    /*
+    This function is the shell process. It prompts, reads a line and runs it, forever.
+    */
+    enable_interrupt();
+    char line[SHELL_LINE_MAX];
+    while (1) {
+        shell_printf("kshell> ");
+        shell_read_line(line, sizeof(line));
+        shell_run(line);
+    }
+}
+
+void start_kshell() {
+    create_kernel_process(kshell, 0);
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "types.h"
+
+void start_kshell();
@@ -0,0 +1,163 @@
+/*
+kernel/kernel_processes/latency_test.c
+This file implements the interrupt latency self-test, built in with `make LATENCY_TEST=1`.
+A test process arms a one-shot timer for a known counter value and records how long it took
+for the interrupt to enter the kernel, to reach its handler, and for the waiting process to resume.
+A second process generates background load (a logging storm, allocator stress) while samples are taken.
+Results are printed over serial as min, median, p99 and max in nanoseconds.
+*/
+#include "latency_test.h"
+#include "process/kprocess_loader.h"
+#include "process/scheduler.h"
+#include "console/kio.h"
+#include "hrtimer.h"
+#include "gic.h"
+#include "ram_e.h"
+
+#define LATENCY_SAMPLES 512
+#define LATENCY_DELAY_MIN_NS (200 * NSEC_PER_USEC)
+#define LATENCY_DELAY_SPREAD_NS (800 * NSEC_PER_USEC) // Randomised so samples do not line up with the scheduler tick
+
+typedef enum {
+    LOAD_IDLE,
+    LOAD_LOGGING,
+    LOAD_ALLOCATOR,
+    LOAD_COUNT,
+} latency_load;
+
+static const char *load_names[LOAD_COUNT] = { "idle", "logging", "allocator" };
+
+static hrtimer latency_timer;
+static volatile bool fired;
+static volatile uint64_t entry_ticks;
+static volatile uint64_t handler_ticks;
+static volatile latency_load current_load = LOAD_IDLE;
+static int test_pid;
+
+static uint64_t entry_samples[LATENCY_SAMPLES];
+static uint64_t handler_samples[LATENCY_SAMPLES];
+static uint64_t resume_samples[LATENCY_SAMPLES];
+
+static uint64_t seed = 0x9E3779B97F4A7C15;
+
+static uint64_t next_random() {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return seed >> 33;
+}
+
+static irq_result latency_timer_handler(hrtimer *timer, void *ctx) {
+    /*
+    Record when the interrupt entered the kernel and when its handler started.
+    If the test process was not the one interrupted, switch to it so its resume time includes the context switch.
+    */
+    handler_ticks = timer_counter();
+    entry_ticks = irq_entry_ticks();
+    fired = true;
+    return get_current_proc() == test_pid ? IRQ_HANDLED : IRQ_RESCHEDULE;
+}
+
+static void sort_samples(uint64_t *samples, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint64_t v = samples[i];
+        uint32_t j = i;
+        while (j > 0 && samples[j - 1] > v) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = v;
+    }
+}
+
+static void print_stats(const char *load, const char *name, uint64_t *samples, uint32_t count) {
+    /*
+    Sort the samples and print min, median, p99 and max in nanoseconds.
+    */
+    sort_samples(samples, count);
+    kprintf_raw("[LATENCY] %s %s min %i median %i p99 %i max %i ns",
+        (uint64_t)load, (uint64_t)name,
+        ticks_to_ns(samples[0]),
+        ticks_to_ns(samples[count / 2]),
+        ticks_to_ns(samples[(count * 99) / 100]),
+        ticks_to_ns(samples[count - 1]));
+}
+
+static void run_phase(latency_load load) {
+    /*
+    Take LATENCY_SAMPLES samples under the given background load.
+    Under load the test process yields after arming the timer, so the interrupt usually lands in the load process.
+    */
+    current_load = load;
+    for (uint32_t i = 0; i < LATENCY_SAMPLES; i++) {
+        fired = false;
+        uint64_t delay = LATENCY_DELAY_MIN_NS + (next_random() % LATENCY_DELAY_SPREAD_NS);
+        uint64_t deadline = timer_counter() + ns_to_ticks(delay);
+        hrtimer_start_at(&latency_timer, deadline);
+        if (load != LOAD_IDLE)
+            yield_proc();
+        while (!fired)
+            asm volatile ("wfi");
+        uint64_t resumed = timer_counter();
+
+        entry_samples[i] = entry_ticks - deadline;
+        handler_samples[i] = handler_ticks - deadline;
+        resume_samples[i] = resumed - deadline;
+    }
+    current_load = LOAD_IDLE;
+
+    print_stats(load_names[load], "entry", entry_samples, LATENCY_SAMPLES);
+    print_stats(load_names[load], "handler", handler_samples, LATENCY_SAMPLES);
+    print_stats(load_names[load], "resume", resume_samples, LATENCY_SAMPLES);
+}
+
+void latency_test() {
+    /*
+    This function is the test process. It runs one phase per background load and then idles.
+    */
+    enable_interrupt();
+    hrtimer_setup(&latency_timer, latency_timer_handler, 0, HRTIMER_VIRTUAL);
+    kprintf_raw("[LATENCY] %i samples per load, counter deltas from the programmed deadline", LATENCY_SAMPLES);
+    for (int load = 0; load < LOAD_COUNT; load++)
+        run_phase(load);
+    irq_debug_print();
+    kprintf_raw("[LATENCY] Done");
+    while (1)
+        asm volatile ("wfi");
+}
+
+void latency_load_process() {
+    /*
+    This function is the background load process. It generates whatever load the test process asked for.
+    */
+    enable_interrupt();
+    uint64_t n = 0;
+    while (1) {
+        switch (current_load) {
+            case LOAD_LOGGING:
+                kprintf("[LATENCY] Logging storm %i", n++);
+                break;
+            case LOAD_ALLOCATOR: {
+                uint64_t size = 16 + (next_random() % 1024);
+                void *p = (void*)talloc(size);
+                if (p) {
+                    memset(p, 0xAA, size);
+                    temp_free(p, size);
+                }
+                break;
+            }
+            default:
+                asm volatile ("wfi");
+                break;
+        }
+    }
+}
+
+void start_latency_test() {
+    /*
+    This function creates the test and load processes. The test process must be created first,
+    so the round-robin scheduler switches straight from the load process back to it.
+    */
+    process_t *test = create_kernel_process(latency_test, 0);
+    if (!test) return;
+    test_pid = test->id;
+    create_kernel_process(latency_load_process, 0);
+}
@@ -3,6 +3,8 @@ kernel/string.c
 This file provides basic string manipulation functions for the kernel. It includes
 functions to create strings from literals, characters, and hexadecimal values.
 It also provides string comparison and formatted string creation capabilities.
+Formatting streams through a sink callback or into a caller buffer and never allocates,
+so kprintf, the panic screen and user printf (through the printf syscall) all share it.
 */
 #include "kstring.h"
 #include "ram_e.h"
@@ -92,67 +94,196 @@ bool string_equals(kstring a, kstring b) {
     return strcmp(a.data,b.data) == 0;
 }
 
-kstring string_format_args(const char *fmt, const uint64_t *args, uint32_t arg_count) {
+#define FORMAT_CHUNK 64
+
+typedef struct {
+    format_sink sink;
+    void *ctx;
+    char chunk[FORMAT_CHUNK]; // Output is batched so the sink is called once per chunk, not per character
+    uint32_t used;
+    uint64_t total;
+} format_state;
+
+static void format_flush(format_state *st) {
+    if (st->used) {
+        st->sink(st->ctx, st->chunk, st->used);
+        st->used = 0;
+    }
+}
+
+static void format_put(format_state *st, char c) {
+    if (st->used == FORMAT_CHUNK)
+        format_flush(st);
+    st->chunk[st->used++] = c;
+    st->total++;
+}
+
+static void format_pad(format_state *st, char c, int32_t count) {
+    while (count-- > 0)
+        format_put(st, c);
+}
+
+static void format_field(format_state *st, const char *prefix, const char *body, uint32_t body_len, uint32_t width, bool left, bool zero) {
     /*
-    This function creates a formatted string using a format specifier and a list of arguments.
-    It supports format specifiers such as %h (hex), %c (char), %s (string), and %i (integer).
-    Example usage: string_format_args("Value: %h", [255], 1) would create a string with data "Value: 0xFF".
+    Write a prefix (sign or 0x) and body padded to width. Zero padding goes between the prefix and the body.
     */
-    char *buf = (char*)talloc(256);
+    uint32_t prefix_len = compute_length(prefix, 0);
+    int32_t padding = (int32_t)width - (int32_t)(prefix_len + body_len);
+    if (!left && !zero) format_pad(st, ' ', padding);
+    for (uint32_t i = 0; i < prefix_len; i++) format_put(st, prefix[i]);
+    if (!left && zero) format_pad(st, '0', padding);
+    for (uint32_t i = 0; i < body_len; i++) format_put(st, body[i]);
+    if (left) format_pad(st, ' ', padding);
+}
+
+static uint32_t format_digits(char *out, uint64_t value, uint32_t base, bool upper, uint32_t min_digits) {
+    /*
+    Convert a value to digits in the given base, most significant first. Returns the number of digits.
+    */
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char temp[64];
     uint32_t len = 0;
+    do {
+        temp[len++] = digits[value % base];
+        value /= base;
+    } while (value);
+    while (len < min_digits)
+        temp[len++] = '0';
+    for (uint32_t i = 0; i < len; i++)
+        out[i] = temp[len - 1 - i];
+    return len;
+}
+
+static bool format_is_conversion(char type) {
+    const char *types = "idluxhpcs";
+    for (uint32_t i = 0; types[i]; i++)
+        if (types[i] == type) return true;
+    return false;
+}
+
+uint64_t format_args(format_sink sink, void *ctx, const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    /*
+    This function formats a string and streams it to a sink, without allocating memory.
+    Conversions take the form %[-][0][width][l]type, where - aligns left, 0 pads numbers with zeros,
+    and l is accepted for familiarity, as every argument is 64 bits already. Types are:
+    %i %d %l signed decimal, %u unsigned decimal, %x lowercase hex, %h 0x-prefixed uppercase hex (the kernel's usual),
+    %p pointer, %c character, %s string and %% a literal percent sign.
+    A conversion without a matching argument ends the output, and an unknown one is printed as is
+    without taking an argument. Returns the number of characters produced.
+    Example usage: format_args(uart_sink, 0, "%-8s|%04x", args, 2); with args {"id", 0x2A} would produce "id      |002a".
+    */
+    format_state st = { .sink = sink, .ctx = ctx, .used = 0, .total = 0 };
     uint32_t arg_index = 0;
 
-    for (uint32_t i = 0; fmt[i] && len < 255; i++) {
-        if (fmt[i] == '%' && fmt[i+1]) {
-            i++;
-            if (arg_index >= arg_count) break;
-            if (fmt[i] == 'h') {
-                uint64_t val = args[arg_index++];
-                kstring hex = string_from_hex(val);
-                for (uint32_t j = 0; j < hex.length && len < 255; j++) buf[len++] = hex.data[j];
-                temp_free(hex.data, 18);
-            } else if (fmt[i] == 'c') {
-                uint64_t val = args[arg_index++];
-                buf[len++] = (char)val;
-            } else if (fmt[i] == 's') {
-                const char *str = (const char *)(uintptr_t)args[arg_index++];
-                for (uint32_t j = 0; str[j] && len < 255; j++) buf[len++] = str[j];
-            } else if (fmt[i] == 'i') {
-                uint64_t val = args[arg_index++];
-                char temp[21];
-                uint32_t temp_len = 0;
-                bool negative = false;
-
-                if ((int)val < 0) {
-                    negative = true;
-                    val = (uint64_t)(-(int)val);
-                }
-
-                do {
-                    temp[temp_len++] = '0' + (val % 10);
-                    val /= 10;
-                } while (val && temp_len < 20);
-
-                if (negative && len < 20) {
-                    temp[temp_len++] = '-';
-                }
-
-                for (int j = temp_len - 1; j >= 0 && len < 255; j--) {
-                    buf[len++] = temp[j];
-                }
-            } else if (fmt[i] == 's') {
-                const char *str = (const char *)(uintptr_t)args[arg_index++];
-                for (uint32_t j = 0; str[j] && len < 255; j++) buf[len++] = str[j];
-            } else {
-                buf[len++] = '%';
-                buf[len++] = fmt[i];
+    for (uint32_t i = 0; fmt[i]; i++) {
+        if (fmt[i] != '%' || !fmt[i+1]) {
+            format_put(&st, fmt[i]);
+            continue;
+        }
+        i++;
+
+        bool left = false, zero = false;
+        for (;; i++) {
+            if (fmt[i] == '-') left = true;
+            else if (fmt[i] == '0') zero = true;
+            else break;
+        }
+        uint32_t width = 0;
+        while (fmt[i] >= '0' && fmt[i] <= '9')
+            width = width * 10 + (fmt[i++] - '0');
+        char type = fmt[i];
+        if (type == 'l' && (fmt[i+1] == 'i' || fmt[i+1] == 'd' || fmt[i+1] == 'u' || fmt[i+1] == 'x'))
+            type = fmt[++i]; // %li and friends
+        if (!type) break;
+
+        if (type == '%') {
+            format_put(&st, '%');
+            continue;
+        }
+        if (!format_is_conversion(type)) {
+            format_put(&st, '%');
+            format_put(&st, type);
+            continue;
+        }
+        if (arg_index >= arg_count) break;
+        uint64_t val = args[arg_index++];
+
+        char digits[64];
+        uint32_t len;
+        switch (type) {
+            case 'i':
+            case 'd':
+            case 'l': {
+                bool negative = (int64_t)val < 0;
+                len = format_digits(digits, negative ? -(uint64_t)val : val, 10, false, 0);
+                format_field(&st, negative ? "-" : "", digits, len, width, left, zero);
+                break;
+            }
+            case 'u':
+                len = format_digits(digits, val, 10, false, 0);
+                format_field(&st, "", digits, len, width, left, zero);
+                break;
+            case 'x':
+                len = format_digits(digits, val, 16, false, 0);
+                format_field(&st, "", digits, len, width, left, zero);
+                break;
+            case 'h':
+                len = format_digits(digits, val, 16, true, 0);
+                format_field(&st, "0x", digits, len, width, left, zero);
+                break;
+            case 'p':
+                len = format_digits(digits, val, 16, false, 16);
+                format_field(&st, "0x", digits, len, width, left, false);
+                break;
+            case 'c':
+                digits[0] = (char)val;
+                format_field(&st, "", digits, 1, width, left, false);
+                break;
+            case 's': {
+                const char *str = val ? (const char *)(uintptr_t)val : "(null)";
+                format_field(&st, "", str, compute_length(str, 0), width, left, false);
+                break;
             }
-        } else {
-            buf[len++] = fmt[i];
         }
     }
 
-    buf[len] = 0;
+    format_flush(&st);
+    return st.total;
+}
+
+typedef struct {
+    char *buf;
+    uint32_t size;
+    uint32_t len;
+} buffer_sink_ctx;
+
+static void buffer_sink(void *ctx, const char *s, uint32_t len) {
+    buffer_sink_ctx *b = ctx;
+    for (uint32_t i = 0; i < len && b->len + 1 < b->size; i++)
+        b->buf[b->len++] = s[i];
+}
+
+uint32_t format_buffer_args(char *buf, uint32_t size, const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    /*
+    This function formats a string into a caller provided buffer. The output is truncated to fit
+    and always null terminated. Returns the length written, not counting the terminator.
+    Example usage: char line[64]; uint32_t len = format_buffer_args(line, sizeof(line), "%i items", args, 1);
+    */
+    if (size == 0) return 0;
+    buffer_sink_ctx b = { .buf = buf, .size = size, .len = 0 };
+    format_args(buffer_sink, &b, fmt, args, arg_count);
+    buf[b.len] = 0;
+    return b.len;
+}
+
+kstring string_format_args(const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    /*
+    This function creates a formatted string in a new 256 byte temporary buffer, which the caller frees.
+    Prefer format_buffer_args or format_args, which do not allocate.
+    Example usage: string_format_args("Value: %h", [255], 1) would create a string with data "Value: 0xFF".
+    */
+    char *buf = (char*)talloc(256);
+    uint32_t len = format_buffer_args(buf, 256, fmt, args, arg_count);
     return (kstring){.data = buf, .length = len};
 }
 
@@ -2,6 +2,10 @@
 
 #include "types.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct {
     char *data;
     uint32_t length;
@@ -20,5 +24,20 @@ kstring string_from_hex(uint64_t value);
 bool string_equals(kstring a, kstring b);
 kstring string_format_args(const char *fmt, const uint64_t *args, uint32_t arg_count);
 
+typedef void (*format_sink)(void *ctx, const char *s, uint32_t len);
+
+#define format_buffer(buf, size, fmt, ...) \
+    ({ \
+        uint64_t _args[] = {__VA_ARGS__}; \
+        format_buffer_args((buf), (size), (fmt), _args, sizeof(_args) / sizeof(_args[0])); \
+    })
+
+uint64_t format_args(format_sink sink, void *ctx, const char *fmt, const uint64_t *args, uint32_t arg_count);
+uint32_t format_buffer_args(char *buf, uint32_t size, const char *fmt, const uint64_t *args, uint32_t arg_count);
+
 bool strcmp(const char *a, const char *b);
-bool strcont(const char *a, const char *b);
\ No newline at end of file
+bool strcont(const char *a, const char *b);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
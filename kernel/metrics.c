@@ -0,0 +1,113 @@
+/*
+kernel/metrics.c
+This file implements the metrics registry. Subsystems publish named counters, gauges and histograms once,
+usually at init, and keep updating them in place. Readers such as the kernel shell walk the registry,
+so a new metric shows up without any change on their side.
+Histograms have power of two buckets, so recording a value is a count of leading zeros and three atomic adds,
+and percentiles are reported as the upper bound of the bucket they fall in.
+*/
+#include "metrics.h"
+#include "gic.h"
+
+static metric *first;
+static metric *last;
+
+void metric_register(metric *m) {
+    /*
+    This function adds a metric to the registry, after the ones already there. A metric is registered once.
+    Example usage: static metric switches = METRIC_COUNTER_INIT("sched.switches", "switches"); metric_register(&switches);
+    */
+    uint64_t flags = irq_save();
+    m->next = 0;
+    if (last)
+        last->next = m;
+    else
+        first = m;
+    last = m;
+    irq_restore(flags);
+}
+
+metric* metric_first() {
+    /*
+    This function returns the oldest registered metric, the others follow through next.
+    Metrics are never removed, so the list can be walked while others are being registered.
+    */
+    return first;
+}
+
+metric* metric_find(const char *name) {
+    for (metric *m = first; m; m = m->next) {
+        uint32_t i = 0;
+        while (name[i] && name[i] == m->name[i]) i++;
+        if (name[i] == 0 && m->name[i] == 0)
+            return m;
+    }
+    return 0;
+}
+
+bool metric_in_group(const metric *m, const char *group) {
+    /*
+    This function tells whether the metric is named group or group followed by a dot and more.
+    The empty group holds every metric.
+    Example usage: metric_in_group(m, "irq") is true for "irq.33" but not for "irqs".
+    */
+    if (!group[0])
+        return true;
+    uint32_t i = 0;
+    while (group[i]) {
+        if (m->name[i] != group[i])
+            return false;
+        i++;
+    }
+    return m->name[i] == 0 || m->name[i] == '.';
+}
+
+uint64_t metric_value(const metric *m) {
+    /*
+    This function returns the current value of a counter or gauge, and the number of observations of a histogram.
+    */
+    switch (m->type) {
+        case METRIC_COUNTER: return m->value;
+        case METRIC_GAUGE: return m->read ? m->read(m->ctx) : 0;
+        case METRIC_HISTOGRAM: return m->hist->count;
+    }
+    return 0;
+}
+
+void histogram_observe(histogram *h, uint64_t value) {
+    /*
+    This function records one value. It is safe from interrupt handlers and processes at the same time.
+    Example usage: histogram_observe(&slice_hist, ticks_to_ns(ran) / NSEC_PER_USEC);
+    */
+    uint32_t bucket = value ? 64 - __builtin_clzll(value) : 0;
+    if (bucket >= METRIC_BUCKETS)
+        bucket = METRIC_BUCKETS - 1;
+    __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    uint64_t max = h->max;
+    while (value > max && !__atomic_compare_exchange_n(&h->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+uint64_t histogram_percentile(const histogram *h, uint32_t percent) {
+    /*
+    This function returns an upper bound for the given percentile, the top of the bucket it falls in,
+    and never more than the largest value observed. It returns 0 for an empty histogram.
+    Example usage: uint64_t p99 = histogram_percentile(&hist, 99);
+    */
+    uint64_t count = h->count;
+    if (!count) return 0;
+    uint64_t rank = (count * percent + 99) / 100;
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < METRIC_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t top = b == 0 ? 0 : (1ULL << b) - 1;
+            if (b == METRIC_BUCKETS - 1 || top > h->max)
+                top = h->max;
+            return top;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRIC_COUNTER 0 // Monotonic count, updated with metric_add
+#define METRIC_GAUGE 1 // Current value, read through a callback when displayed
+#define METRIC_HISTOGRAM 2 // Distribution of observed values, updated with metric_observe
+
+#define METRIC_BUCKETS 32 // Bucket 0 counts zeros and bucket b values from 2^(b-1) to 2^b - 1, the last one also everything above
+
+typedef struct {
+    volatile uint64_t count;
+    volatile uint64_t sum;
+    volatile uint64_t max;
+    volatile uint64_t buckets[METRIC_BUCKETS];
+} histogram;
+
+typedef struct metric {
+    /*
+    A named value published by a subsystem. Names are dotted, and the first part is the subsystem,
+    e.g. "irq.33" or "sched.slice", which is how the shell groups them.
+    The metric and its name must outlive the registry, so they are usually static.
+    */
+    const char *name;
+    const char *unit;
+    uint32_t type;
+    volatile uint64_t value; // METRIC_COUNTER
+    uint64_t (*read)(void *ctx); // METRIC_GAUGE
+    void *ctx;
+    histogram *hist; // METRIC_HISTOGRAM
+    struct metric *next;
+} metric;
+
+#define METRIC_COUNTER_INIT(name_, unit_) { .name = (name_), .unit = (unit_), .type = METRIC_COUNTER }
+#define METRIC_GAUGE_INIT(name_, unit_, read_, ctx_) { .name = (name_), .unit = (unit_), .type = METRIC_GAUGE, .read = (read_), .ctx = (ctx_) }
+#define METRIC_HISTOGRAM_INIT(name_, unit_, hist_) { .name = (name_), .unit = (unit_), .type = METRIC_HISTOGRAM, .hist = (hist_) }
+
+void metric_register(metric *m);
+metric* metric_first();
+metric* metric_find(const char *name);
+bool metric_in_group(const metric *m, const char *group);
+uint64_t metric_value(const metric *m);
+uint64_t histogram_percentile(const histogram *h, uint32_t percent);
+void histogram_observe(histogram *h, uint64_t value);
+
+/*
+Counter update. It is a single relaxed atomic add, cheap enough for hot paths.
+Example usage: metric_add(&talloc_calls, 1);
+*/
+static inline void metric_add(metric *m, uint64_t n) {
+    __atomic_fetch_add(&m->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_observe(metric *m, uint64_t value) {
+    histogram_observe(m->hist, value);
+}
+
+#ifdef __cplusplus
+}
+#endif
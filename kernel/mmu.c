@@ -13,11 +13,14 @@ Example attributes include device memory and normal memory.
 #include "gic.h"
 #include "dtb.h"
 #include "filesystem/disk.h"
+#include "pci.h"
 
 #define MAIR_DEVICE_nGnRnE 0b00000000 // Device-nGnRnE is 0b00000000 | nGnRnE is "non-Gathering, non-Reordering, no Early write acknowledgment"
 #define MAIR_NORMAL_NOCACHE 0b01000100 // Normal memory, Non-cacheable is 0b01000100
+#define MAIR_NORMAL_WRITEBACK 0b11111111 // Normal memory, Write-Back Read/Write-Allocate, inner and outer
 #define MAIR_IDX_DEVICE 0 // 0 for device memory
-#define MAIR_IDX_NORMAL 1 // 1 for normal memory
+#define MAIR_IDX_NORMAL 1 // 1 for normal memory. Normal non-cacheable lets stores gather, so it also serves as write-combining for framebuffers
+#define MAIR_IDX_CACHED 2 // 2 for buffers only the CPU touches, such as a back buffer. No device reads them, so no cache maintenance is needed
 
 #define PD_TABLE 0b11 // Table entry 
 #define PD_BLOCK 0b01 // Block entry
@@ -29,9 +32,17 @@ Example attributes include device memory and normal memory.
 #define GRANULE_4KB 0x1000 // 4KB granule size
 #define GRANULE_2MB 0x200000 // 2MB granule size
 
-uint64_t page_table_l1[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE))); // Level 1 page table is aligned to 4KB boundary
+#define CACHED_REGIONS 4
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} cached_region;
 
-static bool mmu_verbose;
+static cached_region cached_regions[CACHED_REGIONS];
+static uint32_t cached_region_count;
+
+uint64_t page_table_l1[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE))); // Level 1 page table is aligned to 4KB boundary
 
 void mmu_map_2mb(uint64_t va, uint64_t pa, uint64_t attr_index) { // Map a 2MB page from virtual address va to physical address pa
     // Calculate indices for L1, L2, and L3 tables by shifting and masking the virtual address
@@ -39,8 +50,7 @@ void mmu_map_2mb(uint64_t va, uint64_t pa, uint64_t attr_index) { // Map a 2MB p
     uint64_t l2_index = (va >> 30) & 0x1FF;
     uint64_t l3_index = (va >> 21) & 0x1FF;
 
-    if (mmu_verbose)
-        kprintf_raw("Mapping 2mb memory %h at [%i][%i][%i] for EL1", va, l1_index, l2_index, l3_index);
+    klog_debug(KLOG_SYS_MMU, "Mapping 2mb memory %h at [%i][%i][%i] for EL1", va, l1_index, l2_index, l3_index);
 
     if (!(page_table_l1[l1_index] & 1)) { // Check if L2 table exists
         // Allocate L2 table
@@ -114,16 +124,47 @@ void mmu_map_4kb(uint64_t va, uint64_t pa, uint64_t attr_index, int level) { //
             break;
     }
     uint64_t attr = ((level == 1) << 54) | (0 << 53) | PD_ACCESS | (0b11 << 8) | (permission << 6) | (attr_index << 2) | 0b11;
-    if (mmu_verbose)
-        kprintf_raw("Mapping 4kb memory %h at [%i][%i][%i][%i] for EL%i = %h permission: %i", va, l1_index, l2_index, l3_index, l4_index, level, attr, permission);
+    klog_debug(KLOG_SYS_MMU, "Mapping 4kb memory %h at [%i][%i][%i][%i] for EL%i = %h permission: %i", va, l1_index, l2_index, l3_index, l4_index, level, attr, permission);
 
     l4[l4_index] = (pa & 0xFFFFFFFFF000ULL) | attr; // Set L4 entry to map 4KB page
 }
 
+static bool cached_overlaps(uint64_t start, uint64_t end) {
+    for (uint32_t i = 0; i < cached_region_count; i++)
+        if (start < cached_regions[i].end && cached_regions[i].start < end)
+            return true;
+    return false;
+}
+
+static void map_kernel_pages(uint64_t block) {
+    /*
+    Maps a 2MB block of kernel memory page by page, cacheable where a registered region covers the page.
+    */
+    uint8_t old_level = klog_levels[KLOG_SYS_MMU];
+    klog_set_level(KLOG_SYS_MMU, KLOG_INFO);
+    for (uint64_t addr = block; addr < block + GRANULE_2MB; addr += GRANULE_4KB)
+        mmu_map_4kb(addr, addr, cached_overlaps(addr, addr + GRANULE_4KB) ? MAIR_IDX_CACHED : MAIR_IDX_NORMAL, 1);
+    klog_set_level(KLOG_SYS_MMU, old_level);
+}
+
+void register_cached_memory(uint64_t pa, uint64_t size) {
+    /*
+    This function asks for a range of kernel memory to be mapped write-back cacheable instead of non-cacheable.
+    It is meant for buffers only the CPU reads and writes, since nothing here cleans the cache for devices.
+    It must be called before mmu_init, which maps the range.
+    Example usage: register_cached_memory(back_buffer, stride * height);
+    */
+    if (cached_region_count == CACHED_REGIONS) {
+        kprintf("[MMU] No room to map %h as cacheable", pa);
+        return;
+    }
+    cached_regions[cached_region_count++] = (cached_region){ pa & ~(GRANULE_4KB - 1), (pa + size + GRANULE_4KB - 1) & ~(GRANULE_4KB - 1) };
+}
+
 void mmu_init() {
     /*
     This function initializes the MMU by setting up the page tables and enabling the MMU.
-    It maps the kernel memory region, UART, and GIC as device memory.
+    It maps the kernel memory region, UART, GIC and the PCI BARs as device memory.
     It configures the MAIR and TCR registers and enables the MMU in SCTLR_EL1.
     MAIR - Memory Attribute Indirection Register
     TCR - Translation Control Register
@@ -135,8 +176,12 @@ void mmu_init() {
 
     uint64_t kstart = mem_get_kmem_start();
     uint64_t kend = mem_get_kmem_end();
-    for (uint64_t addr = kstart; addr <= kend; addr += GRANULE_2MB)
-        mmu_map_2mb(addr, addr, MAIR_IDX_NORMAL); // Map kernel memory as normal memory
+    for (uint64_t addr = kstart; addr <= kend; addr += GRANULE_2MB) {
+        if (cached_overlaps(addr, addr + GRANULE_2MB))
+            map_kernel_pages(addr); // Blocks holding a cacheable buffer are split to map it exactly
+        else
+            mmu_map_2mb(addr, addr, MAIR_IDX_NORMAL); // Map kernel memory as normal memory
+    }
 
     for (uint64_t addr = UART0_BASE; addr <= UART0_BASE; addr += GRANULE_4KB)
         mmu_map_4kb(addr, addr, MAIR_IDX_DEVICE, 1); // Map UART as device memory
@@ -144,6 +189,14 @@ void mmu_init() {
     for (uint64_t addr = GICD_BASE; addr <= GICD_BASE + 0x12000; addr += GRANULE_4KB)
         mmu_map_4kb(addr, addr, MAIR_IDX_DEVICE, 1); // Map GIC as device memory
 
+    mmu_map_4kb(GICV2M_BASE, GICV2M_BASE, MAIR_IDX_DEVICE, 1); // Map the MSI frame as device memory
+
+    uint64_t pci_start;
+    uint64_t pci_end;
+    pci_get_mmio_range(&pci_start, &pci_end);
+    for (uint64_t addr = pci_start; addr < pci_end; addr += GRANULE_4KB)
+        mmu_map_4kb(addr, addr, MAIR_IDX_DEVICE, 1); // Map assigned PCI BARs as device memory
+
     for (uint64_t addr = get_shared_start(); addr <= get_shared_end(); addr += GRANULE_4KB)
         mmu_map_4kb(addr, addr, MAIR_IDX_NORMAL, 2); // Map shared memory as normal memory
 
@@ -159,21 +212,22 @@ void mmu_init() {
     for (uint64_t addr = diskstart; addr <= diskstart + disksize; addr += GRANULE_4KB)
         mmu_map_4kb(addr, addr, MAIR_IDX_DEVICE, 1); // Map Disk device as device memory
 
-    uint64_t mair = (MAIR_DEVICE_nGnRnE << (MAIR_IDX_DEVICE * 8)) | (MAIR_NORMAL_NOCACHE << (MAIR_IDX_NORMAL * 8));
+    uint64_t mair = (MAIR_DEVICE_nGnRnE << (MAIR_IDX_DEVICE * 8)) | (MAIR_NORMAL_NOCACHE << (MAIR_IDX_NORMAL * 8)) | (MAIR_NORMAL_WRITEBACK << (MAIR_IDX_CACHED * 8));
     asm volatile ("msr mair_el1, %0" :: "r"(mair)); // Set MAIR_EL1 register
 
     //30 = Translation granule EL1. 10 = 4KB | 14 = TG EL0 00 = 4KB
     uint64_t tcr = ((64 - 48) << 0) | (64 - 48) << 16 | (0b00 << 14) | (0b10 << 30);
     asm volatile ("msr tcr_el1, %0" :: "r"(tcr)); // Set TCR_EL1 register
 
-    asm volatile ("dsb ish"); // Data Synchronization Barrier
-    asm volatile ("isb"); // Instruction Synchronization Barrier
+    asm volatile ("dsb ish" ::: "memory"); // Data Synchronization Barrier
+    asm volatile ("isb" ::: "memory"); // Instruction Synchronization Barrier
 
     asm volatile ("msr ttbr0_el1, %0" :: "r"(page_table_l1)); // Set TTBR0_EL1 register
 
     asm volatile (
         "mrs x0, sctlr_el1\n"    // Read SCTLR_EL1 register
         "orr x0, x0, #0x1\n"   // Set the M bit to enable MMU
+        "orr x0, x0, #0x4\n"   // Set the C bit, which only affects the pages mapped MAIR_IDX_CACHED
         "bic x0, x0, #(1 << 19)\n" // Clear the I bit to enable instruction cache
         "msr sctlr_el1, x0\n"   // Write back to SCTLR_EL1 register
         "isb\n"                 // Instruction Synchronization Barrier
@@ -187,16 +241,13 @@ void mmu_init() {
 
 }
 
-void mmu_enable_verbose() {
-    mmu_verbose = true;
-}
-
 static inline void mmu_flush_all() {
     asm volatile (
         "dsb ishst\n"           // Ensure all memory accessses completed
         "tlbi vmalle1is\n"      // Invalidate all EL1 TLB entries (Inner Shareable)
         "dsb ish\n"             // Ensure completion of TLB invalidation   
         "isb\n"                 // Synchronize pipeline
+        ::: "memory"
     );
 }
 
@@ -204,6 +255,7 @@ static inline void mmu_flush_icache() {
     asm volatile(
         "ic iallu\n"    // Invalidate all instruction caches to PoU
         "isb\n"         // Ensure completion before continuing
+        ::: "memory"
     );
 }
 
@@ -219,6 +271,22 @@ void register_proc_memory(uint64_t va, uint64_t pa, bool kernel) {
     mmu_flush_icache();
 }
 
+void register_user_framebuffer(uint64_t va, uint64_t pa, uint64_t size) {
+    /*
+    This function maps a framebuffer into the EL0 accessible address space with write-combining attributes.
+    A back buffer the kernel maps cacheable gets the same attributes, so the two mappings stay coherent.
+    Framebuffers span hundreds of pages, so per-page logging is suppressed and the TLB is flushed once at the end.
+    Example usage: register_user_framebuffer(USER_FRAMEBUFFER_VA, fb_base, fb_size);
+    */
+    uint64_t attr_index = cached_overlaps(pa, pa + size) ? MAIR_IDX_CACHED : MAIR_IDX_NORMAL;
+    uint8_t old_level = klog_levels[KLOG_SYS_MMU];
+    klog_set_level(KLOG_SYS_MMU, KLOG_INFO);
+    for (uint64_t offset = 0; offset < size; offset += GRANULE_4KB)
+        mmu_map_4kb(va + offset, pa + offset, attr_index, 0);
+    klog_set_level(KLOG_SYS_MMU, old_level);
+    mmu_flush_all();
+}
+
 void debug_mmu_address(uint64_t va) {
     /*
     This function is used for debugging purposes to print the mapping of a given virtual address.
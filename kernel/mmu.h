@@ -2,8 +2,11 @@
 
 #include "types.h"
 
+#define USER_FRAMEBUFFER_VA 0x1000000000 // Below 2^37, the top of what the page table walk here can index
+
 void mmu_init();
+void register_cached_memory(uint64_t pa, uint64_t size);
 void register_device_memory(uint64_t va, uint64_t pa);
 void register_proc_memory(uint64_t va, uint64_t pa, bool kernel);
-void debug_mmu_address(uint64_t va);
-void mmu_enable_verbose();
\ No newline at end of file
+void register_user_framebuffer(uint64_t va, uint64_t pa, uint64_t size);
+void debug_mmu_address(uint64_t va);
\ No newline at end of file
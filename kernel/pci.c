@@ -10,14 +10,29 @@ and provides functions to read and write PCI configuration registers.
 #include "dma.h"
 #include "fw/fw_cfg.h"
 #include "kstring.h"
+#include "gic.h"
 
 #define PCI_BUS_MAX 256 // 0-255
 #define PCI_SLOT_MAX 32 // 0-31
 #define PCI_FUNC_MAX 8 // 0-7
 
 #define PCI_COMMAND_REGISTER 0x04 // Offset for the Command Register in PCI configuration space
+#define PCI_COMMAND_MEMORY (1 << 1) // Respond to memory space accesses
+#define PCI_COMMAND_BUS_MASTER (1 << 2) // Allow the device to write to memory, which is how MSIs are sent
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+#define PCI_CAPABILITIES_POINTER 0x34
+
+#define PCI_CAP_ID_MSIX 0x11
+#define PCI_MSIX_ENABLE (1 << 15)
+#define PCI_MSIX_FUNCTION_MASK (1 << 14)
+#define PCI_MSIX_ENTRY_SIZE 16
+#define PCI_MSIX_ENTRY_MASKED 1
+
+#define PCI_MMIO_WINDOW_BASE 0x10000000 // 32 bit PCI memory window of the virt board
+#define PCI_MMIO_WINDOW_END  0x3EFF0000
 
 static uint64_t pci_base; // Base address of the PCI configuration space
+static uint64_t pci_mmio_next = PCI_MMIO_WINDOW_BASE; // Next free address for BAR assignment
 
 #define NINIT pci_base == 0x0 // NINIT check macro
 
@@ -224,6 +239,133 @@ uint64_t pci_get_bar_address(uint64_t base, uint8_t offset, uint8_t index){
     return base + offset + (index * 4);
 }
 
+uint64_t pci_setup_bar(uint64_t base, uint8_t index) {
+    /*
+    This function assigns an address to a memory BAR that firmware left unassigned and enables memory access.
+    It probes the BAR size, allocates a naturally aligned range from the PCI memory window, and handles 64 bit BARs.
+    It returns the assigned address, or 0 if the BAR could not be set up.
+    Example usage: uint64_t bar_addr = pci_setup_bar(device_base, 4);
+    */
+    uint64_t bar_addr = pci_get_bar_address(base, 0x10, index);
+    uint32_t original = read32(bar_addr);
+    bool is_64 = ((original >> 1) & 0x3) == 0x2;
+
+    write32(bar_addr, 0xFFFFFFFF);
+    uint32_t bar_val = read32(bar_addr);
+
+    if (bar_val == 0 || bar_val == 0xFFFFFFFF) {
+        kprintf("BAR size probing failed");
+        return 0;
+    }
+
+    uint64_t size = ((uint64_t)(~(bar_val & ~0xF)) + 1) & 0xFFFFFFFF;
+    uint64_t addr = (pci_mmio_next + size - 1) & ~(size - 1);
+    if (addr + size > PCI_MMIO_WINDOW_END) {
+        kprintf("PCI memory window exhausted");
+        return 0;
+    }
+    pci_mmio_next = addr + size;
+
+    write32(bar_addr, addr & 0xFFFFFFFF);
+    if (is_64)
+        write32(bar_addr + 4, 0);
+
+    kprintf("Assigned BAR %i at %h size %h", index, addr, size);
+
+    uint32_t cmd = read32(base + PCI_COMMAND_REGISTER);
+    cmd |= PCI_COMMAND_MEMORY;
+    write32(base + PCI_COMMAND_REGISTER, cmd);
+
+    return addr;
+}
+
+void pci_get_mmio_range(uint64_t *start, uint64_t *end) {
+    /*
+    This function returns the range of the PCI memory window that has been assigned to BARs,
+    so it can be mapped as device memory.
+    */
+    *start = PCI_MMIO_WINDOW_BASE;
+    *end = pci_mmio_next;
+}
+
+uint16_t pci_find_capability(uint64_t base, uint8_t cap_id) {
+    /*
+    This function walks the capability list of a device and returns the offset of the first capability
+    with the given ID, or 0 if the device does not have it.
+    Example usage: pci_find_capability(device_base, 0x11) would find the MSI-X capability.
+    */
+    uint8_t offset = read8(base + PCI_CAPABILITIES_POINTER) & ~0x3;
+    while (offset) {
+        if (read8(base + offset) == cap_id)
+            return offset;
+        offset = read8(base + offset + 1) & ~0x3;
+    }
+    return 0;
+}
+
+bool pci_msix_init(uint64_t base, pci_msix *msix) {
+    /*
+    This function enables MSI-X on a device. It finds the capability, maps the vector table,
+    masks every vector, and turns off the legacy INTx line.
+    Vectors are then routed one by one with pci_msix_route.
+    Returns false if the device has no MSI-X or the platform has no MSI frame.
+    */
+    if (!gic_msi_available()) return false;
+
+    uint16_t cap = pci_find_capability(base, PCI_CAP_ID_MSIX);
+    if (!cap) return false;
+
+    uint16_t control = read16(base + cap + 2);
+    uint32_t table = read32(base + cap + 4);
+    uint8_t bir = table & 0x7;
+
+    uint64_t bar = read32(pci_get_bar_address(base, 0x10, bir)) & ~0xF;
+    if (bar == 0)
+        bar = pci_setup_bar(base, bir);
+    if (bar == 0) return false;
+
+    msix->device = base;
+    msix->cap = cap;
+    msix->table = bar + (table & ~0x7);
+    msix->table_size = (control & 0x7FF) + 1;
+
+    for (uint16_t i = 0; i < msix->table_size; i++)
+        write32(msix->table + i * PCI_MSIX_ENTRY_SIZE + 12, PCI_MSIX_ENTRY_MASKED);
+
+    uint32_t cmd = read32(base + PCI_COMMAND_REGISTER);
+    cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER | PCI_COMMAND_INTX_DISABLE;
+    write32(base + PCI_COMMAND_REGISTER, cmd);
+
+    write16(base + cap + 2, (control | PCI_MSIX_ENABLE) & ~PCI_MSIX_FUNCTION_MASK);
+
+    kprintf("MSI-X enabled with %i vectors, table at %h", msix->table_size, msix->table);
+    return true;
+}
+
+uint32_t pci_msix_route(pci_msix *msix, uint16_t vector, irq_handler handler, void *ctx) {
+    /*
+    This function allocates an SPI from the GICv2m frame, points an MSI-X vector at it,
+    registers the handler and unmasks the vector.
+    Returns the IRQ number the vector was routed to, or 0 on failure.
+    Example usage: pci_msix_route(&msix, 1, queue_irq, 0); would deliver vector 1 to queue_irq.
+    */
+    if (vector >= msix->table_size) return 0;
+
+    uint32_t irq = gic_alloc_msi();
+    if (!irq) return 0;
+
+    if (!request_irq(irq, handler, ctx, IRQ_TRIGGER_EDGE)) return 0;
+
+    uint64_t entry = msix->table + vector * PCI_MSIX_ENTRY_SIZE;
+    uint64_t doorbell = gic_msi_doorbell();
+    write32(entry + 0, doorbell & 0xFFFFFFFF);
+    write32(entry + 4, doorbell >> 32);
+    write32(entry + 8, irq);
+    write32(entry + 12, 0); // Unmask
+
+    return irq;
+}
+
 void debug_read_bar(uint64_t base, uint8_t offset, uint8_t index){
     uint64_t addr = pci_get_bar_address(base, offset, index);
     uint64_t val = read32(addr);
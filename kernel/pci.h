@@ -2,10 +2,24 @@
 #define PCI_H
 
 #include "types.h"
+#include "irq.h"
+
+typedef struct {
+    uint64_t device; // Configuration space of the device
+    uint64_t table; // Address of the MSI-X vector table
+    uint16_t table_size;
+    uint16_t cap;
+} pci_msix;
 
 uint64_t find_pci_device(uint32_t vendor_id, uint32_t device_id);
 
 uint64_t pci_get_bar_address(uint64_t base, uint8_t offset, uint8_t index);
+uint64_t pci_setup_bar(uint64_t base, uint8_t index);
+void pci_get_mmio_range(uint64_t *start, uint64_t *end);
+uint16_t pci_find_capability(uint64_t base, uint8_t cap_id);
+
+bool pci_msix_init(uint64_t base, pci_msix *msix);
+uint32_t pci_msix_route(pci_msix *msix, uint16_t vector, irq_handler handler, void *ctx);
 
 
 #endif
@@ -0,0 +1,36 @@
+/*
+kernel/pmu.c
+This file implements the parts of the Performance Monitors Extension the kernel shares: probing for an architected PMU
+and running its 64 bit cycle counter. The profiler samples on its overflow and the benchmark runner reads it.
+*/
+#include "pmu.h"
+
+bool pmu_available() {
+    /*
+    This function tells whether the CPU has an architected PMU, from ID_AA64DFR0_EL1.PMUVer.
+    Example usage: if (pmu_available()) pmu_start_cycles();
+    */
+    uint64_t dfr0;
+    asm volatile ("mrs %0, id_aa64dfr0_el1" : "=r"(dfr0));
+    uint32_t version = (dfr0 >> 8) & 0xF;
+    return version != 0 && version != 0xF; // 0xF is an IMPLEMENTATION DEFINED PMU
+}
+
+void pmu_start_cycles() {
+    /*
+    This function resets the cycle counter and starts it, counting at EL0 and EL1, with 64 bit overflow.
+    Only call it when pmu_available() is true.
+    */
+    asm volatile ("msr pmccfiltr_el0, xzr"); // Count at EL0 and EL1
+    asm volatile ("msr pmcntenset_el0, %0" :: "r"((uint64_t)PMU_CYCLE_COUNTER));
+    asm volatile ("msr pmcr_el0, %0" :: "r"((uint64_t)(PMCR_E | PMCR_C | PMCR_LC)));
+    asm volatile ("isb" ::: "memory");
+}
+
+void pmu_stop_cycles() {
+    /*
+    This function stops the cycle counter and disables its overflow interrupt.
+    */
+    asm volatile ("msr pmintenclr_el1, %0" :: "r"((uint64_t)PMU_CYCLE_COUNTER));
+    asm volatile ("msr pmcntenclr_el0, %0" :: "r"((uint64_t)PMU_CYCLE_COUNTER));
+}
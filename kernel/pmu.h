@@ -0,0 +1,22 @@
+#pragma once
+
+#include "types.h"
+
+#define PMCR_E (1 << 0) // Enable the counters
+#define PMCR_C (1 << 2) // Reset the cycle counter
+#define PMCR_LC (1 << 6) // 64 bit cycle counter overflow
+#define PMU_CYCLE_COUNTER (1U << 31) // Bit of the cycle counter in the PMCNTEN, PMINTEN and PMOVS registers
+
+bool pmu_available();
+void pmu_start_cycles();
+void pmu_stop_cycles();
+
+static inline uint64_t pmu_cycles() {
+    uint64_t value;
+    asm volatile ("mrs %0, pmccntr_el0" : "=r"(value));
+    return value;
+}
+
+static inline void pmu_set_cycles(uint64_t value) {
+    asm volatile ("msr pmccntr_el0, %0" :: "r"(value));
+}
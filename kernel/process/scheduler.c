@@ -3,23 +3,70 @@
 #include "ram_e.h"
 #include "proc_allocator.h"
 #include "gic.h"
+#include "hrtimer.h"
 #include "console/serial/uart.h"
+#include "trace.h"
+#include "metrics.h"
 
-extern void save_context(process_t* proc);
-extern void save_pc_interrupt(process_t* proc);
-extern void restore_context(process_t* proc);
+extern void restore_context(process_t* proc) __attribute__((noreturn));
 
-#define MAX_PROCS 16
 process_t processes[MAX_PROCS];
 int current_proc = 0;
 int proc_count = 0;
 
-void save_context_registers() {
-    save_context(&processes[current_proc]);
+#define SCHEDULER_TICK_NS (10 * NSEC_PER_MSEC)
+#define SCHEDULER_YIELD_SGI 0
+
+static hrtimer scheduler_tick;
+static volatile bool sleep_requested; // The current process sleeps at the next switch
+static volatile bool idling; // The CPU idles in block_current_proc, the current process resumes from its saved context
+static uint64_t slice_start; // Counter value when the current process was switched to
+
+static histogram slice_hist;
+static histogram wake_hist;
+static metric switch_metric = METRIC_COUNTER_INIT("sched.switches", "switches");
+static metric yield_metric = METRIC_COUNTER_INIT("sched.yields", "yields"); // Switches asked for, the rest are tick preemptions
+static metric slice_metric = METRIC_HISTOGRAM_INIT("sched.slice", "us", &slice_hist); // How long a process ran before switching out
+static metric wake_metric = METRIC_HISTOGRAM_INIT("sched.wake_latency", "us", &wake_hist); // From wake_proc to running
+
+static irq_result scheduler_tick_handler(hrtimer *timer, void *ctx) {
+    return IRQ_RESCHEDULE;
 }
 
-void save_return_address_interrupt() {
-    save_pc_interrupt(&processes[current_proc]);
+static irq_result scheduler_yield_handler(uint32_t irq, void *ctx) {
+    metric_add(&yield_metric, 1);
+    return IRQ_RESCHEDULE;
+}
+
+void yield_proc() {
+    /*
+    This function gives the rest of the current time slice to the next ready process.
+    It raises a software interrupt so the switch goes through the regular interrupt path,
+    which saves the full context. With interrupts masked, the switch happens once they are enabled.
+    Example usage: yield_proc(); from a kernel process that is waiting on another one.
+    */
+    gic_send_sgi(SCHEDULER_YIELD_SGI);
+    asm volatile ("isb" ::: "memory");
+}
+
+void save_context_frame(irq_frame *frame) {
+    /*
+    This function stores the registers of the interrupted process, as pushed on IRQ entry,
+    into its process structure so it can be resumed later by restore_context.
+    The stack pointer in use depends on the SPSel bit of the saved program status.
+    A blocked process already holds the context it has to resume from, so it is left untouched,
+    and so does one woken while the CPU idles on its behalf, as the interrupted code is only the idle loop.
+    */
+    process_t *proc = &processes[current_proc];
+    if (proc->state == BLOCKED || idling)
+        return;
+    for (int i = 0; i < 31; i++)
+        proc->regs[i] = frame->regs[i];
+    proc->sp = (frame->spsr & 1) ? frame->sp_el1 : frame->sp_el0;
+    proc->pc = frame->elr;
+    proc->spsr = frame->spsr;
+    for (int i = 0; i < 8; i++)
+        proc->simd[i] = frame->simd[i];
 }
 
 void switch_proc(ProcSwitchReason reason) {
@@ -28,30 +75,109 @@ void switch_proc(ProcSwitchReason reason) {
     It saves the context of the current process, updates the current process index,
     and restores the context of the next process to run.
     The reason for the switch (e.g., timer interrupt, blocking) is logged for debugging purposes.
+    When the CPU idles for a blocked process and that process is the only one ready, it is resumed from its saved context.
     */
     if (proc_count == 0)
         return;
+    bool slept = sleep_requested;
+    if (slept) {
+        sleep_requested = false;
+        processes[current_proc].state = BLOCKED; // The context was saved before the switch
+    }
     int next_proc = (current_proc + 1) % proc_count;
     while (processes[next_proc].state != READY) {
         next_proc = (next_proc + 1) % proc_count;
-        if (next_proc == current_proc)
+        if (next_proc == current_proc) {
+            if (slept)
+                processes[current_proc].state = READY; // Nothing else to run, return to the sleeper early
+            if (idling && processes[current_proc].state == READY)
+                break;
             return;
+        }
     }
     
+    trace(TRACE_SWITCH, processes[current_proc].id, processes[next_proc].id);
+    uint64_t now = timer_counter();
+    processes[current_proc].cpu_ticks += now - slice_start;
+    histogram_observe(&slice_hist, ticks_to_ns(now - slice_start) / NSEC_PER_USEC);
+    slice_start = now;
+    metric_add(&switch_metric, 1);
+    process_t *next = &processes[next_proc];
+    next->switches++;
+    if (next->wake_ticks) {
+        histogram_observe(&wake_hist, ticks_to_ns(now - next->wake_ticks) / NSEC_PER_USEC);
+        next->wake_ticks = 0;
+    }
     current_proc = next_proc;
+    idling = false;
     // kprintf_raw("Resumiong execution of process %i at %h", current_proc, processes[current_proc].pc);
     restore_context(&processes[current_proc]);
 }
 
+void block_current_proc(irq_frame *frame) {
+    /*
+    This function puts the current process to sleep from inside a syscall.
+    The process is saved so that it re-executes its SVC instruction once woken up with wake_proc,
+    which lets the syscall simply try again. If no other process is ready, the CPU idles until an interrupt wakes one,
+    which can be this same process, and switch_proc then resumes it.
+    This function does not return.
+    */
+    save_context_frame(frame);
+    processes[current_proc].pc -= 4; // Back to the SVC instruction
+    processes[current_proc].state = BLOCKED;
+    idling = true;
+    while (1) {
+        switch_proc(YIELD);
+        enable_interrupt();
+        asm volatile ("wfi" ::: "memory");
+        disable_interrupt();
+    }
+}
+
+void sleep_current_proc() {
+    /*
+    This function puts the calling kernel process to sleep until wake_proc is called for it.
+    The switch goes through the yield interrupt, which saves the context like any other preemption.
+    A wake_proc that arrives before the switch cancels the sleep, and the call can return early
+    when no other process is ready, so callers should check their condition again.
+    Example usage: while (!frame_due) sleep_current_proc();
+    */
+    uint64_t flags = irq_save();
+    sleep_requested = true;
+    yield_proc();
+    irq_restore(flags); // The yield is taken here
+}
+
+void wake_proc(int pid) {
+    /*
+    This function makes a blocked process runnable again. It is safe to call from interrupt handlers.
+    Example usage: wake_proc(pid); would let the scheduler resume a process waiting for input.
+    */
+    if (pid < 0 || pid >= proc_count) return;
+    if (pid == current_proc)
+        sleep_requested = false;
+    if (processes[pid].state == BLOCKED) {
+        processes[pid].state = READY;
+        processes[pid].wake_ticks = timer_counter();
+    }
+}
+
 void start_scheduler() {
     /*
-    This function starts the process scheduler by initializing the timer interrupt
-    to trigger every 1 millisecond. This allows the scheduler to perform context
+    This function starts the process scheduler by starting a periodic timer
+    that triggers every 10 milliseconds. This allows the scheduler to perform context
     switches at regular intervals.
     Example usage: start_scheduler(); would begin the scheduling of processes.
     */
     disable_interrupt();
-    timer_init(10);
+    metric_register(&switch_metric);
+    metric_register(&yield_metric);
+    metric_register(&slice_metric);
+    metric_register(&wake_metric);
+    slice_start = timer_counter();
+    request_irq(SCHEDULER_YIELD_SGI, scheduler_yield_handler, 0, IRQ_TRIGGER_EDGE);
+    hrtimer_setup(&scheduler_tick, scheduler_tick_handler, 0, HRTIMER_PHYSICAL);
+    hrtimer_start(&scheduler_tick, SCHEDULER_TICK_NS, SCHEDULER_TICK_NS, 0);
     switch_proc(YIELD);
 }
 
@@ -63,6 +189,19 @@ int get_current_proc() {
     return current_proc;
 }
 
+int get_proc_count() {
+    return proc_count;
+}
+
+process_t* get_proc(int pid) {
+    /*
+    This function returns the process with the given ID, or 0 if there is none.
+    Example usage: process_t *proc = get_proc(get_current_proc());
+    */
+    if (pid < 0 || pid >= proc_count) return 0;
+    return &processes[pid];
+}
+
 process_t* init_process() {
     if (proc_count >= MAX_PROCS) return 0;
 
@@ -2,6 +2,9 @@
 
 #include "types.h"
 #include "process.h"
+#include "irq.h"
+
+#define MAX_PROCS 16
 
 typedef enum {
     INTERRUPT,
@@ -11,6 +14,11 @@ typedef enum {
 void switch_proc(ProcSwitchReason reason);
 void start_scheduler();
 int get_current_proc();
-void save_context_registers();
-void save_return_address_interrupt();
+int get_proc_count();
+process_t* get_proc(int pid);
+void save_context_frame(irq_frame *frame);
+void block_current_proc(irq_frame *frame);
+void wake_proc(int pid);
+void yield_proc();
+void sleep_current_proc();
 process_t* init_process();
\ No newline at end of file
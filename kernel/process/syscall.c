@@ -3,50 +3,71 @@ kernel/process/syscall.c
 This file implements basic syscall handling for the kernel. It provides functions to handle
 syscalls invoked from user space (EL0) to perform operations such as printing to the console.
 Syscalls are invoked using the SVC (Supervisor Call) instruction, which triggers an exception
-that is handled by the kernel.
+that is handled by the kernel. The syscall number is passed in x8, arguments in x0-x3,
+and the result is returned in x0.
 */
 #include "syscall.h"
 #include "console/kio.h"
+#include "console/tty.h"
 #include "exception_handler.h"
 #include "console/serial/uart.h"
 #include "gic.h"
+#include "graph/user_framebuffer.h"
+#include "process/scheduler.h"
+#include "syscalls/syscalls.h"
+#include "trace.h"
+#include "profiler.h"
 
-void sync_el0_handler_c() {
+#define ESR_EC_SVC64 0x15
 
-    asm volatile ("msr daifset, #2");
-
-    uint64_t x0;
-
-    asm volatile ("mov %0, x0" : "=r"(x0));
-    uint64_t *x1;
-    asm volatile ("mov %0, x1" : "=r"(x1));
-    uint64_t x2;
-    asm volatile ("mov %0, x2" : "=r"(x2));
-    uint64_t x8;
-    asm volatile ("mov %0, x8" : "=r"(x8));
-
-    uint64_t x29;
-    asm volatile ("mov %0, x29" : "=r"(x29));
-    uint64_t x30;
-    asm volatile ("mov %0, x30" : "=r"(x30));
-
-    uint64_t elr;
-
-    asm volatile ("mrs %0, elr_el1" : "=r"(elr));
+void sync_el0_handler_c(irq_frame *frame) {
+    /*
+    This function dispatches a syscall. It is called by sync_el0_asm_handler with the registers
+    of the calling process pushed on the stack, and anything written to the frame is restored on return.
+    Syscalls that have to wait block the process, which re-issues the SVC when it is woken up.
+    */
+    uint64_t esr;
+    asm volatile ("mrs %0, esr_el1" : "=r"(esr));
+    if (((esr >> 26) & 0x3F) != ESR_EC_SVC64)
+        handle_exception("UNEXPECTED EL0 EXCEPTION");
 
-    uint64_t spsr;
-    asm volatile ("mrs %0, spsr_el1" : "=r"(spsr));
+    uint64_t *regs = frame->regs;
+    uint64_t result = 0;
+    trace(TRACE_SYSCALL_ENTRY, regs[8], get_current_proc());
 
-    if (x8 == 3){
-        kprintf_args_raw((const char *)x0, x1, x2);
-    } else {
-        handle_exception("UNEXPECTED EL0 EXCEPTION");
+    switch (regs[8]) {
+        case PRINTF_SYSCALL:
+            kprintf_args_raw((const char *)regs[0], (const uint64_t *)regs[1], regs[2]);
+            break;
+        case GFX_MAP_SYSCALL:
+            result = map_user_framebuffer(regs[0], (gfx_surface_info*)regs[1]);
+            break;
+        case GFX_PRESENT_SYSCALL:
+            present_user_framebuffer((rect){{regs[0], regs[1]}, {regs[2], regs[3]}});
+            break;
+        case READ_SYSCALL:
+            result = tty_read((char *)regs[0], regs[1]);
+            if (result == 0 && regs[1] > 0) {
+                tty_wait(get_current_proc());
+                block_current_proc(frame);
+            }
+            break;
+        case INPUT_MODE_SYSCALL:
+            tty_set_mode(regs[0]);
+            break;
+        case PROFILE_SYSCALL:
+            if (regs[0] == PROFILE_START)
+                result = profiler_start(regs[1] > PROFILE_MAX_HZ ? PROFILE_MAX_HZ : regs[1], PROFILE_SOURCE_AUTO); // Clamped before truncating to 32 bits
+            else if (regs[0] == PROFILE_DUMP)
+                profiler_dump();
+            else
+                profiler_stop();
+            break;
+        default:
+            handle_exception("UNEXPECTED EL0 EXCEPTION");
+            break;
     }
 
-    asm volatile ("mov x29, %0" :: "r"(x29));
-    asm volatile ("mov x30, %0" :: "r"(x30));
-    asm volatile ("msr elr_el1, %0" :: "r"(elr));
-    asm volatile ("msr spsr_el1, %0" :: "r"(spsr));
-
-    asm volatile ("eret");
-}
\ No newline at end of file
+    trace(TRACE_SYSCALL_EXIT, regs[8], result);
+    regs[0] = result;
+}
@@ -1,3 +1,6 @@
 #pragma once
 
-#include "types.h"
\ No newline at end of file
+#include "types.h"
+#include "irq.h"
+
+void sync_el0_handler_c(irq_frame *frame);
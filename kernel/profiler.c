@@ -0,0 +1,167 @@
+/*
+kernel/profiler.c
+This file implements the sampling profiler. At a fixed rate it records the PC, exception level and process
+that an interrupt stopped. Samples are taken on PMU cycle counter overflow where the CPU has a PMU,
+or on a periodic hrtimer otherwise. Either way the sample is an ordinary IRQ, so code running with interrupts masked
+is never sampled: time spent there is attributed to where interrupts are unmasked again.
+The profiler is controlled with Ctrl-P on the serial console or the profile syscall, and profiler_dump writes
+the samples to the host file profile.log, or the serial port without semihosting, for tools/profile_report.py
+to symbolize against kernel.elf.
+*/
+#include "profiler.h"
+#include "irq.h"
+#include "hrtimer.h"
+#include "kstring.h"
+#include "console/kio.h"
+#include "semihost.h"
+#include "process/scheduler.h"
+#include "pmu.h"
+
+#define PMU_IRQ 23 // PPI 7 on the virt board
+
+static profile_sample samples[PROFILE_SAMPLES];
+static volatile uint32_t sample_count;
+static volatile uint64_t dropped;
+static volatile bool running;
+
+static uint32_t sample_hz;
+static uint32_t sample_source;
+static uint64_t pmu_period; // Cycles between samples
+static hrtimer sample_timer;
+static bool pmu_irq_registered;
+
+static void profiler_sample() {
+    /*
+    Record where the current interrupt stopped. SPSR.M[3:2] holds the exception level it was taken from.
+    */
+    irq_frame *frame = irq_interrupted_frame();
+    if (!frame) return;
+    uint32_t index = sample_count;
+    if (index >= PROFILE_SAMPLES) {
+        dropped++;
+        return;
+    }
+    samples[index].pc = frame->elr;
+    samples[index].el = (frame->spsr >> 2) & 0x3;
+    samples[index].pid = get_current_proc();
+    sample_count = index + 1;
+}
+
+static irq_result profiler_timer_handler(hrtimer *timer, void *ctx) {
+    profiler_sample();
+    return IRQ_HANDLED;
+}
+
+static irq_result profiler_pmu_handler(uint32_t irq, void *ctx) {
+    uint64_t overflow;
+    asm volatile ("mrs %0, pmovsclr_el0" : "=r"(overflow));
+    if (!(overflow & PMU_CYCLE_COUNTER))
+        return IRQ_NONE;
+    asm volatile ("msr pmovsclr_el0, %0" :: "r"((uint64_t)PMU_CYCLE_COUNTER));
+    pmu_set_cycles(-pmu_period);
+    if (running)
+        profiler_sample();
+    return IRQ_HANDLED;
+}
+
+static bool pmu_start(uint32_t hz) {
+    /*
+    Start the cycle counter, count its rate against the generic timer over a millisecond,
+    and arm it to overflow once per sample period. Returns false if the counter does not run.
+    */
+    pmu_start_cycles();
+
+    uint64_t start_ticks = timer_counter();
+    uint64_t start_cycles = pmu_cycles();
+    uint64_t wait = ns_to_ticks(NSEC_PER_MSEC);
+    while (timer_counter() - start_ticks < wait);
+    uint64_t cycles_per_sec = (pmu_cycles() - start_cycles) * 1000;
+    if (cycles_per_sec < hz) {
+        pmu_stop_cycles();
+        return false;
+    }
+
+    if (!pmu_irq_registered)
+        pmu_irq_registered = request_irq(PMU_IRQ, profiler_pmu_handler, 0, IRQ_TRIGGER_LEVEL | IRQ_PRIORITY(0x80));
+    if (!pmu_irq_registered)
+        return false;
+
+    pmu_period = cycles_per_sec / hz;
+    asm volatile ("msr pmovsclr_el0, %0" :: "r"((uint64_t)PMU_CYCLE_COUNTER));
+    pmu_set_cycles(-pmu_period);
+    asm volatile ("msr pmintenset_el1, %0" :: "r"((uint64_t)PMU_CYCLE_COUNTER));
+    return true;
+}
+
+bool profiler_start(uint32_t hz, uint32_t source) {
+    /*
+    This function clears the sample buffer and starts sampling at hz, from the given PROFILE_SOURCE_*.
+    Rates above PROFILE_MAX_HZ are clamped to it.
+    Returns false if the profiler is already running, hz is 0 or the requested source is not available.
+    Example usage: profiler_start(PROFILE_DEFAULT_HZ, PROFILE_SOURCE_AUTO);
+    */
+    if (running || hz == 0) return false;
+    if (hz > PROFILE_MAX_HZ) hz = PROFILE_MAX_HZ;
+    sample_count = 0;
+    dropped = 0;
+    sample_hz = hz;
+
+    running = true;
+    if (source != PROFILE_SOURCE_TIMER && pmu_available() && pmu_start(hz)) {
+        sample_source = PROFILE_SOURCE_PMU;
+    } else if (source == PROFILE_SOURCE_PMU) {
+        running = false;
+        return false;
+    } else {
+        sample_source = PROFILE_SOURCE_TIMER;
+        hrtimer_setup(&sample_timer, profiler_timer_handler, 0, HRTIMER_VIRTUAL);
+        hrtimer_start(&sample_timer, NSEC_PER_SEC / hz, NSEC_PER_SEC / hz, 0);
+    }
+    kprintf("[PROFILE] Sampling at %i Hz from the %s", hz, (uint64_t)(sample_source == PROFILE_SOURCE_PMU ? "PMU" : "timer"));
+    return true;
+}
+
+void profiler_stop() {
+    if (!running) return;
+    running = false;
+    if (sample_source == PROFILE_SOURCE_PMU)
+        pmu_stop_cycles();
+    else
+        hrtimer_cancel(&sample_timer);
+}
+
+bool profiler_running() {
+    return running;
+}
+
+void profiler_dump() {
+    /*
+    This function stops sampling and writes the samples between "[PROFILE] begin" and "[PROFILE] end",
+    to profile.log on the host when semihosting is available and to the serial port otherwise,
+    waiting for room in the UART ring so no sample is dropped. Ctrl-P runs it in the ttykeys process for that reason.
+    Relocated process code is listed with its link address, so the host can map its PCs back to kernel.elf.
+    */
+    profiler_stop();
+
+    host_file out;
+    bool to_host = host_file_open(&out, "profile.log");
+    char line[96];
+    format_buffer(line, sizeof(line), "\n[PROFILE] begin hz %u source %s samples %u dropped %u\n",
+        sample_hz, (uint64_t)(sample_source == PROFILE_SOURCE_PMU ? "pmu" : "timer"), sample_count, dropped);
+    host_file_puts(&out, line);
+    for (int pid = 0; pid < get_proc_count(); pid++) {
+        process_t *proc = get_proc(pid);
+        if (!proc->code_size) continue;
+        format_buffer(line, sizeof(line), "[PROFILE] map %u %x %x %x\n", pid, proc->code_base, proc->code_origin, proc->code_size);
+        host_file_puts(&out, line);
+    }
+    for (uint32_t i = 0; i < sample_count; i++) {
+        format_buffer(line, sizeof(line), "[PROFILE] %x %u %u\n", samples[i].pc, samples[i].el, samples[i].pid);
+        host_file_puts(&out, line);
+    }
+    host_file_puts(&out, "[PROFILE] end\n");
+    if (to_host) {
+        bool complete = host_file_close(&out);
+        kprintf("Profile written to profile.log, %u bytes%s", out.written, (uint64_t)(complete ? "" : ", incomplete"));
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "types.h"
+
+#define PROFILE_SAMPLES 32768
+#define PROFILE_DEFAULT_HZ 2000
+#define PROFILE_MAX_HZ 100000 // Faster rates are clamped, sampling interrupts would leave little time for anything else
+
+#define PROFILE_SOURCE_AUTO 0 // PMU cycle counter overflow when available, otherwise the timer
+#define PROFILE_SOURCE_TIMER 1
+#define PROFILE_SOURCE_PMU 2
+
+typedef struct {
+    uint64_t pc;
+    uint32_t pid;
+    uint8_t el;
+    uint8_t padding[3];
+} profile_sample;
+
+bool profiler_start(uint32_t hz, uint32_t source);
+void profiler_stop();
+bool profiler_running();
+void profiler_dump();
@@ -0,0 +1,48 @@
+/*
+kernel/psci.c
+This file implements the Power State Coordination Interface calls the kernel uses to power off or reset the machine.
+The DTB psci node tells whether the firmware is reached with hvc or smc; QEMU's virt board uses hvc
+when it loads the kernel directly. If no PSCI is described, or the call returns, the CPU halts in a wfi loop.
+*/
+#include "psci.h"
+#include "dtb.h"
+#include "kstring.h"
+
+static int handle_psci_node(const char *name, const char *propname, const void *prop, uint32_t len, dtb_match_t *match) {
+    if (strcmp(propname, "method") == 0) {
+        match->compatible = (const char *)prop;
+        match->found = true;
+        return 1;
+    }
+    return 0;
+}
+
+static void psci_call(uint64_t function) {
+    /*
+    Issue a PSCI call with no arguments through the conduit named in the DTB.
+    */
+    dtb_match_t match = {0};
+    if (dtb_scan("psci", handle_psci_node, &match)) {
+        register uint64_t x0 asm("x0") = function;
+        if (strcmp(match.compatible, "smc") == 0)
+            asm volatile ("smc #0" : "+r"(x0) :: "memory");
+        else
+            asm volatile ("hvc #0" : "+r"(x0) :: "memory");
+    }
+}
+
+void psci_system_off() {
+    /*
+    This function powers the machine off. It does not return, QEMU exits with the guest.
+    Example usage: psci_system_off(); at the end of an automated run.
+    */
+    psci_call(PSCI_SYSTEM_OFF);
+    while (1)
+        asm volatile ("wfi");
+}
+
+void psci_system_reset() {
+    psci_call(PSCI_SYSTEM_RESET);
+    while (1)
+        asm volatile ("wfi");
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "types.h"
+
+#define PSCI_SYSTEM_OFF 0x84000008
+#define PSCI_SYSTEM_RESET 0x84000009
+
+void psci_system_off();
+void psci_system_reset();
@@ -12,6 +12,9 @@ to allocate memory sequentially from predefined regions.
 #include "dtb.h"
 #include "console/serial/uart.h"
 #include "kstring.h"
+#include "trace.h"
+#include "metrics.h"
+#include "gic.h"
 
 static uint64_t total_ram_size = 0; // in bytes
 static uint64_t total_ram_start = 0; // start address of total RAM
@@ -31,6 +34,13 @@ typedef struct FreeBlock {
 
 FreeBlock* temp_free_list = 0;
 
+static histogram talloc_sizes;
+static metric talloc_metric = METRIC_COUNTER_INIT("mem.talloc", "calls");
+static metric talloc_reuse_metric = METRIC_COUNTER_INIT("mem.talloc.reused", "calls"); // Served from the free list
+static metric talloc_size_metric = METRIC_HISTOGRAM_INIT("mem.talloc.size", "bytes", &talloc_sizes);
+static metric temp_free_metric = METRIC_COUNTER_INIT("mem.temp_free", "calls");
+static metric palloc_metric = METRIC_COUNTER_INIT("mem.palloc", "calls");
+
 uint8_t read8(uintptr_t addr) {
     return *(volatile uint8_t*)addr;
 }
@@ -98,6 +108,19 @@ void *memset(void *dest, int val, unsigned long count) {
     return dest;
 }
 
+void *memcpy(void *dest, const void *src, unsigned long count) {
+    /*
+    This function copies count bytes from src to dest.
+    The memory areas must not overlap.
+    */
+    unsigned char *d = dest;
+    const unsigned char *s = src;
+    while (count--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
 #define temp_start (uint64_t)&heap_bottom + 0x500000 // 5 MB after heap bottom
 
 extern uint64_t kernel_start; // defined in linker script
@@ -113,8 +136,6 @@ uint64_t next_free_perm_memory = temp_start; // Start of permanent memory, imple
 // Well need to use a table indicating which sections of memory are available
 // so we can talloc and free dynamically
 
-static bool talloc_verbose = false;
-
 uint64_t talloc(uint64_t size) {
     /*
     This function allocates temporary memory of the given size using a bump pointer allocator.
@@ -122,24 +143,20 @@ uint64_t talloc(uint64_t size) {
     */
     size = (size + 0xFFF) & ~0xFFF;
 
-    if (talloc_verbose) {
-        uart_raw_puts("[talloc] Requested size: ");
-        uart_puthex(size);
-        uart_raw_puts("\n");
-    }
+    klog_debug(KLOG_SYS_MEM, "[talloc] Requested size: %h", size);
+    metric_add(&talloc_metric, 1);
+    histogram_observe(&talloc_sizes, size);
 
     FreeBlock** curr = &temp_free_list;
     while (*curr) {
 
         if ((*curr)->size >= size) {
-            if (talloc_verbose) {
-                uart_raw_puts("[talloc] Reusing free block at ");
-                uart_puthex((uint64_t)*curr);
-                uart_raw_putc('\n');
-            }
+            klog_debug(KLOG_SYS_MEM, "[talloc] Reusing free block at %h", (uint64_t)*curr);
 
             uint64_t result = (uint64_t)*curr;
             *curr = (*curr)->next;
+            trace(TRACE_TALLOC, size, result);
+            metric_add(&talloc_reuse_metric, 1);
             return result;
         }
         curr = &(*curr)->next;
@@ -151,6 +168,7 @@ uint64_t talloc(uint64_t size) {
 
     uint64_t result = next_free_temp_memory;
     next_free_temp_memory += size;
+    trace(TRACE_TALLOC, size, result);
     return result;
 }
 
@@ -161,24 +179,16 @@ void temp_free(void* ptr, uint64_t size) {
     */
    size = (size + 0xFFF) & ~0xFFF;
 
-    if (talloc_verbose) {
-        uart_raw_puts("[temp_free] Freeing block at ");
-        uart_puthex((uint64_t)ptr);
-        uart_raw_puts(" of size ");
-        uart_puthex(size);
-        uart_raw_putc('\n');
-    }
+    klog_debug(KLOG_SYS_MEM, "[temp_free] Freeing block at %h of size %h", (uint64_t)ptr, size);
 
+    trace(TRACE_TEMP_FREE, size, (uint64_t)ptr);
+    metric_add(&temp_free_metric, 1);
     FreeBlock* block = (FreeBlock*)ptr;
     block->size = size;
     block->next = temp_free_list;
     temp_free_list = block;
 }
 
-void enable_talloc_verbose() {
-    talloc_verbose = true;
-}
-
 uint64_t palloc(uint64_t size) {
     /*
     This function allocates permanent memory of the given size using a bump pointer allocator.
@@ -190,9 +200,60 @@ uint64_t palloc(uint64_t size) {
         panic_with_info("Permanent allocator overflow", (uint64_t)&heap_limit);
     uint64_t result = next_free_perm_memory;
     next_free_perm_memory += aligned_size;
+    trace(TRACE_PALLOC, aligned_size, result);
+    metric_add(&palloc_metric, 1);
     return result;
 }
 
+static uint64_t read_temp_used(void *ctx) {
+    /*
+    Bytes handed out by talloc and not freed. The free list is walked with interrupts masked,
+    so no other process takes a block from under the walk.
+    */
+    uint64_t flags = irq_save();
+    uint64_t used = next_free_temp_memory - (uint64_t)&heap_bottom;
+    for (FreeBlock *block = temp_free_list; block; block = block->next)
+        used -= block->size;
+    irq_restore(flags);
+    return used;
+}
+
+static uint64_t read_temp_free_blocks(void *ctx) {
+    uint64_t flags = irq_save();
+    uint64_t count = 0;
+    for (FreeBlock *block = temp_free_list; block; block = block->next)
+        count++;
+    irq_restore(flags);
+    return count;
+}
+
+static uint64_t read_perm_used(void *ctx) {
+    return next_free_perm_memory - temp_start;
+}
+
+static uint64_t read_perm_left(void *ctx) {
+    return (uint64_t)&heap_limit - next_free_perm_memory;
+}
+
+void mem_metrics_init() {
+    /*
+    This function publishes the allocator metrics under "mem".
+    */
+    static metric temp_used = METRIC_GAUGE_INIT("mem.temp.used", "bytes", read_temp_used, 0);
+    static metric temp_free_blocks = METRIC_GAUGE_INIT("mem.temp.free_blocks", "blocks", read_temp_free_blocks, 0);
+    static metric perm_used = METRIC_GAUGE_INIT("mem.perm.used", "bytes", read_perm_used, 0);
+    static metric perm_left = METRIC_GAUGE_INIT("mem.perm.left", "bytes", read_perm_left, 0);
+    metric_register(&talloc_metric);
+    metric_register(&talloc_reuse_metric);
+    metric_register(&talloc_size_metric);
+    metric_register(&temp_free_metric);
+    metric_register(&palloc_metric);
+    metric_register(&temp_used);
+    metric_register(&temp_free_blocks);
+    metric_register(&perm_used);
+    metric_register(&perm_left);
+}
+
 uint64_t mem_get_kmem_start(){
     /*
     This function returns the start address of the kernel memory region.
@@ -222,7 +283,7 @@ int handle_mem_node(const char *name, const char *propname, const void *prop, ui
         
         return 1;
     }
-    if (strcmp(propname, "device_type") == 0, strcmp(prop, "memory") == 0) {
+    if (strcmp(propname, "device_type") == 0 && strcmp(prop, "memory") == 0) {
         match->found = true;
     }
     return 0;
@@ -2,6 +2,10 @@
 
 #include "types.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 uint8_t read8(uintptr_t addr);
 void write8(uintptr_t addr, uint8_t value);
 uint16_t read16(uintptr_t addr);
@@ -16,20 +20,14 @@ void write_barrier();
 
 int memcmp(const void *s1, const void *s2, unsigned long n);
 void *memset(void *dest, int val, unsigned long count);
-
-#ifdef __cplusplus
-extern "C" {
-#endif
+void *memcpy(void *dest, const void *src, unsigned long count);
+void memcpy_simd(void *dest, const void *src, uint64_t count);
+void memset32_simd(void *dest, uint32_t value, uint64_t count);
 
 uint64_t talloc(uint64_t size);
 void temp_free(void* ptr, uint64_t size);
-void enable_talloc_verbose();
-
-#ifdef __cplusplus
-}
-#endif
-
 uint64_t palloc(uint64_t size);
+void mem_metrics_init();
 
 uint64_t mem_get_kmem_start();
 uint64_t mem_get_kmem_end();
@@ -38,4 +36,8 @@ uint64_t get_total_user_ram();
 uint64_t get_user_ram_start();
 uint64_t get_user_ram_end();
 uint64_t get_shared_start();
-uint64_t get_shared_end();
\ No newline at end of file
+uint64_t get_shared_end();
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+/*
+kernel/semihost.c
+This file implements a channel to files on the host through Arm semihosting, for dumps too large for the serial port.
+The kernel asks the host to perform SYS_OPEN and SYS_WRITE by executing hlt 0xf000, which QEMU services when
+started with -semihosting, copying the data straight out of guest memory.
+Without -semihosting the hlt is an undefined instruction. The first call probes for that: sync_el1_handler
+hands the exception to semihost_fault, which skips the instruction, and every host file falls back to the serial port.
+Writes are gathered in one buffer, so a file is open at a time and a second one goes to the serial port.
+The serial fallback waits for room in the UART ring rather than dropping output, so a dump should run in a process:
+with interrupts masked it holds the CPU until the line has taken everything.
+*/
+#include "semihost.h"
+#include "console/kio.h"
+#include "console/serial/uart.h"
+#include "kstring.h"
+#include "ram_e.h"
+
+#define SEMIHOST_UNKNOWN 0
+#define SEMIHOST_PRESENT 1
+#define SEMIHOST_ABSENT 2
+
+static volatile uint8_t state = SEMIHOST_UNKNOWN;
+
+static char buffer[HOST_FILE_BUFFER];
+static uint32_t buffered;
+static host_file *buffer_owner;
+
+bool semihost_available() {
+    /*
+    This function tells whether the host services semihosting calls. The first call probes with SYS_ERRNO.
+    Example usage: if (semihost_available()) { ... }
+    */
+    if (state == SEMIHOST_UNKNOWN) {
+        state = SEMIHOST_PRESENT; // semihost_fault changes it if the probe traps
+        semihost_call(SEMIHOST_SYS_ERRNO, 0);
+        if (state == SEMIHOST_PRESENT)
+            kprintf("Semihosting enabled, dumps are written to host files");
+        else
+            kprintf("Semihosting not enabled, dumps are written to the serial port");
+    }
+    return state == SEMIHOST_PRESENT;
+}
+
+bool semihost_fault(irq_frame *frame, uint64_t esr) {
+    /*
+    This function recovers from a semihosting call made without a host to service it.
+    It returns true when the exception was that call, which then returns -1.
+    */
+    extern char semihost_trap[];
+    if (frame->elr != (uint64_t)semihost_trap || (esr >> 26) != 0) // EC 0, unknown reason
+        return false;
+    state = SEMIHOST_ABSENT;
+    frame->regs[0] = (uint64_t)-1;
+    frame->elr += 4;
+    return true;
+}
+
+static void host_file_flush(host_file *file) {
+    if (!buffered) return;
+    if (!file->failed) {
+        uint64_t params[3] = { (uint64_t)file->handle, (uint64_t)buffer, buffered };
+        if (semihost_call(SEMIHOST_SYS_WRITE, params) != 0) // Returns the number of bytes not written
+            file->failed = true;
+    }
+    buffered = 0;
+}
+
+bool host_file_open(host_file *file, const char *name) {
+    /*
+    This function opens or truncates a file in QEMU's working directory on the host.
+    When that is not possible it returns false and the file writes to the serial port instead, so callers
+    can stream the same output either way.
+    Example usage: host_file f; host_file_open(&f, "trace.log"); host_file_puts(&f, line); host_file_close(&f);
+    */
+    file->handle = -1;
+    file->written = 0;
+    file->failed = false;
+    if (buffer_owner || !semihost_available())
+        return false;
+    uint64_t params[3] = { (uint64_t)name, SEMIHOST_MODE_WB, string_l(name).length };
+    int64_t handle = (int64_t)semihost_call(SEMIHOST_SYS_OPEN, params);
+    if (handle < 0) {
+        kprintf("Could not open host file %s", (uint64_t)name);
+        return false;
+    }
+    file->handle = handle;
+    buffer_owner = file;
+    buffered = 0;
+    return true;
+}
+
+void host_file_write(host_file *file, const void *data, uint64_t len) {
+    const char *bytes = (const char *)data;
+    file->written += len;
+    if (file->handle < 0) {
+        uart_raw_write_wait(bytes, len);
+        return;
+    }
+    while (len) {
+        uint64_t chunk = HOST_FILE_BUFFER - buffered;
+        if (chunk > len) chunk = len;
+        memcpy(buffer + buffered, bytes, chunk);
+        buffered += chunk;
+        bytes += chunk;
+        len -= chunk;
+        if (buffered == HOST_FILE_BUFFER)
+            host_file_flush(file);
+    }
+}
+
+void host_file_puts(host_file *file, const char *s) {
+    host_file_write(file, s, string_l(s).length);
+}
+
+bool host_file_close(host_file *file) {
+    /*
+    This function writes out what is buffered and closes the file.
+    It returns true when everything reached the host file, false for short writes and for the serial fallback.
+    */
+    if (file->handle < 0)
+        return false;
+    host_file_flush(file);
+    uint64_t params[1] = { (uint64_t)file->handle };
+    semihost_call(SEMIHOST_SYS_CLOSE, params);
+    file->handle = -1;
+    buffer_owner = 0;
+    return !file->failed;
+}
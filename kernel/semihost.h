@@ -0,0 +1,36 @@
+#pragma once
+
+#include "types.h"
+#include "irq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SEMIHOST_SYS_OPEN 0x01
+#define SEMIHOST_SYS_CLOSE 0x02
+#define SEMIHOST_SYS_WRITE 0x05
+#define SEMIHOST_SYS_ERRNO 0x13
+
+#define SEMIHOST_MODE_WB 5 // fopen mode "wb", the file is created or truncated
+
+#define HOST_FILE_BUFFER 4096
+
+typedef struct {
+    int64_t handle; // Host file handle, or -1 when the output falls back to the serial port
+    uint64_t written;
+    bool failed; // A write was short, the rest of the output is dropped
+} host_file;
+
+uint64_t semihost_call(uint64_t op, void *params);
+bool semihost_available();
+bool semihost_fault(irq_frame *frame, uint64_t esr);
+
+bool host_file_open(host_file *file, const char *name);
+void host_file_write(host_file *file, const void *data, uint64_t len);
+void host_file_puts(host_file *file, const char *s);
+bool host_file_close(host_file *file);
+
+#ifdef __cplusplus
+}
+#endif
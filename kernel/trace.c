@@ -0,0 +1,132 @@
+/*
+kernel/trace.c
+This file implements binary event tracing. Tracepoints write fixed-size records (counter, CPU, event id and two arguments)
+into a ring owned by the CPU they run on, so recording is a single atomic increment and a few stores.
+The rings are flight recorders: they keep the last TRACE_RECORDS events per CPU and are only read once tracing is stopped.
+trace_dump writes them as hex lines between "[TRACE] begin" and "[TRACE] end" markers, to the host file trace.log
+when QEMU runs with -semihosting and to the serial port otherwise. tools/trace_to_perfetto.py turns either
+into a Chrome/Perfetto JSON timeline.
+*/
+#include "trace.h"
+#include "console/kio.h"
+#include "semihost.h"
+#include "kstring.h"
+
+#define TRACE_MASK_RECORDS (TRACE_RECORDS - 1)
+
+typedef struct {
+    trace_record records[TRACE_RECORDS];
+    volatile uint64_t head;
+} trace_ring;
+
+static trace_ring rings[TRACE_MAX_CPUS];
+
+volatile uint32_t trace_mask;
+
+static const struct {
+    uint32_t id;
+    const char *name;
+} event_names[] = {
+    { TRACE_SWITCH, "switch" },
+    { TRACE_IRQ_ENTRY, "irq_entry" },
+    { TRACE_IRQ_EXIT, "irq_exit" },
+    { TRACE_SYSCALL_ENTRY, "syscall_entry" },
+    { TRACE_SYSCALL_EXIT, "syscall_exit" },
+    { TRACE_VQ_SUBMIT, "vq_submit" },
+    { TRACE_VQ_COMPLETE, "vq_complete" },
+    { TRACE_TALLOC, "talloc" },
+    { TRACE_TEMP_FREE, "temp_free" },
+    { TRACE_PALLOC, "palloc" },
+};
+
+static inline uint32_t trace_cpu() {
+    uint64_t mpidr;
+    asm volatile ("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return (mpidr & 0xFF) % TRACE_MAX_CPUS;
+}
+
+void trace_record_event(uint32_t event, uint64_t arg0, uint64_t arg1) {
+    /*
+    This function appends a record to the current CPU's ring. It is safe to call from any context.
+    Use the trace() tracepoint instead, which skips disabled categories without a call.
+    */
+    uint32_t cpu = trace_cpu();
+    trace_ring *ring = &rings[cpu];
+    uint64_t seq = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_record *record = &ring->records[seq & TRACE_MASK_RECORDS];
+
+    uint64_t now;
+    asm volatile ("mrs %0, cntvct_el0" : "=r"(now));
+    record->timestamp = now;
+    record->event = event;
+    record->cpu = cpu;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+}
+
+void trace_start(uint32_t mask) {
+    /*
+    This function clears the rings and starts recording the categories set in mask.
+    Example usage: trace_start((1 << TRACE_CAT_IRQ) | (1 << TRACE_CAT_SCHED));
+    */
+    trace_mask = 0;
+    for (uint32_t cpu = 0; cpu < TRACE_MAX_CPUS; cpu++)
+        rings[cpu].head = 0;
+    __atomic_store_n(&trace_mask, mask, __ATOMIC_RELEASE);
+}
+
+void trace_stop() {
+    __atomic_store_n(&trace_mask, 0, __ATOMIC_RELEASE);
+}
+
+bool trace_active() {
+    return trace_mask != 0;
+}
+
+static void trace_line(host_file *out, const char *fmt, const uint64_t *args, uint32_t arg_count) {
+    char line[128];
+    format_buffer_args(line, sizeof(line), fmt, args, arg_count);
+    host_file_puts(out, line);
+}
+
+#define trace_print(out, fmt, ...) \
+    ({ \
+        uint64_t _args[] = { __VA_ARGS__ }; \
+        trace_line((out), (fmt), _args, sizeof(_args) / sizeof(_args[0])); \
+    })
+
+void trace_dump() {
+    /*
+    This function stops tracing and writes every ring to trace.log on the host, oldest record first.
+    Without semihosting it goes to the serial port instead, bypassing the log and waiting for room in the UART ring,
+    so nothing is dropped however large the dump is. Call it from a process: with interrupts masked
+    the serial fallback holds the CPU until the whole dump is out, which is why Ctrl-T runs it in ttykeys.
+    The header carries the counter frequency and the event names, so the host script needs no copy of this file.
+    */
+    trace_stop();
+
+    host_file out;
+    bool to_host = host_file_open(&out, "trace.log");
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    trace_print(&out, "\n[TRACE] begin freq %u cpus %u\n", freq, TRACE_MAX_CPUS);
+    for (uint32_t i = 0; i < sizeof(event_names) / sizeof(event_names[0]); i++)
+        trace_print(&out, "[TRACE] event %x %s\n", event_names[i].id, (uint64_t)event_names[i].name);
+
+    for (uint32_t cpu = 0; cpu < TRACE_MAX_CPUS; cpu++) {
+        trace_ring *ring = &rings[cpu];
+        uint64_t head = ring->head;
+        uint64_t start = head > TRACE_RECORDS ? head - TRACE_RECORDS : 0;
+        if (start)
+            trace_print(&out, "[TRACE] lost %u %u\n", cpu, start);
+        for (uint64_t seq = start; seq < head; seq++) {
+            trace_record *r = &ring->records[seq & TRACE_MASK_RECORDS];
+            trace_print(&out, "[TRACE] %x %x %x %x %x\n", r->cpu, r->timestamp, r->event, r->args[0], r->args[1]);
+        }
+    }
+    host_file_puts(&out, "[TRACE] end\n");
+    if (to_host) {
+        bool complete = host_file_close(&out);
+        kprintf("Trace written to trace.log, %u bytes%s", out.written, (uint64_t)(complete ? "" : ", incomplete"));
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAX_CPUS 4
+#define TRACE_RECORDS 1024 // Per CPU, power of two
+
+#define TRACE_CAT_SCHED 0
+#define TRACE_CAT_IRQ 1
+#define TRACE_CAT_SYSCALL 2
+#define TRACE_CAT_VIRTQ 3
+#define TRACE_CAT_ALLOC 4
+
+#define TRACE_ALL 0xFFFFFFFF
+
+#define TRACE_ID(cat, n) (((cat) << 8) | (n)) // The category selects the enable bit in the trace mask
+
+#define TRACE_SWITCH TRACE_ID(TRACE_CAT_SCHED, 0) // from pid, to pid
+#define TRACE_IRQ_ENTRY TRACE_ID(TRACE_CAT_IRQ, 0) // irq, entry counter
+#define TRACE_IRQ_EXIT TRACE_ID(TRACE_CAT_IRQ, 1) // irq, irq_result
+#define TRACE_SYSCALL_ENTRY TRACE_ID(TRACE_CAT_SYSCALL, 0) // syscall number, pid
+#define TRACE_SYSCALL_EXIT TRACE_ID(TRACE_CAT_SYSCALL, 1) // syscall number, result
+#define TRACE_VQ_SUBMIT TRACE_ID(TRACE_CAT_VIRTQ, 0) // command type, avail index
+#define TRACE_VQ_COMPLETE TRACE_ID(TRACE_CAT_VIRTQ, 1) // command type, used index
+#define TRACE_TALLOC TRACE_ID(TRACE_CAT_ALLOC, 0) // size, address
+#define TRACE_TEMP_FREE TRACE_ID(TRACE_CAT_ALLOC, 1) // size, address
+#define TRACE_PALLOC TRACE_ID(TRACE_CAT_ALLOC, 2) // size, address
+
+typedef struct {
+    uint64_t timestamp; // cntvct
+    uint32_t event;
+    uint32_t cpu;
+    uint64_t args[2];
+} trace_record;
+
+extern volatile uint32_t trace_mask;
+
+void trace_record_event(uint32_t event, uint64_t arg0, uint64_t arg1);
+
+/*
+Static tracepoint. It costs a load and a branch while its category is disabled.
+Example usage: trace(TRACE_IRQ_ENTRY, irq, entry_ticks);
+*/
+static inline void trace(uint32_t event, uint64_t arg0, uint64_t arg1) {
+    if (trace_mask & (1U << (event >> 8)))
+        trace_record_event(event, arg0, arg1);
+}
+
+void trace_start(uint32_t mask);
+void trace_stop();
+bool trace_active();
+void trace_dump();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+# Build profiles, included by the kernel, shared and user Makefiles. Select one with make PROFILE=name
+# debug   -O0 with full debug info, the default
+# release -O2 with link time optimisation and unused section removal, debug info split into kernel.debug,
+#         debug log messages compiled out unless KLOG_LEVEL is given
+# profile -O2 with frame pointers and no LTO, so profiler samples and backtraces map back to the source functions
+PROFILE ?= debug
+
+# Exception entry and the context switch save the general purpose registers and only q0-q3 of the FP/SIMD ones,
+# for the hand written NEON routines in ram_e_as.S, so compiled code must not keep values in FP/SIMD registers.
+# EL0 code traps on any FP/SIMD instruction
+PROFILE_CFLAGS = -mgeneral-regs-only
+PROFILE_LTO =
+PROFILE_LDFLAGS =
+
+ifeq ($(PROFILE),debug)
+PROFILE_CFLAGS += -g -O0
+else ifeq ($(PROFILE),release)
+PROFILE_CFLAGS += -g -O2 -ffunction-sections -fdata-sections
+PROFILE_LTO = -flto
+PROFILE_LDFLAGS = -Wl,--gc-sections
+KLOG_LEVEL ?= 2
+else ifeq ($(PROFILE),profile)
+PROFILE_CFLAGS += -g -O2 -fno-omit-frame-pointer
+else
+$(error Unknown PROFILE '$(PROFILE)', expected debug, release or profile)
+endif
+
+# The kernel's own memset and memcpy must not be turned back into calls to themselves,
+# and memory is reinterpreted through pointer casts throughout
+ifneq ($(PROFILE),debug)
+PROFILE_CFLAGS += -fno-tree-loop-distribute-patterns -fno-strict-aliasing
+endif
+
+# Every object depends on the stamp, which is rewritten when the profile changes, so switching rebuilds everything
+PROFILE_STAMP = .profile
+ifneq ($(shell cat $(PROFILE_STAMP) 2>/dev/null),$(PROFILE))
+$(shell echo $(PROFILE) > $(PROFILE_STAMP))
+endif
@@ -7,6 +7,13 @@ typedef struct {
     uint64_t sp;        // Stack pointer
     uint64_t pc;        // Program counter
     uint64_t spsr;      // Saved program status register
+    uint64_t simd[8];   // q0-q3, the only SIMD registers code may use, see memcpy_simd
     uint64_t id;        // Process ID
     enum { READY, RUNNING, BLOCKED } state; // Process state
+    uint64_t code_base; // Where relocated code was copied to, 0 for code that runs in place
+    uint64_t code_origin; // Link address of the relocated code, to symbolize its PCs against kernel.elf
+    uint64_t code_size;
+    uint64_t cpu_ticks; // Counter ticks spent running, including the interrupts taken meanwhile
+    uint64_t switches; // Times the process was switched to
+    uint64_t wake_ticks; // Counter value of the wake_proc that made it ready, 0 once it ran
 } process_t;
\ No newline at end of file
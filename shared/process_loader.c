@@ -24,7 +24,7 @@ void relocate_code(void* dst, void* src, uint32_t size, uint64_t src_data_base,
     uint64_t dst_base = (uint64_t)dst32;
     uint32_t count = size / 4;
 
-    kprintf_raw("Beginning translation from base address %h to new address %h", src_base, dst_base);
+    klog_debug(KLOG_SYS_PROC, "Beginning translation from base address %h to new address %h", src_base, dst_base);
 
     for (uint32_t i = 0; i < count; i++) {
         /*
@@ -51,9 +51,9 @@ void relocate_code(void* dst, void* src, uint32_t size, uint64_t src_data_base,
             }
         
             //kprintf_raw("Branch op %i to %h (%s)", op, target, (uint64_t)(internal ? "internal" : "external"));
-        } else if ((instr >> 24) == 84) { // B.cond (untested)
+        } else if ((instr >> 24) == 84) { // B.cond
             int32_t offset = ((int32_t)(instr >> 5) & 0x7FFFF);
-            offset = (offset << 6) >> 6;
+            offset = (offset << 13) >> 13; // Sign extend the 19 bit offset
             offset *= 4;
             uint64_t target = src_base + (i * 4) + offset;
             bool internal = (target >= src_base) && (target < src_base + size);
@@ -73,7 +73,7 @@ void relocate_code(void* dst, void* src, uint32_t size, uint64_t src_data_base,
             uint64_t pc_page = (src_base + i * 4) & ~0xFFFULL;
             uint64_t target = pc_page + offset;
 
-            kprintf_raw("Was at offset %i of original code, so at address %h and data started at %h",offset,target,src_data_base);
+            klog_debug(KLOG_SYS_PROC, "Was at offset %i of original code, so at address %h and data started at %h",offset,target,src_data_base);
             
             // uint64_t target = (src_base & ~0xFFFULL) + ((i * 4 + offset) & ~0xFFFULL);
             bool internal = (target >= src_data_base) && (target < src_data_base + data_size);
@@ -104,16 +104,16 @@ void relocate_code(void* dst, void* src, uint32_t size, uint64_t src_data_base,
                 pc_page = (dst_base + i * 4) & ~0xFFFULL;
                 target = pc_page + offset;
 
-                kprintf_raw("Confirmation: New address is %h compared to calculated one %h",target, new_target);
+                klog_debug(KLOG_SYS_PROC, "Confirmation: New address is %h compared to calculated one %h",target, new_target);
             } else {
-                kprintf_raw("[ERROR]: Symbol not supported");
+                klog_error(KLOG_SYS_PROC, "Symbol not supported at offset %h", (uint64_t)(i * 4));
             }
         }
 
         dst32[i] = instr;
     }
 
-    kprintf_raw("Finished translation");
+    klog_debug(KLOG_SYS_PROC, "Finished translation");
 }
 
 process_t* create_process(void (*func)(), uint64_t code_size, uint64_t func_base, void* data, uint64_t data_size) {
@@ -138,7 +138,7 @@ process_t* create_process(void (*func)(), uint64_t code_size, uint64_t func_base
     if (!code_dest) return 0;
 
     // We need to relocate the code to the new memory location because the original code might be in a different memory region
-    relocate_code(code_dest, func, code_size, (uint64_t)&data[0], (uint64_t)&data_dest[0], data_size);
+    relocate_code(code_dest, func, code_size, (uint64_t)data, (uint64_t)data_dest, data_size);
     
     kprintf_raw("Code copied to %h", (uint64_t)code_dest);
     uint64_t stack_size = 0x1000;
@@ -150,6 +150,9 @@ process_t* create_process(void (*func)(), uint64_t code_size, uint64_t func_base
     proc->sp = (stack + stack_size);
     
     proc->pc = (uint64_t)code_dest;
+    proc->code_base = (uint64_t)code_dest;
+    proc->code_origin = (uint64_t)func;
+    proc->code_size = code_size;
     kprintf_raw("Process allocated with address at %h, stack at %h",proc->pc, proc->sp);
     proc->spsr = 0;
     proc->state = READY;
@@ -3,4 +3,5 @@
 #include "types.h"
 #include "process.h"
 
+void relocate_code(void* dst, void* src, uint32_t size, uint64_t src_data_base, uint64_t dst_data_base, uint32_t data_size);
 process_t* create_process(void (*func)(), uint64_t code_size, uint64_t func_base, void* data, uint64_t data_size);
\ No newline at end of file
@@ -3,11 +3,39 @@
 #include "types.h"
 
 #define PRINTF_SYSCALL 3
+#define GFX_MAP_SYSCALL 4
+#define GFX_PRESENT_SYSCALL 5
+#define READ_SYSCALL 6
+#define INPUT_MODE_SYSCALL 7
+#define PROFILE_SYSCALL 8
+
+#define GFX_MAP_SCANOUT 0 // Map the kernel's drawing surface. On ramfb that is the back buffer, so writes appear only after gfx_present
+#define GFX_MAP_OFFSCREEN 1 // Map a private surface, copied to the screen on present
+
+#define INPUT_ECHO 0x1 // Echo typed characters back to the console
+#define INPUT_CANONICAL 0x2 // Line buffered with backspace editing, read returns whole lines
+
+#define PROFILE_STOP 0
+#define PROFILE_START 1 // Sample at the given rate in Hz, from 1 to 100000, faster rates are clamped
+#define PROFILE_DUMP 2 // Stop and write the samples to the serial port
+
+typedef struct {
+    uint64_t base;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
+}__attribute__((packed)) gfx_surface_info;
 
 extern void printf_args(const char *fmt, const uint64_t *args, uint32_t arg_count);
+extern uint64_t gfx_map_framebuffer(uint32_t flags, gfx_surface_info *info);
+extern void gfx_present(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+extern uint64_t read_input(char *buf, uint64_t len);
+extern void set_input_mode(uint32_t mode);
+extern uint64_t profile_control(uint32_t action, uint32_t hz);
 
 #define printf(fmt, ...) \
     ({  \
         uint64_t _args[] = { __VA_ARGS__ }; \
         printf_args((fmt), _args, sizeof(_args) / sizeof(_args[0])); \
-    })
\ No newline at end of file
+    })
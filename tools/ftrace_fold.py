@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+tools/ftrace_fold.py
+Symbolizes a function entry/exit dump from a `make INSTRUMENT=1` kernel against kernel.elf
+and folds it into flame graph stacks, one "caller;callee;... nanoseconds" line per stack, counting self time.
+The output feeds flamegraph.pl or speedscope directly. --top also prints the functions with the most inclusive time.
+Interrupt handlers of instrumented drivers show up as callees of whatever function they interrupted.
+The dump is ftrace.log with semihosting, or the serial log otherwise.
+Example usage: tools/ftrace_fold.py ftrace.log kernel.elf -o boot.folded --top 20
+"""
+import argparse
+import bisect
+import collections
+import re
+import shutil
+import subprocess
+import sys
+
+LINE = re.compile(r"\[FTRACE\] (.*)")
+EXIT = 1
+
+
+def find_nm():
+    for tool in ("aarch64-none-elf-nm", "aarch64-linux-gnu-nm", "llvm-nm", "nm"):
+        if shutil.which(tool):
+            return tool
+    sys.exit("no nm found to read kernel.elf symbols")
+
+
+class Symbols:
+    def __init__(self, elf):
+        out = subprocess.run([find_nm(), "-n", "--defined-only", elf],
+                             capture_output=True, text=True, check=True).stdout
+        self.addresses = []
+        self.names = []
+        for line in out.splitlines():
+            parts = line.split()
+            if len(parts) == 3 and parts[1] in "TtWw":
+                self.addresses.append(int(parts[0], 16))
+                self.names.append(parts[2])
+
+    def lookup(self, address):
+        i = bisect.bisect_right(self.addresses, address) - 1
+        if i < 0:
+            return "0x%x" % address
+        return self.names[i]
+
+
+def parse(lines):
+    """
+    Returns the counter frequency, dropped count and (timestamp, address) records of the last complete dump.
+    """
+    dump = None
+    result = None
+    for raw in lines:
+        m = LINE.search(raw)
+        if not m:
+            continue
+        fields = m.group(1).split()
+        if fields[0] == "begin":
+            dump = {"freq": int(fields[2]), "dropped": int(fields[4]), "records": []}
+        elif dump is None:
+            continue
+        elif fields[0] == "end":
+            result = dump
+            dump = None
+        else:
+            dump["records"].append((int(fields[0], 16), int(fields[1], 16)))
+    if result is None:
+        sys.exit("no complete [FTRACE] dump found")
+    return result
+
+
+def fold(dump, symbols):
+    """
+    Replays the entries and exits as a call stack. Time between two records is charged to the stack that was
+    current, and an exit pops back to the matching entry, so a missed exit does not corrupt the rest of the trace.
+    """
+    to_ns = 1e9 / dump["freq"]
+    folded = collections.Counter()
+    inclusive = collections.Counter()
+    stack = []  # (name, entry timestamp)
+    last = None
+    for ts, address in dump["records"]:
+        if last is not None and stack:
+            folded[";".join(name for name, _ in stack)] += (ts - last) * to_ns
+        last = ts
+        name = symbols.lookup(address & ~EXIT)
+        if not address & EXIT:
+            stack.append((name, ts))
+            continue
+        while stack:
+            top, start = stack.pop()
+            if top == name:
+                if all(n != name for n, _ in stack):  # Count recursive calls once
+                    inclusive[name] += (ts - start) * to_ns
+                break
+    for name, start in stack:  # Still running when the dump was taken
+        if last is not None:
+            inclusive[name] += (last - start) * to_ns
+    return folded, inclusive
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="serial output containing an [FTRACE] dump")
+    parser.add_argument("elf", help="kernel.elf the dump was taken with")
+    parser.add_argument("-o", "--output", default="-", help="folded stacks output, - for stdout")
+    parser.add_argument("--top", type=int, default=0, help="print the N functions with the most inclusive time")
+    args = parser.parse_args()
+
+    with open(args.capture, errors="replace") as f:
+        dump = parse(f)
+    folded, inclusive = fold(dump, Symbols(args.elf))
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    for stack, ns in sorted(folded.items()):
+        if int(ns):
+            out.write("%s %d\n" % (stack, ns))
+    if out is not sys.stdout:
+        out.close()
+
+    if dump["dropped"]:
+        print("warning: %d calls dropped after the buffer filled" % dump["dropped"], file=sys.stderr)
+    if args.top:
+        print("%-40s %14s" % ("function", "inclusive us"), file=sys.stderr)
+        for name, ns in inclusive.most_common(args.top):
+            print("%-40s %14.1f" % (name, ns / 1000), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
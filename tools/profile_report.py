@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+tools/profile_report.py
+Symbolizes a sampling profiler dump against kernel.elf and prints the hottest functions.
+Samples from relocated process code are mapped back to their link address first, using the map lines in the dump.
+User binaries linked separately can be added with --user ELF, their samples are looked up there as well.
+Start the profiler with Ctrl-P on the serial console (or the profile syscall), press Ctrl-P again to dump,
+With semihosting enabled, as ./run does, the dump is written to profile.log. Otherwise save the serial output,
+e.g. by running QEMU with `-serial file:serial.log`.
+Example usage: tools/profile_report.py profile.log kernel.elf --top 30
+"""
+import argparse
+import bisect
+import collections
+import re
+import shutil
+import subprocess
+import sys
+
+LINE = re.compile(r"\[PROFILE\] (.*)")
+
+
+def find_nm():
+    for tool in ("aarch64-none-elf-nm", "aarch64-linux-gnu-nm", "llvm-nm", "nm"):
+        if shutil.which(tool):
+            return tool
+    sys.exit("no nm found to read symbols")
+
+
+class Symbols:
+    def __init__(self, elfs):
+        symbols = []
+        for elf in elfs:
+            out = subprocess.run([find_nm(), "-n", "-S", "--defined-only", elf],
+                                 capture_output=True, text=True, check=True).stdout
+            for line in out.splitlines():
+                parts = line.split()
+                if len(parts) == 4 and parts[2] in "TtWw":
+                    symbols.append((int(parts[0], 16), int(parts[1], 16), parts[3]))
+                elif len(parts) == 3 and parts[1] in "TtWw":
+                    symbols.append((int(parts[0], 16), 0, parts[2]))
+        symbols.sort()
+        self.addresses = [s[0] for s in symbols]
+        self.symbols = symbols
+
+    def lookup(self, address):
+        i = bisect.bisect_right(self.addresses, address) - 1
+        if i < 0:
+            return None
+        start, size, name = self.symbols[i]
+        if size and address >= start + size:
+            return None
+        return name
+
+
+def parse(lines):
+    dump = None
+    result = None
+    for raw in lines:
+        m = LINE.search(raw)
+        if not m:
+            continue
+        fields = m.group(1).split()
+        if fields[0] == "begin":
+            dump = {"hz": int(fields[2]), "source": fields[4], "dropped": int(fields[8]), "maps": {}, "samples": []}
+        elif dump is None:
+            continue
+        elif fields[0] == "map":
+            dump["maps"][int(fields[1])] = tuple(int(f, 16) for f in fields[2:5])
+        elif fields[0] == "end":
+            result = dump
+            dump = None
+        else:
+            dump["samples"].append((int(fields[0], 16), int(fields[1]), int(fields[2])))
+    if result is None:
+        sys.exit("no complete [PROFILE] dump found")
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="serial output containing a [PROFILE] dump")
+    parser.add_argument("elf", help="kernel.elf the dump was taken with")
+    parser.add_argument("--user", action="append", default=[], help="additional user ELF to symbolize against")
+    parser.add_argument("--top", type=int, default=25)
+    args = parser.parse_args()
+
+    with open(args.capture, errors="replace") as f:
+        dump = parse(f)
+    symbols = Symbols([args.elf] + args.user)
+
+    functions = collections.Counter()
+    by_el = collections.Counter()
+    by_pid = collections.Counter()
+    for pc, el, pid in dump["samples"]:
+        mapping = dump["maps"].get(pid)
+        if mapping and mapping[0] <= pc < mapping[0] + mapping[2]:
+            pc = pc - mapping[0] + mapping[1]
+        name = symbols.lookup(pc) or "0x%x" % pc
+        functions[(name, el)] += 1
+        by_el[el] += 1
+        by_pid[pid] += 1
+
+    total = len(dump["samples"])
+    if not total:
+        sys.exit("the dump has no samples")
+    print("%d samples at %d Hz from the %s, %d dropped" % (total, dump["hz"], dump["source"], dump["dropped"]))
+    print("by exception level: " + ", ".join("EL%d %.1f%%" % (el, n * 100 / total) for el, n in sorted(by_el.items())))
+    print("by process: " + ", ".join("pid %d %.1f%%" % (pid, n * 100 / total) for pid, n in sorted(by_pid.items())))
+    print()
+    print("%8s %7s  %-3s %s" % ("samples", "percent", "EL", "function"))
+    for (name, el), n in functions.most_common(args.top):
+        print("%8d %6.1f%%  %-3d %s" % (n, n * 100 / total, el, name))
+
+
+if __name__ == "__main__":
+    main()
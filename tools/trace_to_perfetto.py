@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+tools/trace_to_perfetto.py
+Converts a kernel trace dump, captured from the serial console, into Chrome trace JSON
+that chrome://tracing and ui.perfetto.dev can open.
+Start tracing with Ctrl-T on the serial console (or build with `make TRACE=1`), press Ctrl-T again to dump,
+With semihosting enabled, as ./run does, the dump is written to trace.log. Otherwise save the serial output,
+e.g. by running QEMU with `-serial file:serial.log`.
+Example usage: tools/trace_to_perfetto.py trace.log -o trace.json
+"""
+import argparse
+import json
+import re
+import sys
+
+LINE = re.compile(r"\[TRACE\] (.*)")
+
+
+def parse(lines):
+    """
+    Returns the counter frequency, event names and records of the last complete dump in the capture.
+    Records are (cpu, timestamp, event, arg0, arg1) tuples.
+    """
+    dump = None
+    result = None
+    for raw in lines:
+        m = LINE.search(raw)
+        if not m:
+            continue
+        fields = m.group(1).split()
+        if fields[0] == "begin":
+            dump = {"freq": int(fields[2]), "names": {}, "records": [], "lost": 0}
+        elif dump is None:
+            continue
+        elif fields[0] == "event":
+            dump["names"][int(fields[1], 16)] = fields[2]
+        elif fields[0] == "lost":
+            dump["lost"] += int(fields[2])
+        elif fields[0] == "end":
+            result = dump
+            dump = None
+        else:
+            dump["records"].append(tuple(int(f, 16) for f in fields[:5]))
+    if result is None:
+        sys.exit("no complete [TRACE] dump found")
+    return result
+
+
+def convert(dump):
+    """
+    Builds the Chrome trace events. Interrupts and syscalls become duration slices,
+    virtqueue commands become async slices from submit to completion, the scheduler becomes
+    one track per process showing when it ran, and allocator calls become instant events.
+    """
+    freq = dump["freq"]
+    names = dump["names"]
+    records = sorted(dump["records"], key=lambda r: r[1])
+    if not records:
+        return []
+    base = records[0][1]
+
+    def us(ticks):
+        return (ticks - base) * 1e6 / freq
+
+    events = []
+    running = {}  # cpu -> (pid, start)
+    pending_vq = {}  # (cpu, command type) -> async slice id
+    for cpu, ts, event, a0, a1 in records:
+        name = names.get(event, "event_%x" % event)
+        t = us(ts)
+        if name == "switch":
+            if cpu in running:
+                pid, start = running[cpu]
+                events.append({"name": "pid %d" % pid, "ph": "X", "ts": start, "dur": t - start,
+                               "pid": cpu, "tid": "pid %d" % pid, "cat": "sched"})
+            running[cpu] = (a1, t)
+        elif name == "irq_entry":
+            events.append({"name": "irq %d" % a0, "ph": "B", "ts": t, "pid": cpu, "tid": "irq",
+                           "cat": "irq", "args": {"entry_latency_us": (ts - a1) * 1e6 / freq}})
+        elif name == "irq_exit":
+            events.append({"name": "irq %d" % a0, "ph": "E", "ts": t, "pid": cpu, "tid": "irq",
+                           "args": {"result": a1}})
+        elif name == "syscall_entry":
+            events.append({"name": "syscall %d" % a0, "ph": "B", "ts": t, "pid": cpu, "tid": "syscall",
+                           "cat": "syscall", "args": {"pid": a1}})
+        elif name == "syscall_exit":
+            events.append({"name": "syscall %d" % a0, "ph": "E", "ts": t, "pid": cpu, "tid": "syscall",
+                           "args": {"result": a1}})
+        elif name == "vq_submit":
+            pending_vq[(cpu, a0)] = "%d-%d" % (cpu, a1)
+            events.append({"name": "cmd %#x" % a0, "ph": "b", "ts": t, "pid": cpu, "tid": "virtqueue",
+                           "cat": "virtq", "id": pending_vq[(cpu, a0)]})
+        elif name == "vq_complete":
+            if (cpu, a0) in pending_vq:
+                events.append({"name": "cmd %#x" % a0, "ph": "e", "ts": t, "pid": cpu, "tid": "virtqueue",
+                               "cat": "virtq", "id": pending_vq.pop((cpu, a0))})
+        else:
+            events.append({"name": name, "ph": "i", "s": "t", "ts": t, "pid": cpu, "tid": "alloc",
+                           "cat": "alloc", "args": {"size": a0, "address": "%#x" % a1}})
+
+    end = us(records[-1][1])
+    for cpu, (pid, start) in running.items():
+        events.append({"name": "pid %d" % pid, "ph": "X", "ts": start, "dur": end - start,
+                       "pid": cpu, "tid": "pid %d" % pid, "cat": "sched"})
+    for cpu in {r[0] for r in records}:
+        events.append({"name": "process_name", "ph": "M", "pid": cpu, "args": {"name": "cpu %d" % cpu}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="serial output containing a [TRACE] dump")
+    parser.add_argument("-o", "--output", default="trace.json")
+    args = parser.parse_args()
+
+    with open(args.capture, errors="replace") as f:
+        dump = parse(f)
+    events = convert(dump)
+    with open(args.output, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, f)
+    print("%d records, %d lost, written to %s" % (len(dump["records"]), dump["lost"], args.output))
+
+
+if __name__ == "__main__":
+    main()